@@ -9,6 +9,20 @@ namespace tmms
     {
         class DomainInfo;
 
+        /**
+         * @brief 慢速播放者的处理策略
+         *
+         * 播放者落后直播边缘超过内容延迟加 slow_lag 即进入慢速状态，按策略处理；
+         * 落后超过两倍内容延迟时仍会直接跳到最新的 GOP
+         */
+        enum SlowPolicy
+        {
+            kSlowPolicyNone = 0,   ///< 不做处理
+            kSlowPolicyDropNonRef, ///< 丢弃非参考视频帧，保留音频
+            kSlowPolicyAudioOnly,  ///< 只发送音频，恢复后从下一个关键帧开始发送视频
+            kSlowPolicySkipGop,    ///< 跳到下一个 GOP
+        };
+
         class AppInfo
         {
           public:
@@ -29,13 +43,26 @@ namespace tmms
             DomainInfo &domain_info_;                 ///< 关联的域信息引用
             std::string domain_name_;                 ///< 域名称
             std::string app_name_;                    ///< 应用名称
-            uint32_t max_buffer_{1000};               ///< 最大缓冲区大小
+            uint32_t max_buffer_{1000};               ///< 最大缓冲区大小(数据包个数)
+            uint64_t max_buffer_bytes_{32 * 1024 * 1024}; ///< 每路流缓冲区最多占用的内存(字节)，0 表示不限制。不含最新 GOP 超出的部分和各事件循环转发器缓存的数据包
+            uint32_t max_buffer_time_{15 * 1000};     ///< 每路流缓冲区最多保存的时长(毫秒)，0 表示不限制
             bool rtmp_support_{false};                ///< 是否支持RTMP协议
             bool flv_support_{false};                 ///< 是否支持FLV格式
             bool hls_support_{false};                 ///< 是否支持HLS协议
             uint32_t content_latency_{3 * 1000};      ///< 内容延迟时间(毫秒)
             uint32_t stream_idle_time_{30 * 1000};    ///< 流空闲超时时间(毫秒)
             uint32_t stream_timeout_time_{30 * 1000}; ///< 流连接超时时间(毫秒)
+            uint32_t wakeup_tick_{5};                 ///< 唤醒播放者的最小间隔(毫秒)，期间的数据包合并投递
+            bool wakeup_on_keyframe_{false};          ///< 是否按关键帧唤醒播放者，没有视频的流仍按唤醒周期
+            int32_t slow_policy_{kSlowPolicyNone};    ///< 慢速播放者的处理策略，参见SlowPolicy
+            uint32_t slow_lag_{1500};                 ///< 播放者在内容延迟之外再落后超过该时长(毫秒)即视为慢速
+            uint32_t slow_disconnect_time_{0};        ///< 慢速状态持续超过该时长(毫秒)时断开连接，0 表示不断开
+            uint32_t rtmp_chunk_size_{4096};          ///< RTMP连接的输出块大小(字节)，服务器间转发可设为64KB
+            uint32_t rtmp_aggregate_size_{0};         ///< RTMP聚合消息体的最大长度(字节)，0 表示不合并，只在播放者追赶时合并
+            uint32_t join_burst_rate_{0};             ///< 播放者加入后追赶缓存数据的速率，为流码率的百分比，0 表示不限速
+            bool join_socket_pacing_{false};          ///< 追赶期间是否同时用 SO_MAX_PACING_RATE 由内核按该速率发送
+            bool live_edge_join_{false};              ///< 播放者是否从最新的关键帧加入，之前的帧压缩时间戳快速追上
+            uint32_t target_latency_{0};              ///< 播放者的目标延迟(毫秒)，落后超过时压缩追赶到直播边缘，0 表示不启用
         };
     } // namespace base
 } // namespace tmms
\ No newline at end of file
@@ -10,43 +10,100 @@ namespace tmms
     {
         using namespace tmms::mm;
 
+        /**
+         * @brief 编解码头信息表，保存某一时刻的当前头信息和仍在缓冲区范围内的历史头信息
+         *
+         * 表创建后不再修改。头信息变化或历史记录被清除时，写者复制出新表并原子地替换旧表，
+         * 读者取得表的智能指针后即可在不加锁的情况下查询。
+         * 历史记录按帧索引递增排列，按帧索引查询时使用二分查找。
+         */
+        struct CodecHeaderTable
+        {
+            int32_t version{0};                           ///< 表版本号，每次头信息变化加一
+            PacketPtr meta;                               ///< 当前元数据包
+            PacketPtr audio_header;                       ///< 当前音频头信息包
+            PacketPtr video_header;                       ///< 当前视频头信息包
+            std::vector<PacketPtr> meta_packets;          ///< 元数据包的历史记录
+            std::vector<PacketPtr> audio_header_packets;  ///< 音频头信息包的历史记录
+            std::vector<PacketPtr> video_header_packets;  ///< 视频头信息包的历史记录
+
+            /**
+             * @brief 获取第idx帧适用的元数据包
+             *
+             * @param idx 帧索引，小于等于0时返回当前元数据包
+             * @return PacketPtr 指向元数据包的智能指针
+             */
+            PacketPtr Meta(int idx) const;
+
+            /**
+             * @brief 获取第idx帧适用的视频头信息包
+             *
+             * @param idx 帧索引，小于等于0时返回当前视频头信息包
+             * @return PacketPtr 指向视频头信息包的智能指针
+             */
+            PacketPtr VideoHeader(int idx) const;
+
+            /**
+             * @brief 获取第idx帧适用的音频头信息包
+             *
+             * @param idx 帧索引，小于等于0时返回当前音频头信息包
+             * @return PacketPtr 指向音频头信息包的智能指针
+             */
+            PacketPtr AudioHeader(int idx) const;
+        };
+
+        /**
+         * @brief CodecHeaderTablePtr是只读CodecHeaderTable的共享指针类型别名
+         */
+        using CodecHeaderTablePtr = std::shared_ptr<const CodecHeaderTable>;
+
         /**
          * @brief CodecHeader类，处理音视频编解码相关的头信息
          *
          * 负责管理和处理流媒体传输中的编解码头信息，包括元数据、
-         * 音频头信息和视频头信息的存储、解析和获取
+         * 音频头信息和视频头信息的存储、解析和获取。
+         * 发布者线程是唯一的写者；播放者线程通过 Headers() 取得头信息表快照后无锁查询。
          */
         class CodecHeader
         {
+            const size_t kMaxHeaderHistory = 64; ///< 每种头信息最多保留的历史记录数
+
           public:
             CodecHeader();
 
             /**
-             * @brief 获取第idx个元数据包
+             * @brief 原子地获取当前的头信息表快照（可在任意线程调用）
+             *
+             * @return CodecHeaderTablePtr 头信息表，同一快照中的头信息彼此一致
+             */
+            CodecHeaderTablePtr Headers() const;
+
+            /**
+             * @brief 获取第idx帧适用的元数据包
              *
-             * @param idx 元数据包的索引
+             * @param idx 帧索引
              * @return PacketPtr 指向元数据包的智能指针
              */
-            PacketPtr Meta(int idx);
+            PacketPtr Meta(int idx) const;
 
             /**
-             * @brief 获取第idx个视频头信息包
+             * @brief 获取第idx帧适用的视频头信息包
              *
-             * @param idx 视频头信息包的索引
+             * @param idx 帧索引
              * @return PacketPtr 指向视频头信息包的智能指针
              */
-            PacketPtr VideoHeader(int idx);
+            PacketPtr VideoHeader(int idx) const;
 
             /**
-             * @brief 获取第idx个音频头信息包
+             * @brief 获取第idx帧适用的音频头信息包
              *
-             * @param idx 音频头信息包的索引
+             * @param idx 帧索引
              * @return PacketPtr 指向音频头信息包的智能指针
              */
-            PacketPtr AudioHeader(int idx);
+            PacketPtr AudioHeader(int idx) const;
 
             /**
-             * @brief 保存元数据包
+             * @brief 保存元数据包（仅限写者调用）
              *
              * @param packet 要保存的元数据包
              *
@@ -64,7 +121,7 @@ namespace tmms
             void ParseMeta(const PacketPtr &packet);
 
             /**
-             * @brief 保存音频头信息包
+             * @brief 保存音频头信息包（仅限写者调用）
              *
              * @param packet 要保存的音频头信息包
              *
@@ -73,7 +130,7 @@ namespace tmms
             void SaveAudioHeader(const PacketPtr &packet);
 
             /**
-             * @brief 保存视频头信息包
+             * @brief 保存视频头信息包（仅限写者调用）
              *
              * @param packet 要保存的视频头信息包
              *
@@ -82,7 +139,7 @@ namespace tmms
             void SaveVideoHeader(const PacketPtr &packet);
 
             /**
-             * @brief 解析编解码头信息
+             * @brief 解析编解码头信息（仅限写者调用）
              *
              * @param packet 要解析的编解码头信息包
              * @return bool 解析是否成功，成功返回true，失败返回false
@@ -91,19 +148,45 @@ namespace tmms
              */
             bool ParseCodecHeader(const PacketPtr &packet);
 
-            
+            /**
+             * @brief 清除已被淘汰的历史头信息（仅限写者调用）
+             *
+             * @param min_idx 流缓冲区的淘汰点（仍然有效的最小帧索引）
+             *
+             * 每种头信息只保留淘汰点之前（含）最新的一个，以及淘汰点之后的所有记录，
+             * 保证从缓冲区内任意位置开始播放时仍能找到对应的头信息。没有可清除的记录时不会替换头信息表
+             */
+            void Prune(int64_t min_idx);
+
             ~CodecHeader();
 
           private:
-            PacketPtr video_header_; ///< 存储当前视频头信息的包
-            PacketPtr audio_header_; ///< 存储当前音频头信息的包
-            PacketPtr meta_;         ///< 存储当前元数据包
-            int meta_version_{0};    ///< 元数据版本号，用于跟踪元数据更新
-            int audio_version_{0}; ///< 音频头信息版本号，用于跟踪音频编解码信息更新
-            int video_version_{0}; ///< 视频头信息版本号，用于跟踪视频编解码信息更新
-            std::vector<PacketPtr> video_header_packets_; ///< 存储多个视频头信息包的历史记录
-            std::vector<PacketPtr> audio_header_packets_; ///< 存储多个音频头信息包的历史记录
-            std::vector<PacketPtr> meta_packets_; ///< 存储多个元数据包的历史记录
+            /**
+             * @brief 复制当前头信息表，用于写者修改后发布
+             *
+             * @return std::shared_ptr<CodecHeaderTable> 当前表的副本
+             */
+            std::shared_ptr<CodecHeaderTable> CopyHeaders() const;
+
+            /**
+             * @brief 发布新的头信息表
+             *
+             * @param table 修改后的头信息表
+             */
+            void StoreHeaders(std::shared_ptr<CodecHeaderTable> table);
+
+            /**
+             * @brief 向历史记录中追加一个头信息包，超过上限时丢弃最旧的记录
+             *
+             * @param packets 历史记录
+             * @param packet 头信息包
+             */
+            void AppendHistory(std::vector<PacketPtr> &packets, const PacketPtr &packet);
+
+            CodecHeaderTablePtr headers_; ///< 当前头信息表，通过 std::atomic_load/std::atomic_store 访问
+            int meta_version_{0};         ///< 元数据版本号，用于跟踪元数据更新
+            int audio_version_{0};        ///< 音频头信息版本号，用于跟踪音频编解码信息更新
+            int video_version_{0};        ///< 视频头信息版本号，用于跟踪视频编解码信息更新
             int64_t start_timestamp_{0}; ///< 编解码开始的时间戳，记录流的起始时间点
         };
     } // namespace live
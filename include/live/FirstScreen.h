@@ -0,0 +1,122 @@
+#pragma once
+#include "mmedia/base/Packet.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace tmms
+{
+    namespace live
+    {
+        using namespace tmms::mm;
+
+        /**
+         * @brief 首屏数据：新加入的播放者一次发送的元数据、编解码头和从关键帧开始的 GOP
+         *
+         * 由流按 GOP 构建，构建后不再修改，在同一时间加入的播放者之间共享。
+         * 各协议序列化后的数据按使用方定义的键缓存（如 RTMP 的块大小），相同参数的播放者只序列化一次。
+         */
+        class FirstScreen
+        {
+          public:
+            /**
+             * @brief 构造函数
+             * @param gop_index GOP 关键帧的索引
+             * @param packets 元数据、编解码头和 GOP 内的帧，编解码头在前
+             * @param headers packets 中元数据和编解码头的个数
+             * @param truncated 是否因字节数上限没有包含到最新帧
+             * @param catchup_end 从关键帧到该时间戳的帧压缩时间戳追赶，0 表示不追赶
+             */
+            FirstScreen(int32_t gop_index, std::vector<PacketPtr> &&packets, size_t headers,
+                        bool truncated, int64_t catchup_end);
+
+            /**
+             * @brief 获取 GOP 关键帧的索引
+             * @return int32_t 关键帧索引
+             */
+            int32_t GopIndex() const;
+
+            /**
+             * @brief 获取包含的最后一帧的索引，播放者从下一帧开始正常获取
+             * @return int32_t 帧索引
+             */
+            int32_t LastIndex() const;
+
+            /**
+             * @brief 获取包含的最后一帧的时间戳
+             * @return int64_t 时间戳（毫秒）
+             */
+            int64_t LastTimeStamp() const;
+
+            /**
+             * @brief 获取首屏的数据包，前 Headers() 个为元数据和编解码头
+             * @return const std::vector<PacketPtr>& 数据包列表
+             */
+            const std::vector<PacketPtr> &Packets() const;
+
+            /**
+             * @brief 获取元数据和编解码头的个数
+             * @return size_t 个数
+             */
+            size_t Headers() const;
+
+            /**
+             * @brief 检查是否因字节数上限没有包含到最新帧
+             * @return 被截断返回true，否则返回false
+             */
+            bool Truncated() const;
+
+            /**
+             * @brief 获取关键帧的时间戳
+             * @return int64_t 时间戳（毫秒）
+             */
+            int64_t GopTimeStamp() const;
+
+            /**
+             * @brief 获取压缩时间戳追赶的终点，即构建时直播边缘的时间戳
+             * @return int64_t 时间戳（毫秒），0 表示不追赶
+             */
+            int64_t CatchupEnd() const;
+
+            /**
+             * @brief 获取包含的帧的字节数，不含元数据和编解码头
+             * @return int64_t 字节数
+             */
+            int64_t Bytes() const;
+
+            /**
+             * @brief 查找序列化后的数据
+             * @param key 缓存键
+             * @return PacketPtr 序列化后的数据，不存在时返回 nullptr
+             * @note 线程安全
+             */
+            PacketPtr FindEncoded(int64_t key) const;
+
+            /**
+             * @brief 添加序列化后的数据
+             * @param key 缓存键
+             * @param data 序列化后的数据
+             * @return PacketPtr 最终生效的数据，其他线程已经添加了相同键的数据时返回已存在的数据
+             * @note 线程安全
+             */
+            PacketPtr AddEncoded(int64_t key, const PacketPtr &data);
+
+          private:
+            int32_t gop_index_{-1};                     ///< GOP 关键帧的索引
+            std::vector<PacketPtr> packets_;            ///< 元数据、编解码头和 GOP 内的帧
+            size_t headers_{0};                         ///< 元数据和编解码头的个数
+            bool truncated_{false};                     ///< 是否因字节数上限没有包含到最新帧
+            int64_t catchup_end_{0};                    ///< 压缩时间戳追赶的终点
+            int64_t bytes_{0};                          ///< 包含的帧的字节数
+            mutable std::mutex lock_;                   ///< 保护序列化缓存
+            std::unordered_map<int64_t, PacketPtr> encoded_; ///< 各协议序列化后的数据
+        };
+
+        /**
+         * @brief FirstScreenPtr是FirstScreen的共享指针类型别名
+         */
+        using FirstScreenPtr = std::shared_ptr<FirstScreen>;
+    } // namespace live
+} // namespace tmms
@@ -1,5 +1,6 @@
 #pragma once
 #include "mmedia/base/Packet.h"
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <vector>
@@ -30,17 +31,29 @@ namespace tmms
 
         /**
          * @brief GOP管理器类，用于管理视频GOP（图像组）
+         *
+         * GOP 索引保存在定长环形数组中，由发布者线程单独写入，播放者线程并发读取。
+         * 读者通过版本号（seqlock）校验读取结果，版本号在读取期间发生变化时重新读取。
+         * 过期清除只需前移头部位置，按延迟查找时对关键帧时间戳做二分查找。
+         * 同时维护 GOP 时长和字节数的滑动平均值，供播放者加入和跳帧时参考。
          */
         class GopMgr
         {
           public:
             /**
-             * @brief 默认构造函数
+             * @brief 构造函数
+             * @param capacity 最多保存的 GOP 数量
+             */
+            explicit GopMgr(uint32_t capacity = 1000);
+
+            /**
+             * @brief 重新设置最多保存的 GOP 数量（仅限添加任何帧之前调用）
+             * @param capacity 最多保存的 GOP 数量
              */
-            GopMgr() = default;
+            void Reset(uint32_t capacity);
 
             /**
-             * @brief 添加一帧到GOP管理器
+             * @brief 添加一帧到GOP管理器（仅限写者调用）
              * @param packet 媒体数据包
              */
             void AddFrame(const PacketPtr &packet);
@@ -57,16 +70,43 @@ namespace tmms
              */
             size_t GopSize() const;
 
+            /**
+             * @brief 获取GOP平均时长
+             * @return 最近若干个GOP时长的滑动平均值（毫秒），尚无完整GOP时为0
+             */
+            int64_t AvgGopDuration() const;
+
+            /**
+             * @brief 获取GOP平均字节数
+             * @return 最近若干个GOP字节数的滑动平均值，尚无完整GOP时为0
+             */
+            int64_t AvgGopBytes() const;
+
             /**
              * @brief 根据延迟获取GOP索引
              * @param content_latency 内容延迟
              * @param latency 实际延迟（输出参数）
-             * @return GOP索引
+             * @return 延迟不超过content_latency的最旧GOP的索引，没有时返回-1
              */
             int GetGopByLatency(int content_latency, int &latency) const;
 
             /**
-             * @brief 清除过期的GOP
+             * @brief 获取指定帧之后的第一个GOP
+             * @param index 帧索引
+             * @param latency 该GOP关键帧相对最新帧的延迟（输出参数）
+             * @return 关键帧索引大于index的最旧GOP的索引，没有时返回-1
+             */
+            int GetNextGop(int64_t index, int &latency) const;
+
+            /**
+             * @brief 获取最新的GOP
+             * @param latency 该GOP关键帧相对最新帧的延迟（输出参数）
+             * @return 最新GOP的索引，没有时返回-1
+             */
+            int GetLastestGop(int &latency) const;
+
+            /**
+             * @brief 清除过期的GOP（仅限写者调用）
              * @param min_idx 最小索引，低于此索引的GOP将被清除
              */
             void ClearExpriedGop(int min_idx);
@@ -82,7 +122,7 @@ namespace tmms
              */
             int64_t LastestTimeStamp() const
             {
-                return lastest_timestamp_;
+                return lastest_timestamp_.load(std::memory_order_acquire);
             }
 
             /**
@@ -91,13 +131,35 @@ namespace tmms
             ~GopMgr(){};
 
           private:
-            std::vector<GopItemInfo> gops_; ///< 存储GOP项的向量
-            int32_t gop_length_{0};         ///< 当前GOP长度
-            int32_t max_gop_length_{0};     ///< 最大GOP长度
-            int32_t gop_numbers_{0};        ///< GOP项的数量
-            int32_t total_gop_length_{0};   ///< 总GOP长度
-            int64_t lastest_timestamp_{0};  ///< 最新时间戳
-        };
+            /**
+             * @brief GOP 环形数组的槽位，字段使用原子变量以便读者无锁读取
+             */
+            struct GopSlot
+            {
+                std::atomic<int32_t> index{-1};    ///< GOP 关键帧索引
+                std::atomic<int64_t> timestamp{0}; ///< GOP 关键帧时间戳
+            };
+
+            /**
+             * @brief 读取当前所有 GOP 的快照
+             * @param gops 输出的 GOP 列表，按从旧到新的顺序排列
+             */
+            void Snapshot(std::vector<GopItemInfo> &gops) const;
 
+            uint32_t capacity_{0};                    ///< 环形数组容量
+            std::unique_ptr<GopSlot[]> gops_;         ///< 存储GOP项的环形数组
+            std::atomic<uint64_t> head_{0};           ///< 最旧 GOP 的位置
+            std::atomic<uint64_t> tail_{0};           ///< 下一个 GOP 的写入位置
+            std::atomic<uint32_t> version_{0};        ///< 写版本号，奇数表示正在修改
+            int32_t gop_length_{0};                   ///< 当前GOP长度
+            std::atomic<int32_t> max_gop_length_{0};  ///< 最大GOP长度
+            int32_t gop_numbers_{0};                  ///< GOP项的数量
+            int32_t total_gop_length_{0};             ///< 总GOP长度
+            std::atomic<int64_t> lastest_timestamp_{0}; ///< 最新时间戳
+            int64_t gop_timestamp_{-1};               ///< 当前GOP关键帧的时间戳
+            int64_t gop_bytes_{0};                    ///< 当前GOP已累计的字节数
+            std::atomic<int64_t> avg_gop_duration_{0}; ///< GOP时长的滑动平均值
+            std::atomic<int64_t> avg_gop_bytes_{0};   ///< GOP字节数的滑动平均值
+        };
     } // namespace live
-} // namespace tmms
\ No newline at end of file
+} // namespace tmms
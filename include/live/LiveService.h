@@ -3,6 +3,7 @@
 #include "base/Singleton.h"
 #include "base/Task.h"
 #include "base/TaskManager.h"
+#include "mmedia/base/PacketPool.h"
 #include "mmedia/rtmp/RtmpHandler.h"
 #include "network/TcpServer.h"
 #include "network/net/Connection.h"
@@ -149,6 +150,8 @@ namespace tmms
             std::mutex lock_;                  ///< 互斥锁，用于保护共享资源
             std::unordered_map<std::string, SessionPtr>
                 sessions_; ///< 会话表，键为会话名称，值为会话指针
+            mm::PacketPoolStats pool_stats_;   ///< 上次定时器记录的数据包内存池统计
+            int64_t pool_stats_time_{0};       ///< 上次记录内存池统计的时间（毫秒）
         };
 
 /**
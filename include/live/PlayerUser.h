@@ -1,6 +1,6 @@
 #pragma once
 #include "User.h"
-#include "live/base/TimeCorrector.h"
+#include "live/FirstScreen.h"
 #include "mmedia/base/Packet.h"
 #include <vector>
 
@@ -10,11 +10,23 @@ namespace tmms
     {
         using namespace tmms::mm;
 
+        /**
+         * @brief 前向声明StreamRelay类
+         */
+        class StreamRelay;
+
+        /**
+         * @brief StreamRelayPtr是StreamRelay的共享指针类型别名
+         */
+        using StreamRelayPtr = std::shared_ptr<StreamRelay>;
+
         /**
          * @brief 播放用户类，继承自User类，负责处理播放相关的功能
          */
         class PlayerUser : public User
         {
+            const int64_t kCatchupTime = 100; ///< 追赶区间的帧压缩到的输出时长(毫秒)
+
           public:
             /**
              * @brief 声明Stream类为友元类，允许Stream类访问PlayerUser的私有成员
@@ -69,13 +81,34 @@ namespace tmms
              */
             virtual bool PostFrames() = 0;
 
+          protected:
             /**
-             * @brief 获取时间校正器
-             * @return 时间校正器的引用
+             * @brief 计算帧的输出时间戳
+             *
+             * 在追赶区间 [catchup_base_, catchup_end_) 内的帧压缩到 kCatchupTime 内输出，
+             * 之后的帧整体前移，再加上跳帧产生的偏移
+             * @param ts 流校正后的时间戳
+             * @return int64_t 输出时间戳，不小于 0
              */
-            TimeCorrector &GetTimeCorrector();
+            int64_t OutTimeStamp(int64_t ts) const;
+
+            /**
+             * @brief 开始压缩时间戳追赶，之前的追赶区间并入时间戳偏移
+             * @param base 追赶区间第一帧的时间戳
+             * @param end 直播边缘的时间戳，之后的帧不再压缩
+             */
+            void StartCatchup(int64_t base, int64_t end);
+
+            /**
+             * @brief 是否处于追赶状态
+             *
+             * 加入后限速追赶期间，或帧落在压缩时间戳的追赶区间内时返回 true，
+             * 此时一次会发送多个积压的帧，适合合并为聚合消息
+             * @param ts 流校正后的时间戳
+             * @return bool 是否处于追赶状态
+             */
+            bool InCatchup(int64_t ts) const;
 
-          protected:
             PacketPtr video_header_;            ///< 视频头信息的指针
             PacketPtr audio_header_;            ///< 音频头信息的指针
             PacketPtr meta_;                    ///< 元数据的指针
@@ -85,12 +118,24 @@ namespace tmms
             int32_t video_header_index_{0};     ///< 视频头索引
             int32_t audio_header_index_{0};     ///< 音频头索引
             int32_t meta_index_{0};             ///< 元数据索引
-            TimeCorrector time_corrector_;      ///< 时间校正器对象
+            int64_t out_ts_offset_{0};          ///< 输出时间戳相对流时间戳的偏移，只在跳帧时修改
             bool wait_timeout_{false};          ///< 是否等待超时
             int32_t out_version_{-1};           ///< 输出版本
             int32_t out_frame_timestamp_{0};    ///< 输出帧时间戳
             std::vector<PacketPtr> out_frames_; ///< 输出帧的指针向量
             int32_t out_index_{-1};             ///< 输出索引
+            uint32_t send_rate_{0};             ///< 连接的发送速率(字节/毫秒)，由子类在获取帧之前更新
+            int64_t slow_since_{0};             ///< 进入慢速状态的时间，0 表示不处于慢速状态
+            bool drop_video_{false};            ///< 是否正在丢弃视频帧（仅音频模式）
+            bool slow_close_{false};            ///< 是否因持续慢速需要断开连接
+            StreamRelayPtr relay_;              ///< 所在事件循环的流转发器
+            FirstScreenPtr first_screen_;       ///< 加入时待发送的首屏数据
+            int64_t burst_start_{0};            ///< 加入后限速追赶的开始时间，0 表示不在追赶
+            int64_t burst_rate_{0};             ///< 追赶期间的发送速率(字节/秒)
+            int64_t burst_bytes_{0};            ///< 追赶期间已获取的字节数
+            TimerPtr burst_timer_;              ///< 追赶额度恢复时重新激活播放者的定时器
+            int64_t catchup_base_{0};           ///< 压缩时间戳追赶区间的起点
+            int64_t catchup_end_{0};            ///< 压缩时间戳追赶区间的终点，不大于起点时不压缩
         };
     } // namespace live
 } // namespace tmms
\ No newline at end of file
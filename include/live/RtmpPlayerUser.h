@@ -52,6 +52,14 @@ namespace tmms
              * @return 推送是否成功
              */
             bool PushFrames(std::vector<PacketPtr> &list);
+
+            /**
+             * @brief 推送首屏数据到客户端
+             *
+             * 首屏数据按块大小编码一次后在播放者之间共享，整体作为一个发送节点写出
+             * @return 推送是否成功
+             */
+            bool PushFirstScreen();
         };
     } // namespace live
 } // namespace tmms
\ No newline at end of file
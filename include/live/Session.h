@@ -21,6 +21,30 @@ namespace tmms
          */
         using UserPtr = std::shared_ptr<User>;
 
+        /**
+         * @brief 会话内慢速播放者处理策略的计数器，由各播放者所在的事件循环并发更新
+         */
+        struct SlowConsumerStats
+        {
+            std::atomic<int64_t> slow_players{0};    ///< 播放者进入慢速状态的次数
+            std::atomic<int64_t> dropped_nonref{0};  ///< 丢弃的非参考视频帧数
+            std::atomic<int64_t> dropped_video{0};   ///< 仅音频模式下丢弃的视频帧数
+            std::atomic<int64_t> gop_skips{0};       ///< 跳到下一个 GOP 的次数
+            std::atomic<int64_t> disconnects{0};     ///< 因持续慢速而断开的连接数
+        };
+
+        /**
+         * @brief 会话内播放者加入追赶的计数器，由各播放者所在的事件循环并发更新
+         */
+        struct JoinBurstStats
+        {
+            std::atomic<int64_t> bursts{0};       ///< 按限速追赶的加入次数
+            std::atomic<int64_t> finished{0};     ///< 追上直播边缘的次数
+            std::atomic<int64_t> total_time{0};   ///< 追上直播边缘的累计耗时(毫秒)
+            std::atomic<int64_t> max_time{0};     ///< 追上直播边缘的最长耗时(毫秒)
+            std::atomic<int64_t> bytes{0};        ///< 追赶期间获取的字节数
+        };
+
         /**
          * @brief 会话类，管理直播流的发布者和播放者
          *
@@ -81,11 +105,6 @@ namespace tmms
              */
             void CloseUser(const UserPtr &user);
 
-            /**
-             * @brief 激活所有播放用户
-             */
-            void ActiveAllPlayers();
-
             /**
              * @brief 添加播放用户到会话
              * @param user 要添加的播放用户指针
@@ -122,6 +141,18 @@ namespace tmms
              */
             AppInfoPtr &GetAppInfo();
 
+            /**
+             * @brief 获取会话的慢速播放者处理计数器
+             * @return 计数器的引用
+             */
+            SlowConsumerStats &GetSlowConsumerStats();
+
+            /**
+             * @brief 获取会话的播放者加入追赶计数器
+             * @return 计数器的引用
+             */
+            JoinBurstStats &GetJoinBurstStats();
+
             /**
              * @brief 判断会话是否有活跃的发布者
              * @return 如果正在发布返回true，否则返回false
@@ -147,6 +178,8 @@ namespace tmms
             UserPtr publisher_;                         ///< 发布者用户指针
             std::mutex lock_;                           ///< 互斥锁，用于线程同步
             std::atomic<int64_t> player_live_time_;     ///< 玩家活动时间，原子类型
+            SlowConsumerStats slow_stats_;              ///< 慢速播放者处理计数器
+            JoinBurstStats burst_stats_;                ///< 播放者加入追赶计数器
         };
     } // namespace live
 } // namespace tmms
\ No newline at end of file
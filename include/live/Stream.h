@@ -2,7 +2,10 @@
 #include "PlayerUser.h"
 #include "User.h"
 #include "live/CodecHeader.h"
+#include "live/FirstScreen.h"
 #include "live/GopMgr.h"
+#include "live/StreamRelay.h"
+#include "live/base/PacketRing.h"
 #include "live/base/TimeCorrector.h"
 #include "mmedia/base/Packet.h"
 #include <atomic>
@@ -10,6 +13,7 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace tmms
@@ -36,8 +40,19 @@ namespace tmms
         /**
          * @brief 流类，负责管理和分发媒体流数据
          */
-        class Stream
+        class Stream : public std::enable_shared_from_this<Stream>
         {
+            const int64_t kSkipFrameDelta = 40;          ///< 跳帧后第一帧与上一输出帧之间的时间戳间隔(毫秒)
+            const int64_t kBatchDrainTime = 50;          ///< 每批帧按连接发送速率估算的发送时长(毫秒)
+            const int64_t kMinBatchBytes = 16 * 1024;    ///< 每批帧的最小字节预算
+            const int64_t kMaxBatchBytes = 1024 * 1024;  ///< 每批帧的最大字节预算
+            const int64_t kMinBatchTime = 100;           ///< 每批帧的最小媒体时长预算(毫秒)
+            const int32_t kMaxBatchPackets = 512;        ///< 每批帧的最大帧数，避免单批占用过多发送节点
+            const int64_t kFirstScreenMaxLag = 200;      ///< 首屏数据落后最新帧超过该时长(毫秒)时重新构建
+            const int64_t kJoinBurstEndLag = 200;        ///< 落后最新帧不超过该时长(毫秒)时结束加入追赶
+            const int64_t kMaxKeyframeWakeup = 500;      ///< 按关键帧唤醒时两次唤醒的最长间隔(毫秒)
+            const int32_t kMaxRelayPackets = 512;        ///< 按关键帧唤醒时待投递数据包的最大数量
+
           public:
             /**
              * @brief 构造函数
@@ -46,6 +61,18 @@ namespace tmms
              */
             Stream(Session &s, const std::string &session_name);
 
+            /**
+             * @brief 按应用配置设置缓冲区容量，只在流收到数据之前调用
+             * @param app_info 应用信息指针
+             */
+            void SetAppInfo(const AppInfoPtr &app_info);
+
+            /**
+             * @brief 获取缓冲区中数据包实际占用的内存
+             * @return 内存大小（字节），不包括只被转发器引用的数据包
+             */
+            int64_t BufferBytes() const;
+
             /**
              * @brief 获取流准备就绪的时间
              * @return 准备时间的时间戳
@@ -106,7 +133,46 @@ namespace tmms
              */
             void GetFrames(const PlayerUserPtr &user);
 
+            /**
+             * @brief 将播放用户加入其所在事件循环的转发器
+             * @param user 播放用户指针
+             */
+            void AddPlayer(const PlayerUserPtr &user);
+
+            /**
+             * @brief 将播放用户从其所在事件循环的转发器中移除
+             * @param user 播放用户指针
+             */
+            void RemovePlayer(const PlayerUserPtr &user);
+
           private:
+            /**
+             * @brief 按应用配置的数据包个数、内存和时长上限淘汰最旧的数据包（仅发布者线程调用）
+             *
+             * 淘汰点即缓冲区的最小帧索引，GOP 索引和编解码头历史记录都按同一个淘汰点清除。
+             * 最新的 GOP 总是保留，因此缓冲区可能超出内存上限；各事件循环转发器缓存的数据包
+             * （每个最多 StreamRelay::kMaxRelayPackets 个）不计入内存上限，被淘汰后由转发器释放
+             */
+            void EvictPackets();
+
+            /**
+             * @brief 将待转发的数据包投递到各个事件循环的转发器，每个事件循环只投递一次
+             */
+            void ActiveRelays();
+
+            /**
+             * @brief 在当前事件循环上设置定时器，合并唤醒被推迟的数据包在唤醒周期结束时投递（仅发布者线程调用）
+             * @param delay 距离唤醒周期结束的时间(毫秒)
+             */
+            void ScheduleFlush(int64_t delay);
+
+            /**
+             * @brief 获取特定用户加入和跳帧时使用的延迟
+             * @param user 播放用户指针
+             * @return 应用配置的内容延迟与GOP平均时长中的较大值（毫秒）
+             */
+            int ContentLatency(const PlayerUserPtr &user) const;
+
             /**
              * @brief 为特定用户定位GOP（图像组）
              * @param user 播放用户指针
@@ -114,6 +180,43 @@ namespace tmms
              */
             bool LocateGop(const PlayerUserPtr &user);
 
+            /**
+             * @brief 获取指定 GOP 的首屏数据，没有缓存或缓存已经过期时重新构建
+             *
+             * 首屏数据包含该 GOP 位置的元数据和编解码头，以及从关键帧到最新帧的数据包，
+             * 字节数不超过 kMaxBatchBytes，加入追赶限速时不超过 kMinBatchBytes（至少包含关键帧）。
+             * 同一个 GOP 的缓存被截断或落后最新帧不超过 kFirstScreenMaxLag 时直接复用
+             * @param idx GOP 关键帧索引
+             * @return FirstScreenPtr 首屏数据，关键帧已经不在缓冲区中时返回 nullptr
+             */
+            FirstScreenPtr GetFirstScreen(int32_t idx);
+
+            /**
+             * @brief 按应用配置开始加入追赶限速
+             *
+             * 追赶速率为待追赶数据（从定位的关键帧到最新帧）的码率乘以 join_burst_rate 百分比，
+             * 之后每批获取的字节数不超过按该速率
+             * 累计的额度，超出时设置定时器在额度恢复时再获取。开启 join_socket_pacing 时同时设置连接的
+             * SO_MAX_PACING_RATE，由内核按该速率均匀发送
+             * @param user 播放用户指针
+             */
+            void StartJoinBurst(const PlayerUserPtr &user);
+
+            /**
+             * @brief 结束加入追赶限速，更新会话的计数器并恢复连接的发送速率
+             * @param user 播放用户指针
+             */
+            void EndJoinBurst(const PlayerUserPtr &user);
+
+            /**
+             * @brief 在播放者所在的事件循环上设置定时器，追赶额度恢复时重新激活播放者
+             *
+             * 发布者暂停或发送稀疏时没有转发器唤醒，额度用完的播放者由该定时器继续获取
+             * @param user 播放用户指针
+             * @param delay 距离额度恢复的时间(毫秒)
+             */
+            void ScheduleBurstRefill(const PlayerUserPtr &user, int64_t delay);
+
             /**
              * @brief 为特定用户跳过帧
              * @param user 播放用户指针
@@ -121,7 +224,45 @@ namespace tmms
             void SkipFrame(const PlayerUserPtr &user);
 
             /**
-             * @brief 为特定用户获取下一帧
+             * @brief 跳转到指定的 GOP，更新用户的头信息和输出时间戳偏移
+             * @param user 播放用户指针
+             * @param idx GOP 关键帧索引，无效或不在用户输出索引之后时不跳转
+             * @param lantency 该 GOP 的延迟，用于日志
+             */
+            void SkipToGop(const PlayerUserPtr &user, int idx, int lantency);
+
+            /**
+             * @brief 按应用配置的目标延迟压缩时间戳追赶
+             *
+             * 用户不在追赶中且落后超过 target_latency 时，有更新的 GOP 先跳到最新的关键帧，
+             * 再把到直播边缘的帧压缩到 kCatchupTime 内输出
+             * @param user 播放用户指针
+             * @return 开始追赶返回true，否则返回false
+             */
+            bool CheckTargetLatency(const PlayerUserPtr &user);
+
+            /**
+             * @brief 按应用配置的策略处理慢速播放者
+             *
+             * 用户落后超过内容延迟加 slow_lag 时进入慢速状态，按策略开始仅音频模式或跳到下一个 GOP，
+             * 慢速状态持续超过 slow_disconnect_time 时标记断开连接，并更新会话的计数器
+             * @param user 播放用户指针
+             */
+            void CheckSlowConsumer(const PlayerUserPtr &user);
+
+            /**
+             * @brief 按慢速播放者策略判断是否丢弃帧
+             * @param user 播放用户指针
+             * @param packet 数据包
+             * @return 需要丢弃返回true，否则返回false
+             */
+            bool DropFrame(const PlayerUserPtr &user, const PacketPtr &packet);
+
+            /**
+             * @brief 为特定用户获取下一批帧
+             *
+             * 每批的字节预算由连接的发送速率决定，媒体时长预算由用户落后的时长决定：
+             * 追赶中的用户一次获取较多的帧，处于直播边缘的用户一次只获取少量的帧
              * @param user 播放用户指针
              */
             void GetNextFrame(const PlayerUserPtr &user);
@@ -132,24 +273,31 @@ namespace tmms
              */
             void SetReady(bool ready);
 
-            int64_t data_coming_time_{0};             ///< 数据到达时间
+            std::atomic<int64_t> data_coming_time_{0}; ///< 数据到达时间
             int64_t start_timestamp_{0};              ///< 流开始时间戳
-            int64_t ready_time_{0};                   ///< 准备就绪时间
+            std::atomic<int64_t> ready_time_{0};      ///< 准备就绪时间
             std::atomic<int64_t> stream_time_{0};     ///< 流当前时间
             Session &session_;                        ///< Session引用
             std::string session_name_;                ///< 会话名称
-            std::atomic<int64_t> frame_index_{-1};    ///< 当前帧索引
             uint32_t packet_buffer_size_{1000};       ///< 数据包缓冲区大小
-            std::vector<PacketPtr> packet_buffer_;    ///< 数据包缓冲区
-            bool has_audio_{false};                   ///< 是否有音频
-            bool has_video_{false};                   ///< 是否有视频
-            bool has_meta_{false};                    ///< 是否有元数据
-            bool ready_{false};                       ///< 流是否准备就绪
+            PacketRing packet_buffer_;                ///< 数据包环形缓冲区，其最新索引即当前帧索引
+            std::atomic<int64_t> buffer_bytes_{0};    ///< 缓冲区中数据包占用的内存
+            int64_t keyframe_index_{-1};              ///< 最新关键帧的索引（仅发布者线程访问）
+            std::atomic<bool> has_audio_{false};      ///< 是否有音频
+            std::atomic<bool> has_video_{false};      ///< 是否有视频
+            std::atomic<bool> has_meta_{false};       ///< 是否有元数据
+            std::atomic<bool> ready_{false};          ///< 流是否准备就绪
             std::atomic<int32_t> stream_version_{-1}; ///< 流版本号
             GopMgr gop_mgr_;                          ///< GOP管理器
             CodecHeader codec_headers_;               ///< 编解码头信息
             TimeCorrector time_corrector_;            ///< 时间校正器
-            std::mutex lock_;                         ///< 互斥锁，用于线程同步
+            std::vector<PacketPtr> relay_packets_;    ///< 待投递给转发器的数据包（仅发布者线程访问）
+            int64_t last_wakeup_time_{0};             ///< 上次唤醒播放者的时间（仅发布者线程访问）
+            TimerPtr flush_timer_;                    ///< 投递被推迟的数据包的定时器（仅发布者线程访问）
+            std::unordered_map<EventLoop *, StreamRelayPtr> relays_; ///< 各事件循环的转发器
+            std::mutex relay_lock_;                   ///< 互斥锁，保护转发器列表
+            FirstScreenPtr first_screen_;             ///< 最近构建的首屏数据
+            std::mutex first_screen_lock_;            ///< 互斥锁，保护首屏数据
         };
     } // namespace live
 } // namespace tmms
\ No newline at end of file
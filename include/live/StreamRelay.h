@@ -0,0 +1,92 @@
+#pragma once
+#include "PlayerUser.h"
+#include "mmedia/base/Packet.h"
+#include "network/net/EventLoop.h"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+namespace tmms
+{
+    namespace live
+    {
+        using namespace tmms::mm;
+        using namespace tmms::network;
+
+        /**
+         * @brief PlayerUserPtr是PlayerUser的共享指针类型别名
+         */
+        using PlayerUserPtr = std::shared_ptr<PlayerUser>;
+
+        /**
+         * @brief 流在单个事件循环上的转发器
+         *
+         * 每个有播放者的事件循环各有一个转发器。发布者线程每产生一批数据包，
+         * 只向每个事件循环投递一次，转发器在本循环内缓存最近的数据包并唤醒本循环的播放者，
+         * 播放者读取这些数据包时不需要跨线程同步。
+         * 除构造外，所有方法都只能在转发器所属的事件循环中调用。
+         */
+        class StreamRelay
+        {
+            const size_t kMaxRelayPackets = 512; ///< 转发器最多缓存的数据包数，不计入流的 max_buffer_bytes
+
+          public:
+            /**
+             * @brief 构造函数
+             * @param loop 转发器所属的事件循环
+             */
+            explicit StreamRelay(EventLoop *loop);
+
+            /**
+             * @brief 获取转发器所属的事件循环
+             * @return 事件循环指针
+             */
+            EventLoop *Loop() const;
+
+            /**
+             * @brief 添加本循环的播放者
+             * @param user 播放用户指针
+             */
+            void AddPlayer(const PlayerUserPtr &user);
+
+            /**
+             * @brief 移除本循环的播放者
+             * @param user 播放用户指针
+             */
+            void RemovePlayer(const PlayerUserPtr &user);
+
+            /**
+             * @brief 获取本循环的播放者数量
+             * @return 播放者数量
+             */
+            size_t PlayerSize() const;
+
+            /**
+             * @brief 接收发布者线程投递的一批数据包，缓存后唤醒本循环的播放者
+             * @param packets 按帧索引连续递增的数据包
+             */
+            void OnPackets(const std::vector<PacketPtr> &packets);
+
+            /**
+             * @brief 从本地缓存中获取指定索引的数据包
+             * @param index 帧索引
+             * @return PacketPtr 数据包，不在本地缓存中时返回 nullptr
+             */
+            PacketPtr GetPacket(int64_t index) const;
+
+          private:
+            EventLoop *loop_{nullptr};                  ///< 所属的事件循环
+            std::unordered_set<PlayerUserPtr> players_; ///< 本循环的播放者
+            std::vector<PlayerUserPtr> active_players_; ///< 唤醒播放者时使用的临时列表
+            std::deque<PacketPtr> packets_;             ///< 最近的数据包缓存
+            int64_t first_index_{-1};                   ///< 缓存中第一个数据包的帧索引
+        };
+
+        /**
+         * @brief StreamRelayPtr是StreamRelay的共享指针类型别名
+         */
+        using StreamRelayPtr = std::shared_ptr<StreamRelay>;
+    } // namespace live
+} // namespace tmms
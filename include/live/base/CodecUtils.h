@@ -24,6 +24,14 @@ namespace tmms
              * @return 如果是关键帧返回true，否则返回false
              */
             static bool IsKeyFrame(const PacketPtr &packet);
+
+            /**
+             * @brief 检查包是否是非参考视频帧，丢弃它不影响其他帧的解码
+             * @param packet 待检查的数据包
+             * @return FLV 帧类型为可丢弃的帧间帧，或 AVC 数据中所有片的 nal_ref_idc 都为 0 时返回true
+             * @note AVC 数据按 4 字节 NALU 长度解析
+             */
+            static bool IsNonReferenceFrame(const PacketPtr &packet);
         };
     }
 }
\ No newline at end of file
@@ -0,0 +1,122 @@
+#pragma once
+#include "mmedia/base/Packet.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace tmms
+{
+    namespace live
+    {
+        using namespace tmms::mm;
+
+        /**
+         * @brief 单生产者/多消费者的数据包环形缓冲区
+         *
+         * 发布者所在的事件循环是唯一的写者，各个播放者所在的事件循环并发读取，读写双方都不加锁：
+         * - 每个槽位带有序列号（即槽位中数据包的帧索引），读者以序列号校验槽位内容，
+         *   序列号不匹配说明该槽位已被覆盖或尚未写入
+         * - 读者在复制槽位中的智能指针期间会登记读者计数，写者覆盖槽位前先作废序列号，
+         *   再等待计数归零，保证读者不会读到被撕裂的智能指针
+         */
+        class PacketRing
+        {
+          public:
+            /**
+             * @brief 构造函数
+             * @param capacity 环形缓冲区的槽位数
+             */
+            explicit PacketRing(uint32_t capacity);
+
+            /**
+             * @brief 重新设置缓冲区容量（仅限写入任何数据包之前调用）
+             * @param capacity 环形缓冲区的槽位数
+             */
+            void Reset(uint32_t capacity);
+
+            /**
+             * @brief 写入一个数据包（仅限写者调用）
+             * @param packet 数据包，其索引必须为 LastestIndex() + 1
+             * @note 缓冲区已满时最旧的数据包会被覆盖释放
+             */
+            void Push(PacketPtr &&packet);
+
+            /**
+             * @brief 淘汰最旧的数据包（仅限写者调用）
+             * @note 淘汰后最小帧索引加一，槽位中的数据包随之释放
+             */
+            void PopFront();
+
+            /**
+             * @brief 获取最旧的数据包（仅限写者调用）
+             * @return PacketPtr 最旧的数据包，缓冲区为空时返回 nullptr
+             */
+            const PacketPtr &Front() const;
+
+            /**
+             * @brief 读取指定索引的数据包（可在任意线程调用）
+             * @param index 帧索引
+             * @return PacketPtr 数据包，不在缓冲区内或已被覆盖时返回 nullptr
+             */
+            PacketPtr Get(int64_t index) const;
+
+            /**
+             * @brief 获取最新写入的帧索引
+             * @return int64_t 最新帧索引，尚未写入时为 -1
+             */
+            int64_t LastestIndex() const
+            {
+                return lastest_index_.load(std::memory_order_acquire);
+            }
+
+            /**
+             * @brief 获取缓冲区中仍然有效的最小帧索引，即淘汰点
+             * @return int64_t 最小帧索引
+             */
+            int64_t MinIndex() const
+            {
+                return min_index_.load(std::memory_order_acquire);
+            }
+
+            /**
+             * @brief 获取缓冲区中的数据包数量
+             * @return uint32_t 数据包数量
+             */
+            uint32_t Size() const
+            {
+                return LastestIndex() - MinIndex() + 1;
+            }
+
+            /**
+             * @brief 获取缓冲区容量
+             * @return uint32_t 槽位数
+             */
+            uint32_t Capacity() const
+            {
+                return capacity_;
+            }
+
+          private:
+            /**
+             * @brief 环形缓冲区槽位
+             */
+            struct Slot
+            {
+                std::atomic<int64_t> seq{-1};             ///< 槽位序列号，即数据包帧索引，-1 表示无效
+                mutable std::atomic<int32_t> readers{0};  ///< 正在复制该槽位的读者数
+                PacketPtr packet;                         ///< 数据包
+            };
+
+            /**
+             * @brief 作废槽位并等待正在复制的读者完成，之后写者可以安全地修改槽位
+             * @param slot 槽位
+             */
+            void Invalidate(Slot &slot);
+
+            uint32_t capacity_{0};                 ///< 槽位数
+            std::unique_ptr<Slot[]> slots_;        ///< 槽位数组
+            std::atomic<int64_t> lastest_index_{-1}; ///< 最新写入的帧索引
+            std::atomic<int64_t> min_index_{0};      ///< 仍然有效的最小帧索引
+        };
+    } // namespace live
+} // namespace tmms
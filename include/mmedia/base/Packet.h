@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include <cstdint>
 #include <cstring>
 #include <memory>
@@ -29,6 +30,20 @@ namespace tmms
 
         class Packet;
 
+        /**
+         * @brief 数据包的序列化缓存节点
+         *
+         * 同一个数据包按相同的输出参数（由 key 区分）序列化后的结果是一样的，
+         * 缓存在数据包上以后，多个连接可以直接共享这份数据，不需要各自重复序列化。
+         * 节点一旦挂到数据包上就不再修改，随数据包一起释放。
+         */
+        struct PacketCache
+        {
+            uint64_t key{0};            ///< 缓存键，由使用方定义（如 RTMP 的 chunk size 和 csid）
+            std::string data;           ///< 序列化后的数据
+            PacketCache *next{nullptr}; ///< 下一个缓存节点
+        };
+
         /**
          * @brief Packet 类的智能指针类型别名
          * 使用 shared_ptr 进行自动内存管理
@@ -36,7 +51,24 @@ namespace tmms
         using PacketPtr = std::shared_ptr<Packet>;
 
 #pragma pack(push)
-#pragma pack(1) // 1字节对齐，确保内存布局紧凑
+#pragma pack(1) // 1字节对齐，只用于消息头，确保内存布局紧凑
+
+        /**
+         * @brief 数据包携带的协议消息头
+         *
+         * 直接内嵌在 Packet 中，解析和发送时不需要额外分配内存，也不需要拷贝共享指针。
+         * 字段按 RTMP 消息头定义，其他协议可按需复用。
+         */
+        struct PacketMsgHeader
+        {
+            uint32_t cs_id{0};     ///< 消息所属的通道（chunk stream id）
+            uint32_t timestamp{0}; ///< 协议层的原始时间戳
+            uint32_t msg_len{0};   ///< 消息长度
+            uint8_t msg_type{0};   ///< 消息类型
+            uint32_t msg_sid{0};   ///< 消息流ID
+        };
+
+#pragma pack(pop) // 恢复默认内存对齐，Packet 中的原子变量和指针需要自然对齐
 
         /**
          * @brief 媒体数据包类，用于封装各种类型的媒体数据
@@ -54,7 +86,7 @@ namespace tmms
             /**
              * @brief 构造一个指定容量的数据包
              * @param size 数据包的容量（字节）
-             * @note 实际可用空间为 size - sizeof(Packet)
+             * @note 数据区由 NewPacket 在同一个内存块中分配
              */
             Packet(int32_t size) : capacity_(size)
             {
@@ -64,7 +96,9 @@ namespace tmms
              * @brief 创建一个新的数据包
              * @param size 数据包的容量（字节）
              * @return PacketPtr 指向新创建数据包的智能指针
-             * @note 推荐使用此静态方法创建数据包实例
+             * @note 推荐使用此静态方法创建数据包实例。数据包、引用计数控制块和数据区
+             *       从当前线程的 PacketPool 中一次分配，释放时归还内存池；
+             *       只初始化包头，数据区不清零
              */
             static PacketPtr NewPacket(int32_t size);
 
@@ -134,6 +168,15 @@ namespace tmms
                 return capacity_ - size_;
             }
 
+            /**
+             * @brief 获取数据包的总容量
+             * @return int32_t 容量大小（字节）
+             */
+            inline int32_t Capacity() const
+            {
+                return capacity_;
+            }
+
             /**
              * @brief 设置数据包中实际数据的大小
              * @param len 数据大小（字节）
@@ -210,18 +253,36 @@ namespace tmms
             /**
              * @brief 获取数据包的数据区指针
              * @return char* 指向数据区的指针
-             * @note 数据区紧跟在 Packet 结构体之后
+             * @note 数据区与 Packet 位于同一个内存块中
              */
             inline char *Data()
             {
-                return (char *)this + sizeof(Packet);
+                return data_;
+            }
+
+            /**
+             * @brief 获取内嵌的协议消息头
+             * @return PacketMsgHeader* 指向消息头的指针，随数据包一起释放
+             */
+            inline PacketMsgHeader *MsgHeader()
+            {
+                return &msg_header_;
+            }
+
+            /**
+             * @brief 获取内嵌的协议消息头（只读）
+             * @return const PacketMsgHeader* 指向消息头的指针
+             */
+            inline const PacketMsgHeader *MsgHeader() const
+            {
+                return &msg_header_;
             }
 
             /**
              * @brief 获取扩展数据
              * @tparam T 扩展数据的类型
              * @return std::shared_ptr<T> 指向扩展数据的智能指针
-             * @note 使用 RTTI 进行类型安全的转换
+             * @note 只用于不常见的扩展，协议消息头请使用 MsgHeader
              */
             template <typename T> inline std::shared_ptr<T> Ext() const
             {
@@ -238,11 +299,26 @@ namespace tmms
             }
 
             /**
-             * @brief 析构函数
+             * @brief 查找指定键的序列化缓存
+             * @param key 缓存键
+             * @return const PacketCache* 找到的缓存节点，不存在时返回 nullptr
+             * @note 线程安全，可在多个事件循环中并发调用
              */
-            ~Packet()
-            {
-            }
+            const PacketCache *FindCache(uint64_t key) const;
+
+            /**
+             * @brief 添加序列化缓存
+             * @param cache 新建的缓存节点，调用后所有权转移给数据包
+             * @return const PacketCache* 最终生效的缓存节点
+             * @note 线程安全。如果其他线程已经添加了相同键的缓存，
+             *       传入的节点会被释放，返回已存在的节点
+             */
+            const PacketCache *AddCache(PacketCache *cache);
+
+            /**
+             * @brief 析构函数，释放序列化缓存
+             */
+            ~Packet();
 
           private:
             int32_t type_{kPacketTypeUnknowed}; ///< 包类型，默认为未知类型
@@ -250,12 +326,10 @@ namespace tmms
             int32_t index_{-1};                 ///< 包索引，默认为-1
             uint64_t timestamp_{0};             ///< 时间戳（微秒）
             uint32_t capacity_{0};              ///< 包的总容量
+            PacketMsgHeader msg_header_;        ///< 协议消息头
             std::shared_ptr<void> ext_;         ///< 扩展数据指针
-
-            // 注意：实际数据紧跟在此结构体之后
+            std::atomic<PacketCache *> cache_{nullptr}; ///< 序列化缓存链表头
+            char *data_{nullptr};                       ///< 数据区指针
         };
-
-#pragma pack(pop) // 恢复默认内存对齐
-
     } // namespace mm
 } // namespace tmms
\ No newline at end of file
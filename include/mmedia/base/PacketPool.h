@@ -0,0 +1,107 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace tmms
+{
+    namespace mm
+    {
+        /**
+         * @brief 数据包内存池的统计信息，各计数器为进程启动以来的累计值
+         */
+        struct PacketPoolStats
+        {
+            int64_t allocs{0};       ///< 分配次数
+            int64_t pool_hits{0};    ///< 从空闲链表复用内存块的次数
+            int64_t pool_misses{0};  ///< 空闲链表为空而新分配内存块的次数
+            int64_t large_allocs{0}; ///< 超出最大尺寸级别、不经过内存池的分配次数
+            int64_t frees{0};        ///< 释放次数
+            int64_t remote_frees{0}; ///< 在其他线程释放、归还给所属内存池的次数
+            int64_t cached_bytes{0}; ///< 空闲链表中缓存的字节数
+        };
+
+        /**
+         * @brief 按尺寸分级的数据包内存池，每个线程（事件循环）一个
+         *
+         * - 内存块按 2 的幂分级，同级的空闲内存块用单链表缓存，分配和本线程释放都不加锁
+         * - 在其他线程释放的内存块通过无锁栈归还给所属的内存池，
+         *   所属线程在本级空闲链表为空时一次性取回
+         * - 每级缓存的内存块数有上限，超出的直接释放
+         * - 内存池随线程创建，进程退出前不会销毁，保证跨线程归还时所属内存池仍然有效
+         */
+        class PacketPool
+        {
+            static const int32_t kMinClassShift = 9;   ///< 最小尺寸级别为 512 字节
+            static const int32_t kSizeClasses = 13;    ///< 尺寸级别数，最大级别为 2MB
+            static const size_t kMaxCachedBytes = 8 * 1024 * 1024; ///< 每级最多缓存的字节数
+
+          public:
+            /**
+             * @brief 获取当前线程的内存池
+             * @return PacketPool* 内存池指针，首次调用时创建
+             */
+            static PacketPool *ThisPool();
+
+            /**
+             * @brief 分配内存块
+             * @param size 需要的字节数
+             * @return void* 内存块地址，按 16 字节对齐
+             */
+            void *Allocate(size_t size);
+
+            /**
+             * @brief 释放内存块，可在任意线程调用
+             * @param ptr Allocate 返回的内存块地址
+             */
+            static void Free(void *ptr);
+
+            /**
+             * @brief 汇总所有线程内存池的统计信息
+             * @return PacketPoolStats 统计信息
+             */
+            static PacketPoolStats Stats();
+
+          private:
+            /**
+             * @brief 内存块头部，位于返回给调用者的地址之前
+             */
+            struct alignas(16) BlockHeader
+            {
+                PacketPool *owner{nullptr}; ///< 所属的内存池，不经过内存池的大块为 nullptr
+                int32_t size_class{-1};     ///< 尺寸级别
+                BlockHeader *next{nullptr}; ///< 空闲链表或归还栈中的下一个内存块
+            };
+
+            PacketPool() = default;
+
+            /**
+             * @brief 取回其他线程归还的内存块，放入对应级别的空闲链表
+             */
+            void DrainRemoteFrees();
+
+            /**
+             * @brief 将内存块放入本线程的空闲链表，超出缓存上限时直接释放
+             * @param block 内存块头部
+             */
+            void PushFree(BlockHeader *block);
+
+            BlockHeader *free_lists_[kSizeClasses]{};    ///< 各级空闲链表
+            size_t free_counts_[kSizeClasses]{};         ///< 各级空闲链表中的内存块数
+            std::atomic<BlockHeader *> remote_frees_{nullptr}; ///< 其他线程归还的内存块
+
+            std::atomic<int64_t> allocs_{0};       ///< 分配次数
+            std::atomic<int64_t> pool_hits_{0};    ///< 复用次数
+            std::atomic<int64_t> pool_misses_{0};  ///< 新分配次数
+            std::atomic<int64_t> large_allocs_{0}; ///< 大块分配次数
+            std::atomic<int64_t> frees_{0};        ///< 释放次数
+            std::atomic<int64_t> remote_frees_count_{0}; ///< 跨线程归还次数
+            std::atomic<int64_t> cached_bytes_{0}; ///< 空闲链表中缓存的字节数
+
+            static std::mutex pools_lock_;            ///< 保护内存池列表
+            static std::vector<PacketPool *> pools_;  ///< 所有线程的内存池，用于汇总统计
+        };
+    } // namespace mm
+} // namespace tmms
@@ -7,6 +7,7 @@
 #include "network/net/TcpConnection.h"
 #include <cstdint>
 #include <unordered_map>
+#include <vector>
 
 namespace tmms
 {
@@ -41,6 +42,14 @@ namespace tmms
         // RTMP上下文类，负责管理一次RTMP连接的状态、握手、消息解析等
         class RtmpContext
         {
+            static const uint32_t kFlatChunkStreams = 64; ///< 用数组保存解析状态的 CSID 上限
+            const int32_t kHeaderBlockSize = 4096; ///< 块头内存块的大小
+            const int32_t kMaxChunkHeaderSize = 18; ///< 单个块头的最大长度（基本头+消息头+扩展时间戳）
+            const size_t kMaxHeaderBlocks = 16;    ///< 发送完成后保留复用的块头内存块数
+            const int32_t kAggregateTagSize = 15;  ///< 聚合消息中每个子消息的标签头(11字节)和反向指针(4字节)
+            const int32_t kSendQuantum = 32 * 1024; ///< 每批最多构建的媒体数据字节数，也是内核中未发送数据的上限
+            const uint32_t kMaxAudioLead = 1000;   ///< 音频最多比排队的视频超前发送的时长(毫秒)
+
           public:
             /**
              * @brief 构造函数，初始化RTMP上下文
@@ -78,6 +87,25 @@ namespace tmms
              */
             int32_t ParseMessage(MsgBuffer &buff);
 
+            /**
+             * @brief 获取接收方向指定块流的解析状态
+             *
+             * 常用的 CSID（小于 kFlatChunkStreams）直接用数组下标访问，其余的放在哈希表中
+             *
+             * @param csid 块流ID
+             * @return RtmpChunkStream& 块流的解析状态
+             */
+            RtmpChunkStream &InChunkStream(uint32_t csid);
+
+            /**
+             * @brief 当前块收到了一段数据
+             *
+             * 数据已经写入正在组装的消息，更新消息大小；块和消息都收完时处理完整的消息
+             *
+             * @param bytes 收到的字节数
+             */
+            void OnChunkBody(size_t bytes);
+
             /**
              * @brief 消息完成处理
              *
@@ -88,13 +116,61 @@ namespace tmms
             void MessageComplete(PacketPtr &&data);
 
             /**
-             * @brief 构建RTMP数据块
+             * @brief 将媒体消息放入发送队列
+             *
+             * 音频和视频分别排队并使用各自的块流。发送时控制消息优先，其次音频，最后视频；
+             * 大的消息按块分批发送，新到的音频可以在块边界插入，不必等整个关键帧发完
              * @param packet 数据包指针
-             * @param timestamp 时间戳，默认为0
+             * @param timestamp 输出时间戳
              * @param fmt0 是否使用格式0，默认为false
-             * @return 构建是否成功
              */
-            bool BuildChunk(const PacketPtr &packet, uint32_t timestamp = 0, bool fmt0 = false);
+            void QueueMessage(const PacketPtr &packet, uint32_t timestamp = 0, bool fmt0 = false);
+
+            /**
+             * @brief 将连续的多个同类型帧作为一条聚合消息（类型 22）放入音频或视频发送队列
+             *
+             * 帧数据不拷贝，每个子消息的标签头写入该帧的输出时间戳，聚合消息的时间戳为第一个帧的输出时间戳
+             * @param packets 第一个帧
+             * @param timestamps 每个帧的输出时间戳
+             * @param count 帧数，通常由 AggregateCount 得到
+             */
+            void QueueAggregate(const PacketPtr *packets, const uint32_t *timestamps, size_t count);
+
+            /**
+             * @brief 将多条消息预先编码为连续的 RTMP 块数据
+             *
+             * 每条消息都使用格式0的块头，不依赖连接上块流的压缩状态，编码结果可以在
+             * 使用相同块大小的连接之间共享。音频使用音频块流，其他消息使用视频块流
+             * @param packets 第一条消息
+             * @param count 消息数
+             * @param timestamps 每条消息的输出时间戳
+             * @param chunk_size 块大小
+             * @return PacketPtr 编码后的块数据
+             */
+            static PacketPtr EncodeMessages(const PacketPtr *packets, size_t count,
+                                            const uint32_t *timestamps, int32_t chunk_size);
+
+            /**
+             * @brief 将 EncodeMessages 编码的块数据作为一个整体放入视频发送队列，发送时只占一个发送节点
+             * @param data 编码后的块数据
+             * @param chunk_size 编码使用的块大小
+             * @return 块大小与连接的输出块大小不一致时返回 false，数据不会放入队列
+             */
+            bool QueueEncoded(const PacketPtr &data, int32_t chunk_size);
+
+            /**
+             * @brief 获取已经通知对端的输出块大小
+             * @return int32_t 块大小(字节)
+             */
+            int32_t OutChunkSize() const;
+
+            /**
+             * @brief 计算从指定帧开始可以合并为一条聚合消息的帧数
+             * @param packets 第一个帧
+             * @param count 可用的帧数
+             * @return size_t 可合并的连续同类型（都是音频或都是视频）帧数，未开启聚合时为0
+             */
+            size_t AggregateCount(const PacketPtr *packets, size_t count) const;
 
             /**
              * @brief 发送数据
@@ -104,11 +180,35 @@ namespace tmms
             void Send();
 
             /**
-             * @brief 检查连接是否就绪
-             * @return 连接是否就绪
+             * @brief 检查连接是否可以接收新的媒体消息
+             * @return 没有在发送数据且排队的媒体数据不足一批时返回 true
              */
             bool Ready() const;
 
+            /**
+             * @brief 获取连接的发送速率
+             * @return 最近若干次发送速率的滑动平均值(字节/毫秒)，尚未发送过数据时为0
+             */
+            uint32_t SendRate() const;
+
+            /**
+             * @brief 设置输出块大小
+             *
+             * 向对端发送 Set Chunk Size 消息，该消息写出后新的块大小才生效，
+             * 之后的消息按新的块大小分块
+             * @param size 块大小(字节)，超出 [128, 0xFFFFFF] 时取边界值
+             */
+            void SetOutChunkSize(int32_t size);
+
+            /**
+             * @brief 设置聚合消息的最大长度
+             *
+             * 开启后，调用方可以把一次发送的多个连续同类型帧合并为聚合消息，
+             * 减少每条消息的头部和发送节点。播放者只在加入追赶和压缩时间戳追帧时合并
+             * @param size 聚合消息体的最大字节数，0 表示不合并
+             */
+            void SetAggregateSize(int32_t size);
+
             /**
              * @brief 播放指定URL的媒体流
              * @param url 要播放的媒体流URL
@@ -131,6 +231,118 @@ namespace tmms
              */
             bool BuildChunk(PacketPtr &&packet, uint32_t timestamp = 0, bool fmt0 = false);
 
+            /**
+             * @brief 构建消息第一个块的头部
+             *
+             * 按该块流上次发送的消息头选择块格式，并更新块流的发送状态
+             * @param h 消息头
+             * @param cs_id 输出使用的块流ID
+             * @param timestamp 输出时间戳
+             * @param fmt0 是否使用格式0
+             * @return uint32_t 块头中时间戳字段的值（格式0为时间戳，其余为增量），后续块的扩展时间戳与它相同
+             */
+            uint32_t BuildChunkHeader(const RtmpMsgHeader *h, uint32_t cs_id, uint32_t timestamp,
+                                      bool fmt0);
+
+            /**
+             * @brief 从指定位置开始构建消息体的块
+             *
+             * 按块边界构建，至少构建一个块；超过 max_bytes 后在下一个块边界停止
+             * @param packet 数据包指针
+             * @param cs_id 输出使用的块流ID
+             * @param timestamp BuildChunkHeader 返回的时间戳字段的值
+             * @param offset 开始位置，位于块边界
+             * @param max_bytes 本次最多构建的消息体字节数
+             * @return int32_t 已构建到的位置
+             */
+            int32_t BuildChunkBody(const PacketPtr &packet, uint32_t cs_id, uint32_t timestamp,
+                                   int32_t offset, int32_t max_bytes);
+
+            /**
+             * @brief 将连续的多个音视频帧构建为一条聚合消息
+             *
+             * 帧数据不拷贝，子消息的标签头和块头写在块头内存块中
+             * @param packets 第一个帧
+             * @param timestamps 每个帧的输出时间戳
+             * @param count 帧数
+             * @param cs_id 输出使用的块流ID
+             * @return 构建是否成功
+             */
+            bool BuildAggregateChunk(const PacketPtr *packets, const uint32_t *timestamps,
+                                     size_t count, uint32_t cs_id);
+
+            /**
+             * @brief 从媒体队列中按顺序构建消息，直到队列为空或用完本批的预算
+             * @param queue 音频或视频队列
+             * @param budget 本批还可以构建的字节数
+             * @return int32_t 本次构建的消息体字节数
+             */
+            int32_t BuildOutQueue(std::list<RtmpOutMessage> &queue, int32_t budget);
+
+            /**
+             * @brief 构建排队消息的下一部分，第一次构建时写入消息头
+             * @param msg 排队的消息
+             * @param budget 本次最多构建的字节数
+             * @return int32_t 本次构建的消息体字节数
+             */
+            int32_t BuildOutMessage(RtmpOutMessage &msg, int32_t budget);
+
+            /**
+             * @brief 获取数据包按当前输出块大小分块后的共享数据
+             *
+             * 分块结果缓存在数据包上，以块大小和 CSID 区分，
+             * 块大小相同的播放连接共享同一份数据，只需各自构建第一个块的头部
+             * @param packet 数据包指针
+             * @param cs_id 块流ID
+             * @param msg_len 消息体长度
+             * @return const PacketCache* 分块后的数据（不含第一个块的头部）
+             */
+            const PacketCache *GetChunkCache(const PacketPtr &packet, uint32_t cs_id,
+                                             int32_t msg_len);
+
+            /**
+             * @brief 追加聚合消息的一段消息体，按输出块大小在块边界插入格式3的块头
+             * @param data 数据地址
+             * @param len 数据长度
+             * @param owner 数据所在内存的所有者，发送节点持有它直到写出
+             * @param cs_id 块流ID
+             * @param timestamp 第一个块头中时间戳字段的值，不小于 0xFFFFFF 时块头带扩展时间戳
+             * @param chunk_left 当前块剩余的字节数，随写入更新
+             */
+            void AppendAggregateBody(const char *data, int32_t len,
+                                     const std::shared_ptr<void> &owner, uint32_t cs_id,
+                                     uint32_t timestamp, int32_t &chunk_left);
+
+            /**
+             * @brief 追加一个发送节点，与上一个节点属于同一块内存且首尾相连时直接合并
+             * @param data 数据地址
+             * @param len 数据长度
+             * @param owner 数据所在内存的所有者，发送节点持有它直到写出
+             */
+            void AppendSendBuffer(const char *data, size_t len,
+                                  const std::shared_ptr<void> &owner);
+
+            /**
+             * @brief 获取写入块头的空间
+             *
+             * 块头写在按批分配的内存块中，当前内存块剩余空间不足时切换到下一个内存块，
+             * 已经写入的块头地址保持不变，直到本批数据发送完成
+             * @param len 需要的字节数，不超过 kHeaderBlockSize
+             * @return char* 写入位置，写完后由调用方更新 out_current_
+             */
+            char *HeaderBuffer(int32_t len);
+
+            /**
+             * @brief 当前块头内存块，作为块头发送节点的所有者
+             * @return std::shared_ptr<void> 最近一次 HeaderBuffer 返回的内存块，本批还没有分配时返回 nullptr
+             */
+            std::shared_ptr<void> HeaderOwner() const;
+
+            /**
+             * @brief 本批数据发送完成后回收块头内存块
+             */
+            void ResetHeaderBuffer();
+
             /**
              * @brief 检查并发送数据
              * 
@@ -177,6 +389,14 @@ namespace tmms
              */
             void HandleAmfCommand(PacketPtr &data, bool amf3 = false);
 
+            /**
+             * @brief 处理聚合消息
+             * 
+             * 将聚合消息拆分为单独的音视频消息，按子消息的时间差还原时间戳后逐个处理
+             * @param packet 聚合消息的数据包
+             */
+            void HandleAggregate(PacketPtr &packet);
+
             /**
              * @brief 发送设置块大小消息
              * 
@@ -331,16 +551,20 @@ namespace tmms
             TcpConnectionPtr connection_;        ///< TCP连接指针
             RtmpHandler *rtmp_handler_{nullptr}; ///< RTMP处理器指针
 
-            std::unordered_map<uint32_t, RtmpMsgHeaderPtr> in_message_headers_; ///< 存储接收到的消息头部
-            std::unordered_map<uint32_t, PacketPtr> in_packets_;               ///< 存储接收到的数据包
-            std::unordered_map<uint32_t, uint32_t> in_deltas_;                 ///< 存储时间戳增量信息
-            std::unordered_map<uint32_t, bool> in_ext_;                        ///< 标记是否使用扩展时间戳
+            RtmpChunkStream in_streams_[kFlatChunkStreams]; ///< CSID 较小的块流的解析状态
+            std::unordered_map<uint32_t, RtmpChunkStream> in_streams_ext_; ///< 其余块流的解析状态
+            uint32_t in_csid_{0};        ///< 正在接收数据的块所属的块流
+            int32_t in_chunk_left_{0};   ///< 当前块还没有收到的数据字节数
 
             int32_t in_chunk_size_{128}; ///< 输入数据块大小，默认为128字节
 
-            char out_buffer_[4096]; ///< 输出缓冲区
+            std::vector<std::shared_ptr<char[]>> out_header_blocks_; ///< 块头内存块，发送节点共同持有
+
+            size_t out_header_used_{0}; ///< 本批已使用的块头内存块数
+
+            char *out_current_{nullptr}; ///< 当前块头内存块的写入位置
 
-            char *out_current_{nullptr}; ///< 当前输出缓冲区位置指针
+            char *out_end_{nullptr}; ///< 当前块头内存块的结束位置
 
             std::unordered_map<uint32_t, uint32_t> out_deltas_; ///< 输出时间戳增量信息
 
@@ -349,14 +573,28 @@ namespace tmms
 
             int32_t out_chunk_size_{4096}; ///< 输出数据块大小，默认为4096字节
 
-            std::list<PacketPtr> out_waiting_queue_; ///< 等待发送的数据包队列
+            int32_t out_chunk_size_conf_{4096}; ///< 最近一次通知对端的输出块大小
 
-            std::list<BufferNodePtr> sending_bufs_; ///< 正在发送的缓冲区列表
+            int32_t aggregate_size_{0}; ///< 聚合消息体的最大字节数，0 表示不合并
+
+            std::list<PacketPtr> out_waiting_queue_; ///< 等待发送的控制消息队列
+
+            std::list<RtmpOutMessage> out_audio_queue_; ///< 等待发送的音频消息队列
 
-            std::list<PacketPtr> out_sending_packets_; ///< 正在发送的数据包列表
+            std::list<RtmpOutMessage> out_video_queue_; ///< 等待发送的视频和其他媒体消息队列
+
+            size_t out_queued_bytes_{0}; ///< 媒体队列中还没有构建的消息体字节数（按整条消息计）
+
+            std::list<BufferNodePtr> sending_bufs_; ///< 正在发送的缓冲区列表
 
             bool sending_{false}; ///< 标记当前是否正在发送数据
 
+            int64_t send_time_{0}; ///< 本次发送开始的时间(毫秒)
+
+            size_t send_bytes_{0}; ///< 本次发送的字节数
+
+            uint32_t send_rate_{0}; ///< 发送速率的滑动平均值(字节/毫秒)
+
             int32_t ack_size_{2500000}; ///< 确认窗口大小，默认为2.5MB，当接收的数据量达到此值时需要发送确认包
 
             int32_t in_bytes_{0}; ///< 已接收的字节数，用于跟踪何时需要发送确认包
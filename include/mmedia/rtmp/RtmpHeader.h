@@ -1,6 +1,8 @@
 #pragma once 
+#include "mmedia/base/Packet.h"
 #include <cstdint>
 #include <memory>
+#include <vector>
 
 namespace tmms
 {
@@ -22,7 +24,7 @@ namespace tmms
             kRtmpMsgTypeAMFMeta,        // AMF元数据消息类型
             kRtmpMsgTypeAMFShared,      // AMF共享对象消息类型
             kRtmpMsgTypeAMFMessage,     // AMF消息类型
-            kRtmpMsgTypeMetadata = 22   // 元数据消息类型
+            kRtmpMsgTypeAggregate = 22  // 聚合消息类型，消息体由多个带 FLV 标签头的子消息组成
         };
 
         enum RtmpFmt
@@ -45,34 +47,34 @@ namespace tmms
         #define kRtmpMsID0 0            // 定义消息流ID 0
         #define kRtmpMsID1 1            // 定义消息流ID 1
 
-        #pragma pack(push)              // 保存当前的内存对齐
-        #pragma pack(1)                 // 设置内存对齐为1字节
-
-            // 定义RTMP消息头结构
-            struct RtmpMsgHeader
-            {
-                uint32_t cs_id{0};      // 标识消息所属的通道
-                uint32_t timestamp{0};  // 时间戳（增量）
-                uint32_t msg_len{0};    // 消息长度
-                uint8_t  msg_type{0};   // 消息类型ID
-                uint32_t msg_sid{0};    // 消息流ID
-
-                // 构造函数
-                RtmpMsgHeader()
-                    : cs_id(0)
-                    , timestamp(0)
-                    , msg_len(0)
-                    , msg_type(0)
-                    , msg_sid(0)
-                {
-
-                }
-            };
-
-        // 恢复内存对齐到默认状态
-        #pragma pack()
+        // RTMP消息头直接使用数据包内嵌的消息头结构
+        using RtmpMsgHeader = PacketMsgHeader;
 
         // 定义RtmpMsgHeader的智能指针类型
         using RtmpMsgHeaderPtr = std::shared_ptr<RtmpMsgHeader>;
+
+        // 接收方向单个块流（chunk stream）的解析状态
+        struct RtmpChunkStream
+        {
+            RtmpMsgHeader header;       // 上一个块的消息头
+            PacketPtr packet;           // 正在组装的消息
+            uint32_t delta{0};          // 时间戳增量
+            bool ext{false};            // 是否使用扩展时间戳
+        };
+
+        // 发送方向等待发送的媒体消息，大的消息按块分批构建
+        struct RtmpOutMessage
+        {
+            PacketPtr packet;                 // 消息的数据包
+            std::vector<PacketPtr> packets;   // 聚合消息包含的帧，普通消息为空
+            std::vector<uint32_t> timestamps; // 聚合消息中每个帧的输出时间戳
+            uint32_t cs_id{0};                // 输出使用的块流ID
+            uint32_t timestamp{0};            // 输出时间戳
+            uint32_t field{0};                // 块头中时间戳字段的值，后续块的扩展时间戳与它相同
+            bool fmt0{false};                 // 是否使用格式0
+            bool encoded{false};              // packet 是否为预先编码好的块数据
+            int32_t msg_len{0};               // 消息体长度
+            int32_t sent{-1};                 // 已经构建的消息体字节数，-1 表示还没有构建消息头
+        };
     }
 }
\ No newline at end of file
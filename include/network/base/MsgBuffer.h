@@ -275,6 +275,32 @@ namespace tmms
              */
             ssize_t ReadFd(int fd, int *retErrno);
 
+            /**
+             * @brief 设置下一次 ReadFd 的直接读取目标
+             * @param target 目标内存，读到的数据优先写入这里，剩余的写入缓冲区
+             * @param len 目标内存的长度
+             * @note 只在缓冲区没有可读数据时生效，只对下一次 ReadFd 有效。
+             *       用于把大块负载直接读到最终位置，省去经过缓冲区的一次拷贝
+             */
+            void SetReadTarget(char *target, size_t len)
+            {
+                target_ = target;
+                target_len_ = len;
+            }
+
+            /**
+             * @brief 取出上一次 ReadFd 直接写入目标内存的字节数，并清除读取目标
+             * @return size_t 写入目标内存的字节数
+             */
+            size_t TakeReadTargetBytes()
+            {
+                size_t bytes = target_read_;
+                target_ = nullptr;
+                target_len_ = 0;
+                target_read_ = 0;
+                return bytes;
+            }
+
             /**
              * @brief 移除直到指定位置的数据
              * @param end 目标位置的指针
@@ -356,6 +382,9 @@ namespace tmms
             size_t initCap_;           ///< 初始分配的缓冲区容量
             std::vector<char> buffer_; ///< 存储数据的底层容器
             size_t tail_;              ///< 写入位置的索引
+            char *target_{nullptr};    ///< 直接读取的目标内存
+            size_t target_len_{0};     ///< 直接读取的目标内存长度
+            size_t target_read_{0};    ///< 上一次直接写入目标内存的字节数
 
             /**
              * @brief 获取缓冲区起始位置（常量版本）
@@ -117,6 +117,20 @@ namespace tmms
              */
             void SetNonBlocking(bool on);
 
+            /**
+             * @brief 设置TCP_NOTSENT_LOWAT选项，限制内核发送缓冲区中尚未发送的数据量
+             * @param bytes 未发送数据低于该值时才报告可写
+             * @note 适用于需要在应用层调度发送顺序的场景，数据尽量留在应用层排队
+             */
+            void SetNotSentLowat(int bytes);
+
+            /**
+             * @brief 设置SO_MAX_PACING_RATE选项，限制内核发送数据的速率
+             * @param rate 速率上限(字节/秒)，~0U 表示不限速
+             * @note TCP 会按该速率在内核中均匀发送，不依赖应用层定时器
+             */
+            void SetMaxPacingRate(uint32_t rate);
+
           private:
             int sock_{-1};      ///< socket文件描述符
             bool is_v6_{false}; ///< 是否为IPv6 socket
@@ -33,13 +33,21 @@ namespace tmms
 
         // 活动状态回调函数类型，用于处理连接活动状态变化
         using ActiveCallback = std::function<void(const ConnectionPtr &)>;
+        /**
+         * @brief 发送节点，描述一段待发送的内存
+         *
+         * owner 持有这段内存的所有者（如数据包），节点在连接的发送队列中时内存不会被释放，
+         * 同一段内存可以被多个连接的节点同时引用。交给连接发送后不能再修改节点
+         */
         struct BufferNode
         {
-            BufferNode(void *buf, size_t s) : addr(buf), size(s)
+            BufferNode(void *buf, size_t s, std::shared_ptr<void> o = nullptr)
+                : addr(buf), size(s), owner(std::move(o))
             {
             }
-            void *addr{nullptr};
-            size_t size{0};
+            void *addr{nullptr};         ///< 数据地址
+            size_t size{0};              ///< 数据长度
+            std::shared_ptr<void> owner; ///< 内存的所有者，为空时由调用方保证发送完成前有效
         };
         using BufferNodePtr = std::shared_ptr<BufferNode>;
         /**
@@ -81,6 +81,12 @@ namespace tmms
              */
             int Fd() const;
 
+            /**
+             * @brief 获取所属的事件循环
+             * @return 事件循环指针
+             */
+            EventLoop *Loop() const;
+
             void Close();
 
           protected:
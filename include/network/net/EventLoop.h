@@ -1,13 +1,12 @@
 #pragma once
 #include "Event.h"
-#include "PipeEvent.h"
+#include "TaskQueue.h"
 #include "TimingWheel.h"
+#include "WakeupEvent.h"
+#include <atomic>
 #include <functional>
 #include <memory>
-#include <mutex>
-#include <queue>
 #include <sys/epoll.h>
-#include <unordered_map>
 #include <vector>
 namespace tmms
 {
@@ -16,12 +15,23 @@ namespace tmms
         using EventPtr = std::shared_ptr<Event>;
         using Func = std::function<void()>;
 
+        /**
+         * @brief 事件表的一项，按文件描述符索引
+         */
+        struct EventSlot
+        {
+            EventPtr event;  ///< 注册的事件，未注册时为空
+            uint32_t seq{0}; ///< 注册序号，随 epoll 事件一起返回，用于识别已删除事件的残留通知
+        };
+
         /**
          * @brief 事件循环类
          * 基于epoll实现的事件循环，负责管理IO事件的分发和处理
          */
         class EventLoop
         {
+            const int64_t kMaxPollTimeout = 1000; ///< 没有定时器时 epoll_wait 的最长等待时间(毫秒)
+
           public:
             /**
              * @brief 构造函数，初始化epoll实例
@@ -92,59 +102,114 @@ namespace tmms
 
             /**
              * @brief 在事件循环线程中执行函数
+             *
+             * 在事件循环线程中调用时立即执行，否则放入任务队列并唤醒事件循环。
+             * 可调用对象直接存入任务节点，不经过 std::function
              * @param func 要执行的函数
              */
-            void RunInLoop(const Func &func);
+            template <typename F>
+            void RunInLoop(F &&func);
 
             /**
-             * @brief 在事件循环线程中执行函数（右值引用版本）
-             * @param func 要执行的函数
+             * @brief 获取事件循环缓存的当前时间，在每次 epoll_wait 返回和处理定时器前更新
+             *
+             * 用于读写路径上记录时间等不要求精确的场合，避免每次都读取时钟
+             * @return int64_t 当前时间戳(毫秒)
+             * @note 只能在事件循环线程中调用
              */
-            void RunInLoop(Func &&func);
+            int64_t NowMS() const;
 
             /**
-             * @brief 向时间轮插入定时任务项
-             * @param delay 延迟时间(毫秒)
+             * @brief 获取当前线程的事件循环
+             * @return EventLoop* 当前线程不是事件循环线程时返回nullptr
+             */
+            static EventLoop *Current();
+
+            /**
+             * @brief 向时间轮插入定时任务项，延迟到期后释放对任务项的引用
+             * @param delay 延迟时间(秒)
              * @param entryPty 定时任务项指针
              */
             void InsertEntry(uint32_t delay, EntryPtr entryPty);
 
+            /**
+             * @brief 插入定时器，已经在等待触发时按新的延迟重新插入
+             * @param timer 定时器
+             * @param delay 延迟时间(毫秒)
+             */
+            void AddTimer(const TimerPtr &timer, int64_t delay);
+
+            /**
+             * @brief 取消定时器
+             * @param timer 定时器
+             */
+            void CancelTimer(const TimerPtr &timer);
+
             /**
              * @brief 延迟执行回调函数(左值引用版本)
-             * @param delay 延迟时间(秒)
+             * @param delay 延迟时间(秒)，精确到毫秒
              * @param cb 回调函数
+             * @return TimerPtr 定时器，可用于取消
              */
-            void RunAfter(double delay, const Func &cb);
+            TimerPtr RunAfter(double delay, const Func &cb);
 
             /**
              * @brief 延迟执行回调函数(右值引用版本)
-             * @param delay 延迟时间(秒)
+             * @param delay 延迟时间(秒)，精确到毫秒
              * @param cb 回调函数
+             * @return TimerPtr 定时器，可用于取消
              */
-            void RunAfter(double delay, Func &&cb);
+            TimerPtr RunAfter(double delay, Func &&cb);
 
             /**
              * @brief 周期性执行回调函数(左值引用版本)
-             * @param interval 执行间隔(秒)
+             * @param interval 执行间隔(秒)，精确到毫秒
              * @param cb 回调函数
+             * @return TimerPtr 定时器，可用于取消
              */
-            void RunEvery(double interval, const Func &cb);
+            TimerPtr RunEvery(double interval, const Func &cb);
 
             /**
              * @brief 周期性执行回调函数(右值引用版本)
-             * @param interval 执行间隔(秒)
+             * @param interval 执行间隔(秒)，精确到毫秒
              * @param cb 回调函数
+             * @return TimerPtr 定时器，可用于取消
              */
-            void RunEvery(double interval, Func &&cb);
+            TimerPtr RunEvery(double interval, Func &&cb);
 
           private:
+            /**
+             * @brief 查找文件描述符对应的事件表项
+             * @param fd 文件描述符
+             * @return 已注册时返回表项指针，否则返回nullptr
+             */
+            EventSlot *FindSlot(int fd);
+
+            /**
+             * @brief 查找事件对象注册的事件表项
+             *
+             * 文件描述符关闭后可能被新的连接复用，表项中注册的必须是同一个事件对象，
+             * 过期的事件对象不能删除或修改新连接的注册
+             * @param event 事件对象
+             * @return 该事件对象已注册时返回表项指针，否则返回nullptr
+             */
+            EventSlot *FindSlot(const EventPtr &event);
+
+            /**
+             * @brief 按事件当前关注的标志调用 epoll_ctl
+             * @param op EPOLL_CTL_ADD、EPOLL_CTL_MOD 或 EPOLL_CTL_DEL
+             * @param slot 事件表项
+             * @return epoll_ctl 的返回值
+             */
+            int UpdateEvent(int op, const EventSlot &slot);
+
             /**
              * @brief 执行队列中的函数
              */
             void RunFunctions();
 
             /**
-             * @brief 唤醒事件循环
+             * @brief 唤醒事件循环，已有未处理的唤醒时不再重复唤醒
              */
             void WakeUp();
 
@@ -152,12 +217,28 @@ namespace tmms
             int epoll_fd_{-1};    ///< epoll文件描述符，用于事件监听
             std::vector<struct epoll_event>
                 epoll_events_; ///< 存储epoll事件的容器，用于接收epoll_wait返回的事件
-            std::unordered_map<int, EventPtr>
-                events_; ///< 存储事件的映射表，键为文件描述符，值为对应的事件对象
-            std::queue<Func> functions_; ///< 待执行函数队列，用于线程间通信
-            std::mutex lock_;            ///< 互斥锁，保护函数队列的线程安全
-            PipeEventPtr pipe_event_;    ///< 管道事件，用于唤醒事件循环
-            TimingWheel wheel_;          ///< 时间轮，用于定时任务的管理
+            std::vector<EventSlot> events_; ///< 按文件描述符索引的事件表
+            size_t event_count_{0};         ///< 已注册的事件数
+            uint32_t event_seq_{0};         ///< 下一个注册序号
+            TaskQueue tasks_;                         ///< 其他线程投递的待执行函数
+            std::atomic<bool> wakeup_pending_{false}; ///< 是否已有未处理的唤醒
+            WakeupEventPtr wakeup_event_;             ///< 唤醒事件，用于唤醒事件循环
+            TimingWheel wheel_;                       ///< 毫秒时间轮，用于定时任务的管理
+            int64_t now_ms_{0};                       ///< 缓存的当前时间(毫秒)
         };
+
+        template <typename F>
+        void EventLoop::RunInLoop(F &&func)
+        {
+            if (IsInLoopThread())
+            {
+                func();
+            }
+            else
+            {
+                tasks_.Push(std::forward<F>(func));
+                WakeUp();
+            }
+        }
     } // namespace network
 } // namespace tmms
\ No newline at end of file
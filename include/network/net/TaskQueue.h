@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace tmms
+{
+    namespace network
+    {
+        /**
+         * @brief 多生产者单消费者的无锁任务队列
+         *
+         * 任意线程无锁地放入任务，消费线程一次取走全部任务后按放入顺序执行，执行期间不持有任何锁，
+         * 生产者不会被正在执行的任务阻塞。任务节点内嵌可调用对象的存储，小的可调用对象不需要额外分配内存
+         */
+        class TaskQueue
+        {
+            static const size_t kInlineSize = 64; ///< 内嵌存储的大小，超出时可调用对象另外分配
+
+          public:
+            TaskQueue() = default;
+
+            /**
+             * @brief 析构函数，销毁还没有执行的任务
+             */
+            ~TaskQueue();
+
+            TaskQueue(const TaskQueue &) = delete;
+            TaskQueue &operator=(const TaskQueue &) = delete;
+
+            /**
+             * @brief 放入任务
+             * @param func 可调用对象
+             * @note 线程安全
+             */
+            template <typename F>
+            void Push(F &&func);
+
+            /**
+             * @brief 取走当前的全部任务并按放入顺序执行，执行期间放入的任务留到下次
+             * @return size_t 执行的任务数
+             * @note 只能由消费线程调用
+             */
+            size_t RunAll();
+
+          private:
+            /**
+             * @brief 任务节点，通过 next 串成链表
+             */
+            struct Task
+            {
+                Task *next{nullptr};              ///< 下一个节点
+                void (*run)(Task *){nullptr};     ///< 执行并析构可调用对象
+                void (*destroy)(Task *){nullptr}; ///< 不执行，只析构可调用对象
+                alignas(std::max_align_t) unsigned char storage[kInlineSize]; ///< 可调用对象的存储
+            };
+
+            /**
+             * @brief 超出内嵌存储的可调用对象另外分配，节点中只保存指针
+             */
+            template <typename Fn>
+            struct HeapFunc
+            {
+                std::unique_ptr<Fn> fn;
+                void operator()()
+                {
+                    (*fn)();
+                }
+            };
+
+            template <typename Fn>
+            static void Run(Task *task)
+            {
+                Fn *fn = reinterpret_cast<Fn *>(task->storage);
+                (*fn)();
+                fn->~Fn();
+            }
+
+            template <typename Fn>
+            static void Destroy(Task *task)
+            {
+                reinterpret_cast<Fn *>(task->storage)->~Fn();
+            }
+
+            template <typename Fn, typename F>
+            void Emplace(F &&func);
+
+            std::atomic<Task *> head_{nullptr}; ///< 最后放入的任务，链表按放入的逆序排列
+        };
+
+        template <typename F>
+        void TaskQueue::Push(F &&func)
+        {
+            using Fn = typename std::decay<F>::type;
+            if constexpr (sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(std::max_align_t))
+            {
+                Emplace<Fn>(std::forward<F>(func));
+            }
+            else
+            {
+                Emplace<HeapFunc<Fn>>(HeapFunc<Fn>{std::make_unique<Fn>(std::forward<F>(func))});
+            }
+        }
+
+        template <typename Fn, typename F>
+        void TaskQueue::Emplace(F &&func)
+        {
+            static_assert(sizeof(Fn) <= kInlineSize, "callable too large for inline storage");
+
+            Task *task = new Task;
+            new (task->storage) Fn(std::forward<F>(func));
+            task->run = &Run<Fn>;
+            task->destroy = &Destroy<Fn>;
+
+            // 压入链表头部，与消费线程取走链表之间只通过 CAS 同步
+            Task *head = head_.load(std::memory_order_relaxed);
+            do
+            {
+                task->next = head;
+            } while (!head_.compare_exchange_weak(head, task, std::memory_order_seq_cst,
+                                                  std::memory_order_relaxed));
+        }
+    } // namespace network
+} // namespace tmms
@@ -4,6 +4,7 @@
 #include "InetAddress.h"
 #include "MsgBuffer.h"
 #include <cstddef>
+#include <deque>
 #include <functional>
 #include <list>
 #include <memory>
@@ -15,7 +16,6 @@ namespace tmms
     namespace network
     {
         class TcpConnection;
-        struct TimeOutEntry;
         // TCP连接智能指针类型
         using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
         // 关闭连接回调函数类型
@@ -89,13 +89,25 @@ namespace tmms
             void SetTimeoutCallback(int timeout, TimeOutCallback &&cb);
 
             /**
-             * @brief 发送数据
+             * @brief 发送数据，可以在任意线程调用
+             *
+             * 节点放入连接的发送队列，下一次可写时与队列中的其他数据一起写出。节点持有内存的所有者时，
+             * 发送完成前内存不会被释放；没有所有者时由调用方保证内存在发送完成前有效
              * @param list 数据缓冲区列表
              */
-            void Send(std::list<BufferNodePtr> &list);
+            void Send(const std::list<BufferNodePtr> &list);
 
             /**
-             * @brief 发送数据
+             * @brief 发送数据(右值引用版本)，可以在任意线程调用
+             * @param list 数据缓冲区列表
+             */
+            void Send(std::list<BufferNodePtr> &&list);
+
+            /**
+             * @brief 发送数据，可以在任意线程调用
+             *
+             * 在事件循环线程中且发送队列为空时直接写入，写不完的部分复制到发送队列；
+             * 在其他线程中调用时先复制数据，调用返回后缓冲区可以立即复用
              * @param buf 数据缓冲区
              * @param size 数据大小
              */
@@ -134,16 +146,18 @@ namespace tmms
 
             /**
              * @brief 启用空闲超时检测
-             * @param max_time 最大空闲时间
+             *
+             * 读写时只记录最后活动的时间，定时器到期时再检查是否空闲，没有空闲时按最后活动的时间重新计时
+             * @param max_time 最大空闲时间(秒)
              */
             void EnableCheckIdleTimeout(int32_t max_time);
 
           private:
             /**
-             * @brief 在事件循环中发送数据
+             * @brief 在事件循环中把数据放入发送队列
              * @param list 数据缓冲区列表
              */
-            void SendInLoop(std::list<BufferNodePtr> &list);
+            void SendInLoop(const std::list<BufferNodePtr> &list);
 
             /**
              * @brief 在事件循环中发送数据
@@ -153,41 +167,26 @@ namespace tmms
             void SendInLoop(const void *buf, size_t size);
 
             /**
-             * @brief 延长连接生命周期
+             * @brief 延长连接生命周期，记录最后活动的时间
              */
             void ExtendLife();
 
+            /**
+             * @brief 空闲检测定时器到期时检查连接是否空闲，空闲时关闭连接，否则重新设置定时器
+             */
+            void CheckIdleTimeout();
+
             bool close_{false};                         ///< 是否关闭连接
             CloseConnectionCallback close_cb_;          ///< 关闭连接回调函数
             MsgBuffer message_buffer_;                  ///< 消息缓冲区
             MessageCallback message_cb_;                ///< 消息回调函数
-            std::vector<struct iovec> io_vec_list_;     ///< 向量列表，用于批量发送数据
+            std::deque<BufferNodePtr> send_queue_;      ///< 发送队列，持有待发送的节点
+            size_t send_offset_{0};                     ///< 队首节点已经写出的字节数
+            std::vector<struct iovec> io_vec_list_;     ///< 每次 writev 时由发送队列组装的向量列表
             WriteCompleteCallback write_complete_cb_;   ///< 写完成回调函数
-            std::weak_ptr<TimeOutEntry> timeout_entry_; ///< 超时事件条目
-            int32_t max_idle_time_{30};                 ///< 最大空闲时间
-        };
-        struct TimeOutEntry
-        {
-          public:
-            /**
-             * @brief 构造函数
-             * @param c TCP连接指针
-             */
-            TimeOutEntry(const TcpConnectionPtr &c)
-                : conn(c){
-
-                  };
-
-            ~TimeOutEntry()
-            {
-                auto c = conn.lock();
-                if (c)
-                {
-                    c->OnTimeout();
-                }
-            };
-
-            std::weak_ptr<TcpConnection> conn; ///< TCP连接指针
+            TimerPtr idle_timer_;                       ///< 空闲检测定时器
+            int64_t last_active_time_{0};               ///< 最后活动的时间(毫秒)，取自事件循环缓存的时间
+            int32_t max_idle_time_{30};                 ///< 最大空闲时间(秒)
         };
     } // namespace network
 } // namespace tmms
\ No newline at end of file
@@ -1,9 +1,9 @@
 #pragma once
 
 #include <cstdint>
-#include <deque>
 #include <functional>
 #include <memory>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -13,20 +13,8 @@ namespace tmms
     {
         using EntryPtr = std::shared_ptr<void>;
         using WheelEntry = std::unordered_set<EntryPtr>;
-        using Wheel = std::deque<WheelEntry>;
-        using Wheels = std::vector<Wheel>;
         using Func = std::function<void()>;
 
-        const int kTimingMinute = 60;
-        const int kTimingHour = 60 * 60;
-        const int kTimingDay = 60 * 60 * 24;
-        enum TimingType
-        {
-            kTimingTypeSecond = 0,
-            kTimingTypeMinute = 1,
-            kTimingTypeHour = 2,
-            kTimingTypeDay = 3,
-        };
         class CallbackEntry
         {
           public:
@@ -47,97 +35,188 @@ namespace tmms
 
         using CallbackEntryPtr = std::shared_ptr<CallbackEntry>;
 
+        /**
+         * @brief 时间轮槽位链表的链接，槽位本身是不带定时器的哨兵节点
+         */
+        struct TimerLink
+        {
+            TimerLink *prev{this}; ///< 前一个节点
+            TimerLink *next{this}; ///< 后一个节点
+        };
+
+        class Timer;
+        using TimerPtr = std::shared_ptr<Timer>;
+
+        /**
+         * @brief 定时器，侵入式地链接在时间轮的槽位链表中，插入和取消都是 O(1)
+         *
+         * 定时器只能在所属事件循环的线程中插入和取消，触发后回调仍然保留，可以再次插入
+         */
+        class Timer : public TimerLink
+        {
+            friend class TimingWheel;
+
+          public:
+            /**
+             * @brief 构造函数
+             * @param cb 回调函数
+             * @param interval 周期(毫秒)，0 表示只执行一次
+             */
+            Timer(const Func &cb, int64_t interval = 0);
+
+            /**
+             * @brief 构造函数(右值引用版本)
+             * @param cb 回调函数
+             * @param interval 周期(毫秒)，0 表示只执行一次
+             */
+            Timer(Func &&cb, int64_t interval = 0);
+
+            Timer(const Timer &) = delete;
+            Timer &operator=(const Timer &) = delete;
+
+            /**
+             * @brief 检查是否在等待触发
+             * @return 在时间轮中返回true，否则返回false
+             */
+            bool Pending() const;
+
+          private:
+            TimerPtr self_;         ///< 在时间轮中时持有自身，触发或取消前不会被释放
+            int64_t expire_{0};     ///< 到期的 tick
+            int64_t interval_{0};   ///< 周期(毫秒)
+            int32_t slot_{-1};      ///< 所在槽位的下标，不在时间轮中时为 -1
+            bool cancelled_{false}; ///< 是否已取消，周期定时器在回调中取消时不再插入
+            Func cb_;               ///< 回调函数
+        };
+
+        /**
+         * @brief 分层时间轮
+         *
+         * 第 0 层 256 个槽位，每个槽位一个 tick；之上 4 层各 64 个槽位，每个槽位的跨度是下一层转一圈的时长，
+         * 最长约 2^32 个 tick。第 0 层转完一圈时把上一层当前槽位的定时器按到期时间重新放入下层。
+         * 所有接口都由调用者传入当前时间，时间轮本身不读取时钟
+         */
         class TimingWheel
         {
+            static const int kRootBits = 8;                    ///< 第 0 层槽位数的位数
+            static const int kLevelBits = 6;                   ///< 上层槽位数的位数
+            static const int kLevels = 5;                      ///< 层数
+            static const int64_t kRootSize = 1 << kRootBits;   ///< 第 0 层槽位数
+            static const int64_t kLevelSize = 1 << kLevelBits; ///< 上层槽位数
+            static const int64_t kMaxTicks = 1ll << 32;        ///< 能表示的最长延迟(tick)
+
           public:
             /**
              * @brief 构造函数，初始化时间轮
+             * @param tick_ms 一个 tick 的时长(毫秒)
              */
-            TimingWheel();
+            explicit TimingWheel(int64_t tick_ms = 1);
 
             /**
-             * @brief 析构函数，清理资源
+             * @brief 析构函数，释放还没有触发的定时器
              */
             ~TimingWheel();
 
+            TimingWheel(const TimingWheel &) = delete;
+            TimingWheel &operator=(const TimingWheel &) = delete;
+
+            /**
+             * @brief 插入定时器，已经在等待触发时按新的延迟重新插入
+             * @param timer 定时器
+             * @param delay 延迟时间(毫秒)
+             * @param now 当前时间戳(毫秒)
+             */
+            void AddTimer(const TimerPtr &timer, int64_t delay, int64_t now);
+
             /**
-             * @brief 插入定时任务
+             * @brief 取消定时器，可以在定时器自己的回调中调用
+             * @param timer 定时器
+             */
+            void CancelTimer(const TimerPtr &timer);
+
+            /**
+             * @brief 插入定时任务，延迟到期后释放对任务的引用
+             *
+             * 同一秒到期的任务放在同一个集合中，共用一个定时器，重复插入同一个任务只保留一份
              * @param delay 延迟时间(秒)
              * @param entryPty 要插入的任务指针
+             * @param now 当前时间戳(毫秒)
              */
-            void InsertEntry(uint32_t delay, EntryPtr entryPty);
+            void InsertEntry(uint32_t delay, EntryPtr entryPty, int64_t now);
 
             /**
-             * @brief 定时器触发时调用
-             * @param now 当前时间戳
+             * @brief 推进到当前时间，执行到期的定时器
+             * @param now 当前时间戳(毫秒)
              */
             void OnTimer(int64_t now);
 
             /**
-             * @brief 弹出到期的任务
-             * @param bq 任务队列
+             * @brief 计算距离下一次需要处理的时间，用作 epoll_wait 的超时
+             * @param now 当前时间戳(毫秒)
+             * @param max_timeout 最长的等待时间(毫秒)
+             * @return int64_t 等待时间(毫秒)，已经有到期的定时器时为 0
              */
-            void PopUp(Wheel &bq);
+            int64_t NextTimeout(int64_t now, int64_t max_timeout) const;
 
             /**
-             * @brief 延迟执行函数
-             * @param delay 延迟时间(秒)
-             * @param cb 回调函数
+             * @brief 获取等待触发的定时器数
+             * @return size_t 定时器数
              */
-            void RunAfter(double delay, const Func &cb);
+            size_t Size() const;
 
+          private:
             /**
-             * @brief 延迟执行函数(右值引用版本)
-             * @param delay 延迟时间(秒)
-             * @param cb 回调函数
+             * @brief 按到期时间把定时器放入对应层的槽位
+             * @param timer 定时器
              */
-            void RunAfter(double delay, Func &&cb);
+            void Link(Timer *timer);
 
             /**
-             * @brief 周期性执行函数
-             * @param interval 执行间隔(秒)
-             * @param cb 回调函数
+             * @brief 把定时器从所在的槽位中移除
+             * @param timer 定时器
              */
-            void RunEvery(double interval, const Func &cb);
+            void Unlink(Timer *timer);
 
             /**
-             * @brief 周期性执行函数(右值引用版本)
-             * @param interval 执行间隔(秒)
-             * @param cb 回调函数
+             * @brief 把槽位的链表整个移到另一个哨兵节点上，槽位变为空
+             * @param slot 槽位下标
+             * @param list 接收的哨兵节点
              */
-            void RunEvery(double interval, Func &&cb);
+            void TakeSlot(int64_t slot, TimerLink &list);
 
-          private:
             /**
-             * @brief 插入秒级定时任务
-             * @param delay 延迟时间(秒)
-             * @param entryPty 要插入的任务指针
+             * @brief 把上层一个槽位的定时器按到期时间重新放入下层
+             * @param level 层
+             * @param index 槽位
              */
-            void InsertSecondEntry(uint32_t delay, EntryPtr entryPty);
+            void Cascade(int level, int64_t index);
 
             /**
-             * @brief 插入分钟级定时任务
-             * @param delay 延迟时间(分钟)
-             * @param entryPty 要插入的任务指针
+             * @brief 查找第 0 层从 index 开始的第一个非空槽位
+             * @param index 开始的槽位
+             * @return int64_t 槽位，都为空时返回 kRootSize
              */
-            void InsertMinuteEntry(uint32_t delay, EntryPtr entryPty);
+            int64_t NextRootSlot(int64_t index) const;
 
             /**
-             * @brief 插入小时级定时任务
-             * @param delay 延迟时间(小时)
-             * @param entryPty 要插入的任务指针
+             * @brief 执行到期的定时器，周期定时器重新插入
+             * @param timer 定时器
              */
-            void InsertHourEntry(uint32_t delay, EntryPtr entryPty);
+            void Fire(Timer *timer);
 
             /**
-             * @brief 插入天级定时任务
-             * @param delay 延迟时间(天)
-             * @param entryPty 要插入的任务指针
+             * @brief 把毫秒换算为 tick，向上取整，至少为 1
+             * @param ms 毫秒
+             * @return int64_t tick 数
              */
-            void InsertDayEntry(uint32_t delay, EntryPtr entryPty);
-            Wheels wheels_;      ///< 时间轮容器，存储不同时间粒度的任务队列
-            int64_t last_ts_{0}; ///< 上次触发时间戳
-            uint64_t tick_{0};   ///< 当前tick计数
+            int64_t Ticks(int64_t ms) const;
+
+            int64_t tick_ms_{1};           ///< 一个 tick 的时长(毫秒)
+            int64_t tick_{-1};             ///< 下一个要处理的 tick，-1 表示还没有开始
+            size_t count_{0};              ///< 等待触发的定时器数
+            std::vector<TimerLink> slots_; ///< 各层槽位的哨兵节点，第 0 层在前
+            uint64_t root_bits_[kRootSize / 64]{}; ///< 第 0 层非空槽位的位图
+            std::unordered_map<int64_t, WheelEntry> entries_; ///< 按到期的秒分组的定时任务
         };
     } // namespace network
-} // namespace tmms
\ No newline at end of file
+} // namespace tmms
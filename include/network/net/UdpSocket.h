@@ -14,7 +14,6 @@ namespace tmms
         class UdpSocket;
         /// @brief UDP套接字智能指针类型
         using UdpSocketPtr = std::shared_ptr<UdpSocket>;
-        struct UdpTimeoutEntry;
 
         /**
          * @brief UDP缓冲区节点结构体
@@ -168,6 +167,8 @@ namespace tmms
 
             /**
              * @brief 启用空闲超时检查
+             *
+             * 收发时只记录最后活动的时间，定时器到期时再检查是否空闲
              * @param max_time 最大空闲时间(秒)
              */
             void EnableCheckIdleTimeout(int32_t max_time);
@@ -195,14 +196,20 @@ namespace tmms
             void SendInLoop(const char *buff, size_t size, struct sockaddr *saddr, socklen_t len);
             /**
              * @brief 延长连接生命周期
-             * 重置超时计时器
+             * 记录最后活动的时间
              */
             void ExtendLife();
 
+            /**
+             * @brief 空闲检测定时器到期时检查是否空闲，空闲时关闭，否则重新设置定时器
+             */
+            void CheckIdleTimeout();
+
             std::list<UdpBufferNodePtr> buffer_list_; ///< 待发送的UDP数据缓冲区列表
             bool closed_{false};                      ///< 连接是否已关闭标志，默认false
             int32_t max_idle_time_{30}; ///< 最大空闲超时时间(秒)，默认30秒
-            std::weak_ptr<UdpTimeoutEntry> timeout_entry_; ///< 超时事件条目
+            TimerPtr idle_timer_;                     ///< 空闲检测定时器
+            int64_t last_active_time_{0}; ///< 最后活动的时间(毫秒)，取自事件循环缓存的时间
             int32_t message_buffer_size_{65535};  ///< 消息缓冲区大小，默认65535字节
             MsgBuffer message_buffer_;            ///< 接收消息缓冲区
             UdpSocketMessageCallback message_cb_; ///< 消息接收回调函数
@@ -210,33 +217,5 @@ namespace tmms
             UdpSocketCloseConnectionCallback close_cb_;        ///< 连接关闭回调函数
         };
 
-        /**
-         * @brief UDP超时条目结构体
-         * 用于管理UDP套接字的超时事件
-         */
-        struct UdpTimeoutEntry
-        {
-          public:
-            /**
-             * @brief 构造函数
-             * @param c UDP套接字指针
-             */
-            UdpTimeoutEntry(const UdpSocketPtr &c)
-                : conn(c){
-
-                  };
-
-            ~UdpTimeoutEntry()
-            {
-                auto c = conn.lock();
-                if (c)
-                {
-                    c->OnTimeout();
-                }
-            };
-
-            std::weak_ptr<UdpSocket> conn; ///< UDP套接字弱指针
-        };
-
     } // namespace network
 } // namespace tmms
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+#include "Event.h"
+#include <memory>
+
+namespace tmms
+{
+    namespace network
+    {
+        /**
+         * @brief 唤醒事件类
+         * 基于 eventfd 实现，用于其他线程唤醒阻塞在 epoll_wait 中的事件循环
+         */
+        class WakeupEvent : public Event
+        {
+          public:
+            /**
+             * @brief 构造函数
+             * @param loop 关联的事件循环
+             * @note 初始化时会创建非阻塞的 eventfd
+             */
+            WakeupEvent(EventLoop *loop);
+
+            /**
+             * @brief 析构函数，关闭 eventfd
+             */
+            ~WakeupEvent();
+
+            /**
+             * @brief 读事件回调，清空 eventfd 的计数
+             */
+            void OnRead() override;
+
+            /**
+             * @brief 唤醒事件循环
+             * @note 线程安全
+             */
+            void Notify();
+        };
+
+        /// 智能指针类型定义
+        using WakeupEventPtr = std::shared_ptr<WakeupEvent>;
+    } // namespace network
+} // namespace tmms
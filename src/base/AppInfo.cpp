@@ -25,6 +25,21 @@ bool AppInfo::ParseAppInfo(Json::Value &root)
         max_buffer_ = mbObj.asUInt();
     }
 
+    // 从 JSON 对象中获取 "max_buffer_bytes" 字段，如果存在，将其值赋给 max_buffer_bytes，单位为字节。
+    // 只限制流缓冲区：最新的 GOP 总是保留，可能超出该值；转发器缓存的数据包也不计入
+    Json::Value mbbObj = root["max_buffer_bytes"];
+    if (!mbbObj.isNull())
+    {
+        max_buffer_bytes_ = mbbObj.asUInt64();
+    }
+
+    // 从 JSON 对象中获取 "max_buffer_time" 字段，如果存在，将其值赋给 max_buffer_time，单位为毫秒
+    Json::Value mbtObj = root["max_buffer_time"];
+    if (!mbtObj.isNull())
+    {
+        max_buffer_time_ = mbtObj.asUInt();
+    }
+
     // 从 JSON 对象中获取 "hls_support" 字段，如果存在并且值为 "on"，将 hls_support_ 设置为 true
     Json::Value hlsObj = root["hls_support"];
     if (!hlsObj.isNull())
@@ -69,11 +84,124 @@ bool AppInfo::ParseAppInfo(Json::Value &root)
         stream_timeout_time_ = sttObj.asUInt();
     }
 
+    // 从 JSON 对象中获取 "wakeup_tick" 字段，值为 "keyframe" 时每个关键帧唤醒一次播放者，
+    // 否则为唤醒播放者的最小间隔，单位为毫秒
+    Json::Value wtObj = root["wakeup_tick"];
+    if (!wtObj.isNull())
+    {
+        if (wtObj.isString())
+        {
+            wakeup_on_keyframe_ = wtObj.asString() == "keyframe";
+        }
+        else
+        {
+            wakeup_tick_ = wtObj.asUInt();
+        }
+    }
+
+    // 从 JSON 对象中获取 "slow_policy" 字段，取值为 "none"、"drop_nonref"、"audio_only" 或 "skip_gop"
+    Json::Value spObj = root["slow_policy"];
+    if (!spObj.isNull())
+    {
+        auto policy = spObj.asString();
+        if (policy == "drop_nonref")
+        {
+            slow_policy_ = kSlowPolicyDropNonRef;
+        }
+        else if (policy == "audio_only")
+        {
+            slow_policy_ = kSlowPolicyAudioOnly;
+        }
+        else if (policy == "skip_gop")
+        {
+            slow_policy_ = kSlowPolicySkipGop;
+        }
+        else
+        {
+            slow_policy_ = kSlowPolicyNone;
+        }
+    }
+
+    // 从 JSON 对象中获取 "slow_lag" 字段，如果存在，将其值赋给 slow_lag，单位为毫秒
+    Json::Value slObj = root["slow_lag"];
+    if (!slObj.isNull())
+    {
+        slow_lag_ = slObj.asUInt();
+    }
+
+    // 从 JSON 对象中获取 "slow_disconnect_time" 字段，如果存在，将其值赋给
+    // slow_disconnect_time，单位为毫秒
+    Json::Value sdtObj = root["slow_disconnect_time"];
+    if (!sdtObj.isNull())
+    {
+        slow_disconnect_time_ = sdtObj.asUInt();
+    }
+
+    // 从 JSON 对象中获取 "rtmp_chunk_size" 字段，如果存在，将其值赋给 rtmp_chunk_size，单位为字节
+    Json::Value rcsObj = root["rtmp_chunk_size"];
+    if (!rcsObj.isNull())
+    {
+        rtmp_chunk_size_ = rcsObj.asUInt();
+    }
+
+    // 从 JSON 对象中获取 "rtmp_aggregate_size" 字段，如果存在，将其值赋给 rtmp_aggregate_size，单位为字节；
+    // 只在播放者加入后限速追赶或压缩时间戳追帧时合并，追上直播边缘后逐帧发送
+    Json::Value rasObj = root["rtmp_aggregate_size"];
+    if (!rasObj.isNull())
+    {
+        rtmp_aggregate_size_ = rasObj.asUInt();
+    }
+
+    // 从 JSON 对象中获取 "join_burst_rate" 字段，如果存在，将其值赋给 join_burst_rate，
+    // 单位为流码率的百分比，如 400 表示按 4 倍码率发送缓存的 GOP，不超过 100 时无法追上直播边缘，视为不限速
+    Json::Value jbrObj = root["join_burst_rate"];
+    if (!jbrObj.isNull())
+    {
+        join_burst_rate_ = jbrObj.asUInt();
+        if (join_burst_rate_ <= 100)
+        {
+            join_burst_rate_ = 0;
+        }
+    }
+
+    // 从 JSON 对象中获取 "join_socket_pacing" 字段，如果存在并且值为 "on"，将 join_socket_pacing_ 设置为 true
+    Json::Value jspObj = root["join_socket_pacing"];
+    if (!jspObj.isNull())
+    {
+        join_socket_pacing_ = jspObj.asString() == "on";
+    }
+
+    // 从 JSON 对象中获取 "join_mode" 字段，值为 "live_edge" 时播放者从最新的关键帧加入，
+    // 默认为 "latency"，从内容延迟范围内最旧的关键帧加入
+    Json::Value jmObj = root["join_mode"];
+    if (!jmObj.isNull())
+    {
+        live_edge_join_ = jmObj.asString() == "live_edge";
+    }
+
+    // 从 JSON 对象中获取 "target_latency" 字段，如果存在，将其值赋给 target_latency，单位为毫秒
+    Json::Value tlObj = root["target_latency"];
+    if (!tlObj.isNull())
+    {
+        target_latency_ = tlObj.asUInt();
+    }
+
     // 输出日志，显示应用程序的相关信息
     LOG_INFO << " app name : " << app_name_ << " max_buffer : " << max_buffer_
+             << " max_buffer_bytes : " << max_buffer_bytes_
+             << " max_buffer_time : " << max_buffer_time_
              << " content_latency : " << content_latency_
              << " stream_idle_time : " << stream_idle_time_
              << " stream_timeout_time : " << stream_timeout_time_
+             << " wakeup_tick : " << (wakeup_on_keyframe_ ? "keyframe" : std::to_string(wakeup_tick_))
+             << " slow_policy : " << slow_policy_ << " slow_lag : " << slow_lag_
+             << " slow_disconnect_time : " << slow_disconnect_time_
+             << " rtmp_chunk_size : " << rtmp_chunk_size_
+             << " rtmp_aggregate_size : " << rtmp_aggregate_size_
+             << " join_burst_rate : " << join_burst_rate_
+             << " join_socket_pacing : " << join_socket_pacing_
+             << " join_mode : " << (live_edge_join_ ? "live_edge" : "latency")
+             << " target_latency : " << target_latency_
              << " rtmp_support : " << rtmp_support_ << " flv_support : " << flv_support_
              << " hls_support : " << hls_support_;
 
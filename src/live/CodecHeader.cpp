@@ -2,111 +2,133 @@
 #include "base/TTime.h"
 #include "live/base/LiveLog.h"
 #include "mmedia/rtmp/amf/AMFObject.h"
+#include <algorithm>
 #include <sstream>
 
 using namespace tmms::live;
 using namespace tmms::mm;
 
-CodecHeader::CodecHeader()
+namespace
 {
-    // 构造函数，将当前的毫秒级时间戳赋值给start_timestamp_
-    start_timestamp_ = tmms::base::TTime::NowMS();
-}
-
-PacketPtr CodecHeader::Meta(int idx)
-{
-    // 如果传入的索引小于等于0，直接返回当前保存的meta_元数据包
-    if (idx <= 0)
+    // 在按帧索引递增排列的历史记录中，二分查找第 idx 帧适用（索引小于等于 idx）的最新头信息
+    PacketPtr FindHeader(const std::vector<PacketPtr> &packets, const PacketPtr &current, int idx)
     {
-        return meta_;
-    }
+        // 如果传入的索引小于等于0，直接返回当前保存的头信息包
+        if (idx <= 0)
+        {
+            return current;
+        }
 
-    // 反向迭代meta_packets_，从最后一个元素开始
-    auto iter = meta_packets_.rbegin();
+        // 找到第一个索引大于 idx 的记录，它之前的一条即为所求
+        auto iter = std::upper_bound(packets.begin(), packets.end(), idx,
+                                     [](int i, const PacketPtr &pkt) { return i < pkt->Index(); });
+        if (iter != packets.begin())
+        {
+            return *(iter - 1);
+        }
 
-    // 遍历meta_packets_，找到索引小于等于idx的包
-    for (; iter != meta_packets_.rend(); iter++)
-    {
-        // 获取当前包
-        PacketPtr pkt = *iter;
+        // 如果没有找到，返回当前保存的头信息包
+        return current;
+    }
 
-        // 如果当前包的索引小于等于传入的idx，则返回该包
-        if (pkt->Index() <= idx)
+    // 统计被后续记录覆盖、且位于淘汰点之前的历史头信息数
+    size_t PruneCount(const std::vector<PacketPtr> &packets, int64_t min_idx)
+    {
+        // 下一条记录仍在淘汰点之前（含）时，当前记录不再被使用
+        size_t count = 0;
+        while (count + 1 < packets.size() && packets[count + 1]->Index() <= min_idx)
         {
-            return pkt;
+            count++;
         }
+        return count;
     }
+} // namespace
 
-    // 如果遍历完所有包都没有找到，返回meta_
-    return meta_;
+PacketPtr CodecHeaderTable::Meta(int idx) const
+{
+    // 在元数据历史记录中查找
+    return FindHeader(meta_packets, meta, idx);
 }
 
-PacketPtr CodecHeader::VideoHeader(int idx)
+PacketPtr CodecHeaderTable::VideoHeader(int idx) const
 {
-    // 如果传入的索引小于等于0，直接返回当前保存的视频头信息包
-    if (idx <= 0)
-    {
-        return video_header_;
-    }
+    // 在视频头历史记录中查找
+    return FindHeader(video_header_packets, video_header, idx);
+}
 
-    // 反向迭代video_header_packets_，从最后一个元素开始
-    auto iter = video_header_packets_.rbegin();
+PacketPtr CodecHeaderTable::AudioHeader(int idx) const
+{
+    // 在音频头历史记录中查找
+    return FindHeader(audio_header_packets, audio_header, idx);
+}
 
-    // 遍历video_header_packets_，找到索引小于等于idx的包
-    for (; iter != video_header_packets_.rend(); iter++)
-    {
-        // 获取当前包
-        PacketPtr pkt = *iter;
+CodecHeader::CodecHeader() : headers_(std::make_shared<CodecHeaderTable>())
+{
+    // 构造函数，将当前的毫秒级时间戳赋值给start_timestamp_
+    start_timestamp_ = tmms::base::TTime::NowMS();
+}
 
-        // 如果当前包的索引小于等于传入的idx，则返回该包
-        if (pkt->Index() <= idx)
-        {
-            return pkt;
-        }
-    }
+CodecHeaderTablePtr CodecHeader::Headers() const
+{
+    // 原子地读取当前头信息表
+    return std::atomic_load(&headers_);
+}
 
-    // 如果遍历完所有包都没有找到，返回video_header_
-    return video_header_;
+PacketPtr CodecHeader::Meta(int idx) const
+{
+    // 在当前头信息表中查找元数据
+    return Headers()->Meta(idx);
 }
 
-PacketPtr CodecHeader::AudioHeader(int idx)
+PacketPtr CodecHeader::VideoHeader(int idx) const
 {
-    // 如果传入的索引小于等于0，直接返回当前保存的音频头信息包
-    if (idx <= 0)
-    {
-        return audio_header_;
-    }
+    // 在当前头信息表中查找视频头
+    return Headers()->VideoHeader(idx);
+}
 
-    // 反向迭代audio_header_packets_，从最后一个元素开始
-    auto iter = audio_header_packets_.rbegin();
+PacketPtr CodecHeader::AudioHeader(int idx) const
+{
+    // 在当前头信息表中查找音频头
+    return Headers()->AudioHeader(idx);
+}
 
-    // 遍历audio_header_packets_，找到索引小于等于idx的包
-    for (; iter != audio_header_packets_.rend(); iter++)
-    {
-        // 获取当前包
-        PacketPtr pkt = *iter;
+std::shared_ptr<CodecHeaderTable> CodecHeader::CopyHeaders() const
+{
+    // 只有写者修改头信息表，复制当前表即可得到最新内容
+    return std::make_shared<CodecHeaderTable>(*Headers());
+}
 
-        // 如果当前包的索引小于等于传入的idx，则返回该包
-        if (pkt->Index() <= idx)
-        {
-            return pkt;
-        }
-    }
+void CodecHeader::StoreHeaders(std::shared_ptr<CodecHeaderTable> table)
+{
+    // 原子地替换头信息表，正在使用旧表的读者不受影响
+    std::atomic_store(&headers_, CodecHeaderTablePtr(std::move(table)));
+}
+
+void CodecHeader::AppendHistory(std::vector<PacketPtr> &packets, const PacketPtr &packet)
+{
+    // 追加到历史记录末尾
+    packets.emplace_back(packet);
 
-    // 如果遍历完所有包都没有找到，返回audio_header_
-    return audio_header_;
+    // 编码器频繁重发头信息时，历史记录也不会无限增长
+    if (packets.size() > kMaxHeaderHistory)
+    {
+        packets.erase(packets.begin());
+    }
 }
 
 void CodecHeader::SaveMeta(const PacketPtr &packet)
 {
-    // 将传入的元数据包保存到成员变量meta_
-    meta_ = packet;
+    // 复制当前头信息表，将传入的元数据包设为当前元数据
+    auto table = CopyHeaders();
+    table->meta = packet;
+    table->version++;
 
     // 增加元数据版本号
     ++meta_version_;
 
-    // 将元数据包添加到meta_packets_列表中
-    meta_packets_.emplace_back(packet);
+    // 将元数据包添加到历史记录中，并发布新的头信息表
+    AppendHistory(table->meta_packets, packet);
+    StoreHeaders(std::move(table));
 
     // 输出保存元数据的日志信息
     LIVE_TRACE << " save meta, meta version : " << meta_version_
@@ -221,14 +243,17 @@ void CodecHeader::ParseMeta(const PacketPtr &packet)
 
 void CodecHeader::SaveAudioHeader(const PacketPtr &packet)
 {
-    // 将传入的音频头信息包保存到成员变量audio_header_
-    audio_header_ = packet;
+    // 复制当前头信息表，将传入的音频头信息包设为当前音频头
+    auto table = CopyHeaders();
+    table->audio_header = packet;
+    table->version++;
 
     // 增加音频头信息的版本号
     ++audio_version_;
 
-    // 将音频头信息包添加到audio_header_packets_列表中
-    audio_header_packets_.emplace_back(packet);
+    // 将音频头信息包添加到历史记录中，并发布新的头信息表
+    AppendHistory(table->audio_header_packets, packet);
+    StoreHeaders(std::move(table));
 
     // 输出保存音频头信息的日志信息
     LIVE_TRACE << " save audio header, version : " << audio_version_
@@ -238,14 +263,17 @@ void CodecHeader::SaveAudioHeader(const PacketPtr &packet)
 
 void CodecHeader::SaveVideoHeader(const PacketPtr &packet)
 {
-    // 将传入的视频头信息包保存到成员变量video_header_
-    video_header_ = packet;
+    // 复制当前头信息表，将传入的视频头信息包设为当前视频头
+    auto table = CopyHeaders();
+    table->video_header = packet;
+    table->version++;
 
     // 增加视频头信息的版本号
     ++video_version_;
 
-    // 将视频头信息包添加到video_header_packets_列表中
-    video_header_packets_.emplace_back(packet);
+    // 将视频头信息包添加到历史记录中，并发布新的头信息表
+    AppendHistory(table->video_header_packets, packet);
+    StoreHeaders(std::move(table));
 
     // 输出保存视频头信息的日志信息
     LIVE_TRACE << " save video header, version : " << video_version_
@@ -281,6 +309,31 @@ bool CodecHeader::ParseCodecHeader(const PacketPtr &packet)
     return true;
 }
 
+void CodecHeader::Prune(int64_t min_idx)
+{
+    // 统计各类头信息可以清除的记录数，写者读取当前表无需同步
+    auto headers = Headers();
+    auto meta_count = PruneCount(headers->meta_packets, min_idx);
+    auto audio_count = PruneCount(headers->audio_header_packets, min_idx);
+    auto video_count = PruneCount(headers->video_header_packets, min_idx);
+
+    // 没有可清除的记录，绝大多数情况下直接返回
+    if (meta_count == 0 && audio_count == 0 && video_count == 0)
+    {
+        return;
+    }
+
+    // 复制当前头信息表，清除开头的过期记录后发布
+    auto table = CopyHeaders();
+    table->meta_packets.erase(table->meta_packets.begin(),
+                              table->meta_packets.begin() + meta_count);
+    table->audio_header_packets.erase(table->audio_header_packets.begin(),
+                                      table->audio_header_packets.begin() + audio_count);
+    table->video_header_packets.erase(table->video_header_packets.begin(),
+                                      table->video_header_packets.begin() + video_count);
+    StoreHeaders(std::move(table));
+}
+
 // 析构函数
 CodecHeader::~CodecHeader()
 {
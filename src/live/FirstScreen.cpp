@@ -0,0 +1,82 @@
+#include "FirstScreen.h"
+
+using namespace tmms::live;
+
+FirstScreen::FirstScreen(int32_t gop_index, std::vector<PacketPtr> &&packets, size_t headers,
+                         bool truncated, int64_t catchup_end)
+    : gop_index_(gop_index),
+      packets_(std::move(packets)),
+      headers_(headers),
+      truncated_(truncated),
+      catchup_end_(catchup_end)
+{
+    for (size_t i = headers_; i < packets_.size(); i++)
+    {
+        bytes_ += packets_[i]->PacketSize();
+    }
+}
+
+int32_t FirstScreen::GopIndex() const
+{
+    return gop_index_;
+}
+
+int32_t FirstScreen::LastIndex() const
+{
+    // 构建时至少包含关键帧，最后一个数据包就是最后一帧
+    return packets_.empty() ? gop_index_ : packets_.back()->Index();
+}
+
+int64_t FirstScreen::LastTimeStamp() const
+{
+    return packets_.empty() ? 0 : packets_.back()->TimeStamp();
+}
+
+const std::vector<PacketPtr> &FirstScreen::Packets() const
+{
+    return packets_;
+}
+
+size_t FirstScreen::Headers() const
+{
+    return headers_;
+}
+
+bool FirstScreen::Truncated() const
+{
+    return truncated_;
+}
+
+int64_t FirstScreen::GopTimeStamp() const
+{
+    return packets_.size() > headers_ ? packets_[headers_]->TimeStamp() : 0;
+}
+
+int64_t FirstScreen::CatchupEnd() const
+{
+    return catchup_end_;
+}
+
+int64_t FirstScreen::Bytes() const
+{
+    return bytes_;
+}
+
+PacketPtr FirstScreen::FindEncoded(int64_t key) const
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    auto iter = encoded_.find(key);
+    if (iter != encoded_.end())
+    {
+        return iter->second;
+    }
+    return PacketPtr();
+}
+
+PacketPtr FirstScreen::AddEncoded(int64_t key, const PacketPtr &data)
+{
+    // 多个事件循环可能同时序列化同一份首屏数据，以先添加的为准
+    std::lock_guard<std::mutex> lk(lock_);
+    auto iter = encoded_.emplace(key, data).first;
+    return iter->second;
+}
@@ -3,109 +3,294 @@
 
 using namespace tmms::live;
 
+namespace
+{
+    // 滑动平均中新样本的权重为 1/8
+    int64_t MovingAverage(int64_t avg, int64_t sample)
+    {
+        return avg == 0 ? sample : avg + (sample - avg) / 8;
+    }
+} // namespace
+
+GopMgr::GopMgr(uint32_t capacity)
+    : capacity_(capacity > 0 ? capacity : 1), gops_(new GopSlot[capacity_])
+{
+}
+
+void GopMgr::Reset(uint32_t capacity)
+{
+    // 重新分配环形数组，只在尚无读写时调用
+    capacity_ = capacity > 0 ? capacity : 1;
+    gops_.reset(new GopSlot[capacity_]);
+    head_.store(0, std::memory_order_release);
+    tail_.store(0, std::memory_order_release);
+}
+
 void GopMgr::AddFrame(const PacketPtr &packet)
 {
     // 更新最新时间戳为当前数据包的时间戳
-    lastest_timestamp_ = packet->TimeStamp();
+    lastest_timestamp_.store(packet->TimeStamp(), std::memory_order_release);
 
     // 如果当前数据包是关键帧
     if (packet->IsKeyFrame())
     {
-        // 将关键帧的索引和时间戳添加到 gops_ 向量中
-        gops_.emplace_back(packet->Index(), packet->TimeStamp());
+        // 上一个 GOP 结束，更新 GOP 时长和字节数的滑动平均值
+        if (gop_timestamp_ >= 0)
+        {
+            auto duration = (int64_t)packet->TimeStamp() - gop_timestamp_;
+            avg_gop_duration_.store(MovingAverage(avg_gop_duration_.load(std::memory_order_relaxed),
+                                                  duration),
+                                    std::memory_order_relaxed);
+            avg_gop_bytes_.store(MovingAverage(avg_gop_bytes_.load(std::memory_order_relaxed),
+                                               gop_bytes_),
+                                 std::memory_order_relaxed);
+        }
+        gop_timestamp_ = packet->TimeStamp();
+        gop_bytes_ = 0;
 
-        // 更新最大 GOP 长度
-        max_gop_length_ = std::max(max_gop_length_, gop_length_);
+        auto head = head_.load(std::memory_order_relaxed);
+        auto tail = tail_.load(std::memory_order_relaxed);
+
+        // 开始修改，版本号变为奇数，读者据此发现正在修改
+        auto version = version_.load(std::memory_order_relaxed);
+        version_.store(version + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        // 环形数组已满时丢弃最旧的 GOP
+        if (tail - head >= capacity_)
+        {
+            head_.store(head + 1, std::memory_order_relaxed);
+        }
+
+        // 将关键帧的索引和时间戳写入环形数组
+        GopSlot &slot = gops_[tail % capacity_];
+        slot.index.store(packet->Index(), std::memory_order_relaxed);
+        slot.timestamp.store(packet->TimeStamp(), std::memory_order_relaxed);
+        tail_.store(tail + 1, std::memory_order_relaxed);
+
+        // 修改完成，版本号恢复为偶数
+        version_.store(version + 2, std::memory_order_release);
 
+        // 更新最大 GOP 长度
+        max_gop_length_.store(std::max(max_gop_length_.load(std::memory_order_relaxed), gop_length_),
+                              std::memory_order_relaxed);
         // 累加当前 GOP 的长度到总长度
         total_gop_length_ += gop_length_;
-
         // GOP 数量加一
-        gop_numbers_ ++;
-
+        gop_numbers_++;
         // 重置当前 GOP 长度
         gop_length_ = 0;
     }
 
-    // 当前 GOP 长度加一
+    // 当前 GOP 长度加一，并累计字节数
     gop_length_++;
+    gop_bytes_ += packet->PacketSize();
 }
 
 int32_t GopMgr::MaxGopLength() const
 {
     // 返回最大 GOP 长度
-    return max_gop_length_;
+    return max_gop_length_.load(std::memory_order_relaxed);
+}
+
+int64_t GopMgr::AvgGopDuration() const
+{
+    // 返回 GOP 时长的滑动平均值
+    return avg_gop_duration_.load(std::memory_order_relaxed);
+}
+
+int64_t GopMgr::AvgGopBytes() const
+{
+    // 返回 GOP 字节数的滑动平均值
+    return avg_gop_bytes_.load(std::memory_order_relaxed);
 }
 
 size_t GopMgr::GopSize() const
 {
-    // 返回 gops_ 向量的大小
-    return gops_.size();
+    // 返回环形数组中 GOP 的数量
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
 }
 
-int GopMgr::GetGopByLatency(int content_latency, int &latency) const
+void GopMgr::Snapshot(std::vector<GopItemInfo> &gops) const
 {
-    // 初始化获取的 GOP 索引为 -1
-    int got = -1;
+    while (true)
+    {
+        gops.clear();
 
-    // 初始化延迟为 0
-    latency = 0;
+        // 写者正在修改时重新读取
+        auto version = version_.load(std::memory_order_acquire);
+        if (version & 1)
+        {
+            continue;
+        }
 
-    // 从 gops_ 向量的末尾开始迭代
-    auto iter = gops_.rbegin();
+        auto head = head_.load(std::memory_order_relaxed);
+        auto tail = tail_.load(std::memory_order_relaxed);
+        for (auto i = head; i < tail; i++)
+        {
+            const GopSlot &slot = gops_[i % capacity_];
+            gops.emplace_back(slot.index.load(std::memory_order_relaxed),
+                              slot.timestamp.load(std::memory_order_relaxed));
+        }
 
-    // 遍历 gops_ 向量
-    for (; iter != gops_.rend(); ++iter)
+        // 读取期间版本号没有变化，说明快照一致
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (version_.load(std::memory_order_relaxed) == version)
+        {
+            return;
+        }
+    }
+}
+
+int GopMgr::GetGopByLatency(int content_latency, int &latency) const
+{
+    while (true)
     {
-        // 计算当前 GOP 项的延迟
-        int item_latency = lastest_timestamp_ - iter->timestamp;
+        // 写者正在修改时重新读取
+        auto version = version_.load(std::memory_order_acquire);
+        if (version & 1)
+        {
+            continue;
+        }
 
-        // 如果当前 GOP 项的延迟在内容延迟范围内
-        if (item_latency <= content_latency)
+        // 在读取版本号之后读取最新时间戳，保证它不早于本版本中任何关键帧的时间戳。
+        // 关键帧时间戳不早于 min_timestamp 的 GOP，延迟都在内容延迟范围内
+        auto lastest_timestamp = LastestTimeStamp();
+        auto min_timestamp = lastest_timestamp - content_latency;
+
+        // 关键帧时间戳单调递增，二分查找第一个时间戳不早于 min_timestamp 的 GOP
+        auto low = head_.load(std::memory_order_relaxed);
+        auto tail = tail_.load(std::memory_order_relaxed);
+        auto high = tail;
+        while (low < high)
         {
-            // 记录 GOP 索引
-            got = iter->index;
+            auto mid = low + (high - low) / 2;
+            if (gops_[mid % capacity_].timestamp.load(std::memory_order_relaxed) < min_timestamp)
+            {
+                low = mid + 1;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
 
-            // 更新延迟值
-            latency = item_latency;
+        // 读取找到的 GOP 的索引和延迟
+        int got = -1;
+        int64_t timestamp = 0;
+        if (low < tail)
+        {
+            const GopSlot &slot = gops_[low % capacity_];
+            got = slot.index.load(std::memory_order_relaxed);
+            timestamp = slot.timestamp.load(std::memory_order_relaxed);
         }
-        else 
+
+        // 读取期间版本号没有变化，说明结果有效
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (version_.load(std::memory_order_relaxed) == version)
         {
-            // 如果延迟超过范围，结束循环
-            break;
+            latency = got == -1 ? 0 : lastest_timestamp - timestamp;
+            return got;
         }
     }
-
-    // 返回找到的 GOP 索引
-    return got;
 }
 
-void GopMgr::ClearExpriedGop(int min_idx)
+int GopMgr::GetNextGop(int64_t index, int &latency) const
 {
-    // 如果 gops_ 向量为空
-    if (gops_.empty())
+    while (true)
     {
-        // 直接返回
-        return;
+        // 写者正在修改时重新读取
+        auto version = version_.load(std::memory_order_acquire);
+        if (version & 1)
+        {
+            continue;
+        }
+        auto lastest_timestamp = LastestTimeStamp();
+
+        // 关键帧索引单调递增，二分查找第一个索引大于 index 的 GOP
+        auto low = head_.load(std::memory_order_relaxed);
+        auto tail = tail_.load(std::memory_order_relaxed);
+        auto high = tail;
+        while (low < high)
+        {
+            auto mid = low + (high - low) / 2;
+            if (gops_[mid % capacity_].index.load(std::memory_order_relaxed) <= index)
+            {
+                low = mid + 1;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+
+        // 读取找到的 GOP 的索引和时间戳
+        int got = -1;
+        int64_t timestamp = 0;
+        if (low < tail)
+        {
+            const GopSlot &slot = gops_[low % capacity_];
+            got = slot.index.load(std::memory_order_relaxed);
+            timestamp = slot.timestamp.load(std::memory_order_relaxed);
+        }
+
+        // 读取期间版本号没有变化，说明结果有效
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (version_.load(std::memory_order_relaxed) == version)
+        {
+            latency = got == -1 ? 0 : lastest_timestamp - timestamp;
+            return got;
+        }
     }
+}
 
-    // 遍历 gops_ 向量
-    for (auto iter = gops_.begin(); iter != gops_.end();)
+int GopMgr::GetLastestGop(int &latency) const
+{
+    while (true)
     {
-        // 如果当前 GOP 项的索引小于等于最小索引
-        if (iter->index <= min_idx)
+        // 写者正在修改时重新读取
+        auto version = version_.load(std::memory_order_acquire);
+        if (version & 1)
         {
-            // 删除当前 GOP 项，并更新迭代器
-            iter = gops_.erase(iter);
+            continue;
         }
-        else 
+        auto lastest_timestamp = LastestTimeStamp();
+
+        // 读取最新的 GOP 的索引和时间戳
+        auto head = head_.load(std::memory_order_relaxed);
+        auto tail = tail_.load(std::memory_order_relaxed);
+        int got = -1;
+        int64_t timestamp = 0;
+        if (head < tail)
+        {
+            const GopSlot &slot = gops_[(tail - 1) % capacity_];
+            got = slot.index.load(std::memory_order_relaxed);
+            timestamp = slot.timestamp.load(std::memory_order_relaxed);
+        }
+
+        // 读取期间版本号没有变化，说明结果有效
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (version_.load(std::memory_order_relaxed) == version)
         {
-            // 否则，移动到下一个 GOP 项
-            iter++;
+            latency = got == -1 ? 0 : lastest_timestamp - timestamp;
+            return got;
         }
     }
 }
 
+void GopMgr::ClearExpriedGop(int min_idx)
+{
+    auto head = head_.load(std::memory_order_relaxed);
+    auto tail = tail_.load(std::memory_order_relaxed);
+
+    // 从最旧的 GOP 开始，索引小于等于最小索引的 GOP 都已过期，只需前移头部位置
+    while (head < tail && gops_[head % capacity_].index.load(std::memory_order_relaxed) <= min_idx)
+    {
+        head++;
+    }
+    head_.store(head, std::memory_order_release);
+}
+
 void GopMgr::PrintAllGop()
 {
     // 创建一个字符串流对象
@@ -114,8 +299,11 @@ void GopMgr::PrintAllGop()
     // 添加标题到字符串流
     ss << "All gop : ";
 
-    // 遍历 gops_ 向量
-    for (auto iter = gops_.begin(); iter != gops_.end(); iter++)
+    std::vector<GopItemInfo> gops;
+    Snapshot(gops);
+
+    // 遍历 GOP 列表
+    for (auto iter = gops.begin(); iter != gops.end(); iter++)
     {
         // 将每个 GOP 项的索引和时间戳添加到字符串流
         ss << "[" << iter->index << ", " << iter->timestamp << "]";
@@ -123,4 +311,4 @@ void GopMgr::PrintAllGop()
 
     // 将字符串流的内容输出到日志中
     LIVE_TRACE << ss.str() << "\n";
-}
\ No newline at end of file
+}
@@ -5,6 +5,7 @@
 #include "base/StringUtils.h"
 #include "base/TTime.h"
 #include "live/base/LiveLog.h"
+#include "mmedia/rtmp/RtmpContext.h"
 #include "mmedia/rtmp/RtmpServer.h"
 
 using namespace tmms::live;
@@ -162,6 +163,26 @@ void LiveService::OnTimer(const TaskPtr &t)
         }
     }
 
+    // 输出数据包内存池在本周期内的分配速率和复用率
+    auto stats = PacketPool::Stats();
+    auto now = base::TTime::NowMS();
+    if (pool_stats_time_ > 0 && now > pool_stats_time_)
+    {
+        auto elapsed = now - pool_stats_time_;
+        auto allocs = stats.allocs - pool_stats_.allocs;
+        auto hits = stats.pool_hits - pool_stats_.pool_hits;
+        LIVE_INFO << "packet pool alloc/s:" << allocs * 1000 / elapsed
+                  << " hit/s:" << hits * 1000 / elapsed
+                  << " miss/s:" << (stats.pool_misses - pool_stats_.pool_misses) * 1000 / elapsed
+                  << " large/s:" << (stats.large_allocs - pool_stats_.large_allocs) * 1000 / elapsed
+                  << " remote_free/s:"
+                  << (stats.remote_frees - pool_stats_.remote_frees) * 1000 / elapsed
+                  << " hit_ratio:" << (allocs > 0 ? hits * 100 / allocs : 0) << "%"
+                  << " cached_bytes:" << stats.cached_bytes;
+    }
+    pool_stats_ = stats;
+    pool_stats_time_ = now;
+
     // 重启定时任务
     t->Restart();
 }
@@ -245,6 +266,16 @@ bool LiveService::OnPlay(const TcpConnectionPtr &conn, const std::string &sessio
     // 将用户添加到会话的播放器列表中
     s->AddPlayer(std::dynamic_pointer_cast<PlayerUser>(user));
 
+    // 按应用配置协商输出块大小，块越大每帧需要的块头和发送节点越少；
+    // 按应用配置开启聚合消息，一次发送的多个帧合并为一条消息
+    auto cx = conn->GetContext<RtmpContext>(kRtmpContext);
+    auto &app_info = s->GetAppInfo();
+    if (cx && app_info)
+    {
+        cx->SetOutChunkSize(app_info->rtmp_chunk_size_);
+        cx->SetAggregateSize(app_info->rtmp_aggregate_size_);
+    }
+
     // 返回成功
     return true;
 }
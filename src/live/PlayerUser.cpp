@@ -1,4 +1,5 @@
 #include "PlayerUser.h"
+#include <algorithm>
 
 using namespace tmms::live;
 
@@ -42,10 +43,51 @@ void PlayerUser::ClearVideoHeader()
 {
     // 重置视频头指针
     video_header_.reset();
-}         
+}
 
-TimeCorrector &PlayerUser::GetTimeCorrector()
+namespace
 {
-    // 返回时间校正器的引用
-    return time_corrector_;
-}
\ No newline at end of file
+    // 按追赶区间映射时间戳，不加偏移
+    int64_t CatchupTimeStamp(int64_t ts, int64_t base, int64_t end, int64_t catchup_time)
+    {
+        if (end <= base)
+        {
+            return ts;
+        }
+
+        // 区间内的帧按比例压缩到 catchup_time 内
+        if (ts < end)
+        {
+            return base + std::max<int64_t>(0, ts - base) * catchup_time / (end - base);
+        }
+
+        // 之后的帧紧接压缩后的区间
+        return ts - (end - base) + catchup_time;
+    }
+} // namespace
+
+int64_t PlayerUser::OutTimeStamp(int64_t ts) const
+{
+    auto out = CatchupTimeStamp(ts, catchup_base_, catchup_end_, kCatchupTime) + out_ts_offset_;
+    return std::max<int64_t>(0, out);
+}
+
+void PlayerUser::StartCatchup(int64_t base, int64_t end)
+{
+    // 之前的追赶区间已经结束，它对之后帧的前移量并入偏移
+    out_ts_offset_ += CatchupTimeStamp(base, catchup_base_, catchup_end_, kCatchupTime) - base;
+    catchup_base_ = base;
+    catchup_end_ = end;
+}
+
+bool PlayerUser::InCatchup(int64_t ts) const
+{
+    // 加入后的限速追赶还没有结束
+    if (burst_start_ > 0)
+    {
+        return true;
+    }
+
+    // 帧落在压缩时间戳的追赶区间内
+    return ts >= catchup_base_ && ts < catchup_end_;
+}
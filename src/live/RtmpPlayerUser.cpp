@@ -3,6 +3,7 @@
 #include "mmedia/rtmp/RtmpContext.h"
 #include "live/base/LiveLog.h"
 #include "base/TTime.h"
+#include <algorithm>
 
 using namespace tmms::live;
 using namespace tmms::mm;
@@ -22,11 +23,42 @@ bool RtmpPlayerUser::PostFrames()
         return false;
     }
 
+    // 更新连接的发送速率，流据此决定本次获取的帧数
+    auto cx = connection_->GetContext<RtmpContext>(kRtmpContext);
+    if (cx)
+    {
+        send_rate_ = cx->SendRate();
+    }
+
     // 从流中获取帧，使用动态类型转换将当前对象转换为 PlayerUser
     stream_->GetFrames(std::dynamic_pointer_cast<PlayerUser>(shared_from_this()));
+
+    // 慢速状态持续太久，按应用配置断开连接
+    if (slow_close_)
+    {
+        Close();
+        return false;
+    }
     
+    // 刚加入的播放者先发送首屏数据
+    if (first_screen_)
+    {
+        // 推送首屏数据
+        auto ret = PushFirstScreen();
+
+        // 如果推送成功
+        if (ret)
+        {
+            // 记录日志
+            LIVE_INFO << " rtmp sent first screen now : " << base::TTime::NowMS()
+                      << " packets : " << first_screen_->Packets().size() << " host : " << user_id_;
+
+            // 重置首屏数据
+            first_screen_.reset();
+        }
+    }
     // 如果存在元数据
-    if (meta_)
+    else if (meta_)
     {
         // 推送元数据帧，标头参数为 true
         auto ret = PushFrame(meta_, true);
@@ -115,16 +147,16 @@ bool RtmpPlayerUser::PushFrame(PacketPtr &packet,bool is_header)
     // 初始化时间戳
     int64_t ts = 0;
 
-    // 如果不是标头帧，进行时间戳校正
+    // 如果不是标头帧，使用流校正后的时间戳加上本播放者的偏移
     if (!is_header)
     {
-        ts = time_corrector_.CorrectTimestamp(packet);
+        ts = OutTimeStamp(packet->TimeStamp());
     }
 
-    // 构建 RTMP 数据块
-    cx->BuildChunk(packet, ts, is_header);
+    // 放入发送队列
+    cx->QueueMessage(packet, ts, is_header);
 
-    // 发送数据块
+    // 按优先级发送
     cx->Send();
 
     // 返回 true，表示帧成功推送
@@ -147,21 +179,86 @@ bool RtmpPlayerUser::PushFrames(std::vector<PacketPtr> &list)
     int64_t ts = 0;
 
     // 遍历帧列表
-    for(int i = 0; i < list.size(); i++)
+    size_t i = 0;
+    while (i < list.size())
     {
         // 获取当前帧
         PacketPtr &packet = list[i];
 
-        // 校正时间戳
-        ts = time_corrector_.CorrectTimestamp(packet);
+        // 流已经校正过时间戳，只需按本播放者的追赶区间和偏移调整
+        ts = OutTimeStamp(packet->TimeStamp());
+
+        // 开启聚合且处于追赶状态时，连续的多个同类型帧合并为一条聚合消息，
+        // 每个帧按各自的输出时间戳写入；追上直播边缘后逐帧发送，不增加延迟
+        size_t count = InCatchup(packet->TimeStamp())
+                           ? cx->AggregateCount(&list[i], list.size() - i)
+                           : 0;
+        if (count > 1)
+        {
+            std::vector<uint32_t> timestamps(count);
+            for (size_t k = 0; k < count; k++)
+            {
+                timestamps[k] = (uint32_t)OutTimeStamp(list[i + k]->TimeStamp());
+            }
+            cx->QueueAggregate(&list[i], &timestamps[0], count);
+            i += count;
+            continue;
+        }
 
-        // 构建 RTMP 数据块
-        cx->BuildChunk(packet, ts);
+        // 放入发送队列，音频和视频分别排队
+        cx->QueueMessage(packet, ts);
+        i++;
     }
     
-    // 发送所有构建的数据块
+    // 按优先级发送，控制消息优先，其次音频，最后视频
     cx->Send();
 
     // 返回 true，表示帧成功推送
     return true;
-}
\ No newline at end of file
+}
+
+bool RtmpPlayerUser::PushFirstScreen()
+{
+    // 获取当前连接的 RTMP 上下文
+    auto cx = connection_->GetContext<RtmpContext>(kRtmpContext);
+
+    // 检查上下文是否有效且已准备好
+    if (!cx || !cx->Ready())
+    {
+        return false;
+    }
+
+    auto &packets = first_screen_->Packets();
+    auto headers = first_screen_->Headers();
+
+    // 元数据和编解码头的时间戳为 0，其余按追赶区间压缩。共享首屏的播放者追赶区间相同，
+    // 偏移都为 0，输出时间戳一致
+    std::vector<uint32_t> timestamps(packets.size(), 0);
+    for (size_t i = headers; i < packets.size(); i++)
+    {
+        timestamps[i] = (uint32_t)OutTimeStamp(packets[i]->TimeStamp());
+    }
+
+    // 按连接的块大小取得编码后的首屏数据，同一块大小只编码一次
+    int32_t chunk_size = cx->OutChunkSize();
+    auto data = first_screen_->FindEncoded(chunk_size);
+    if (!data)
+    {
+        data = first_screen_->AddEncoded(
+            chunk_size,
+            RtmpContext::EncodeMessages(&packets[0], packets.size(), &timestamps[0], chunk_size));
+    }
+
+    // 编码的块大小与连接不一致时逐条放入发送队列
+    if (!cx->QueueEncoded(data, chunk_size))
+    {
+        for (size_t i = 0; i < packets.size(); i++)
+        {
+            cx->QueueMessage(packets[i], timestamps[i], i < headers);
+        }
+    }
+
+    // 发送
+    cx->Send();
+    return true;
+}
@@ -177,9 +177,9 @@ void Session::CloseUser(const UserPtr &user)
             // 使用 std::lock_guard 对互斥锁加锁，确保线程安全
             std::lock_guard<std::mutex> lk(lock_);
 
-            // 如果用户类型小于等于 WebRTC 播放器类型，且当前会话有发布者
+            // 如果用户类型小于等于 WebRTC 发布类型，且当前会话有发布者
             // 则认为这是一个发布者，需要移除该发布者
-            if (user->GetUserType() <= UserType::kUserTypePlayerWebRTC)
+            if (user->GetUserType() <= UserType::kUserTypePublishWebRtc)
             {
                 if (publisher_)
                 {
@@ -194,7 +194,7 @@ void Session::CloseUser(const UserPtr &user)
                     publisher_.reset();
                 }
             }
-            else    // 如果用户类型大于 WebRTC 播放器类型，认为这是一个播放用户
+            else    // 如果用户类型大于 WebRTC 发布类型，认为这是一个播放用户
             {
                 // 输出调试信息，记录移除玩家的操作，包括会话名、用户ID、用户的已用时间、准备时间和流时间
                 LIVE_DEBUG << " remove player, session name : " << session_name_
@@ -204,7 +204,11 @@ void Session::CloseUser(const UserPtr &user)
                             << " , stream time : " << SinceStart();
 
                 // 从 players_ 集合中移除该播放用户，使用 dynamic_pointer_cast 进行类型转换
-                players_.erase(std::dynamic_pointer_cast<PlayerUser>(user));
+                auto player = std::dynamic_pointer_cast<PlayerUser>(user);
+                players_.erase(player);
+
+                // 从所在事件循环的转发器中移除
+                stream_->RemovePlayer(player);
 
                 // 更新最后一次玩家活动时间为当前时间
                 player_live_time_ = tmms::base::TTime::NowMS();
@@ -216,18 +220,6 @@ void Session::CloseUser(const UserPtr &user)
     }
 }
 
-void Session::ActiveAllPlayers()
-{
-    // 使用 std::lock_guard 对互斥锁加锁，确保线程安全
-    std::lock_guard<std::mutex> lk(lock_);
-
-    // 遍历 players_ 集合中的每个用户，并调用他们的 Active() 方法，激活所有用户
-    for (auto const &u : players_)
-    {
-        u->Active();
-    }
-}
-
 void Session::AddPlayer(const PlayerUserPtr &user)
 {
     {
@@ -238,6 +230,9 @@ void Session::AddPlayer(const PlayerUserPtr &user)
         players_.insert(user);
     }
 
+    // 将播放用户加入其所在事件循环的转发器
+    stream_->AddPlayer(user);
+
     // 输出调试信息，记录添加玩家的操作，包括会话名和用户ID
     LIVE_DEBUG << " add player, session name : " << session_name_ << " , user : " << user->UserId();
 
@@ -288,6 +283,9 @@ void Session::SetAppInfo(AppInfoPtr &ptr)
 {
     // 设置会话的应用信息
     app_info_ = ptr;
+
+    // 按应用配置设置流的缓冲区容量
+    stream_->SetAppInfo(ptr);
 }
 
 AppInfoPtr &Session::GetAppInfo()
@@ -296,6 +294,18 @@ AppInfoPtr &Session::GetAppInfo()
     return app_info_;
 }
 
+SlowConsumerStats &Session::GetSlowConsumerStats()
+{
+    // 返回慢速播放者处理计数器
+    return slow_stats_;
+}
+
+JoinBurstStats &Session::GetJoinBurstStats()
+{
+    // 返回播放者加入追赶计数器
+    return burst_stats_;
+}
+
 bool Session::IsPublishing() const 
 {
     // 检查当前会话是否有发布者，返回 true 表示正在发布，false 表示没有发布者
@@ -314,15 +324,32 @@ void Session::Clear()
         CloseUserNoLock(publisher_);
     }
 
-    // 遍历 players_ 集合中的所有玩家，并将每个玩家关闭
+    // 输出本会话慢速播放者的处理统计
+    LIVE_INFO << " session : " << session_name_
+              << " slow players : " << slow_stats_.slow_players.load()
+              << " , dropped nonref : " << slow_stats_.dropped_nonref.load()
+              << " , dropped video : " << slow_stats_.dropped_video.load()
+              << " , gop skips : " << slow_stats_.gop_skips.load()
+              << " , disconnects : " << slow_stats_.disconnects.load();
+
+    // 输出本会话播放者加入追赶的统计
+    auto finished = burst_stats_.finished.load();
+    LIVE_INFO << " session : " << session_name_ << " join bursts : " << burst_stats_.bursts.load()
+              << " , finished : " << finished << " , avg time : "
+              << (finished > 0 ? burst_stats_.total_time.load() / finished : 0)
+              << " ms , max time : " << burst_stats_.max_time.load()
+              << " ms , bytes : " << burst_stats_.bytes.load();
+
+    // 先取出所有播放用户并清空 players_ 集合，关闭时会从集合中移除用户，不能边遍历边关闭
+    std::unordered_set<PlayerUserPtr> players;
+    players.swap(players_);
+
+    // 遍历所有玩家，并将每个玩家关闭
     // 使用 dynamic_pointer_cast 进行类型转换
-    for (auto const &p : players_)
+    for (auto const &p : players)
     {
         CloseUserNoLock(std::dynamic_pointer_cast<User>(p));
     }
-
-    // 清空 players_ 集合，移除所有播放用户
-    players_.clear();
 }
 
 void Session::CloseUserNoLock(const UserPtr &user)
@@ -331,8 +358,8 @@ void Session::CloseUserNoLock(const UserPtr &user)
     if (!user->destroyed_.exchange(true))
     {
         {
-            // 如果用户类型小于等于 WebRTC 播放器类型，表示这是发布者用户
-            if (user->GetUserType() <= UserType::kUserTypePlayerWebRTC)
+            // 如果用户类型小于等于 WebRTC 发布类型，表示这是发布者用户
+            if (user->GetUserType() <= UserType::kUserTypePublishWebRtc)
             {
                 // 如果当前会话有发布者
                 if (publisher_)
@@ -361,7 +388,11 @@ void Session::CloseUserNoLock(const UserPtr &user)
                             << " , stream time : " << SinceStart();
 
                 // 从 players_ 集合中移除该播放用户，使用 dynamic_pointer_cast 进行类型转换         
-                players_.erase(std::dynamic_pointer_cast<PlayerUser>(user));
+                auto player = std::dynamic_pointer_cast<PlayerUser>(user);
+                players_.erase(player);
+
+                // 从所在事件循环的转发器中移除
+                stream_->RemovePlayer(player);
                 
                 // 关闭该播放用户
                 user->Close();
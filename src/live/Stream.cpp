@@ -3,6 +3,8 @@
 #include "base/TTime.h"
 #include "live/base/CodecUtils.h"
 #include "live/base/LiveLog.h"
+#include "network/base/SocketOpt.h"
+#include <algorithm>
 
 using namespace tmms::live;
 using namespace tmms::base;
@@ -13,6 +15,8 @@ Stream::Stream(Session &s, const std::string &session_name)
       session_name_(session_name) // 初始化成员变量 session_name_ 为传入的会话名称
       ,
       packet_buffer_(packet_buffer_size_) // 初始化数据包缓冲区大小为 packet_buffer_size_
+      ,
+      gop_mgr_(packet_buffer_size_) // 缓冲区内最多有 packet_buffer_size_ 个 GOP
 {
     // 获取当前时间戳并赋值给 stream_time_
     stream_time_ = TTime::NowMS();
@@ -21,6 +25,29 @@ Stream::Stream(Session &s, const std::string &session_name)
     start_timestamp_ = TTime::NowMS();
 }
 
+namespace
+{
+    // 数据包实际占用的内存，包括包头和分配的数据区
+    int64_t PacketBytes(const PacketPtr &packet)
+    {
+        return sizeof(Packet) + packet->Capacity();
+    }
+} // namespace
+
+void Stream::SetAppInfo(const AppInfoPtr &app_info)
+{
+    // 缓冲区最多保存 max_buffer 个数据包，GOP 数量不会超过数据包数量
+    packet_buffer_size_ = app_info->max_buffer_;
+    packet_buffer_.Reset(packet_buffer_size_);
+    gop_mgr_.Reset(packet_buffer_size_);
+}
+
+int64_t Stream::BufferBytes() const
+{
+    // 返回缓冲区中数据包占用的内存
+    return buffer_bytes_;
+}
+
 int64_t Stream::ReadyTime() const
 {
     // 返回 ready_time_ 的值
@@ -96,99 +123,263 @@ void Stream::AddPacket(PacketPtr &&packet)
     // 设置数据包的时间戳
     packet->SetTimeStamp(t);
 
+    // 只有发布者线程写入，新的帧索引为缓冲区最新索引加一
+    auto index = packet_buffer_.LastestIndex() + 1;
+
+    // 设置数据包的索引
+    packet->SetIndex(index);
+
+    // 如果是视频并且是关键帧
+    if (packet->IsVideo() && CodecUtils::IsKeyFrame(packet))
     {
-        // 创建互斥锁，保护临界区
-        std::lock_guard<std::mutex> lk(lock_);
+        // 设置流为准备状态
+        SetReady(true);
 
-        // 增加帧索引并获取新的索引值
-        auto index = ++frame_index_;
+        // 记录最新关键帧的索引，淘汰时保留最新的 GOP
+        keyframe_index_ = index;
 
-        // 设置数据包的索引
-        packet->SetIndex(index);
+        // 设置数据包类型为视频关键帧
+        packet->SetPacketType(kPacketTypeVideo | kFrameTypeKeyFrame);
+    }
 
-        // 如果是视频并且是关键帧
-        if (packet->IsVideo() && CodecUtils::IsKeyFrame(packet))
+    // 如果是编解码头
+    if (CodecUtils::IsCodecHeader(packet))
+    {
+        // 解析编解码头，新的头信息表发布后播放者即可读取
+        codec_headers_.ParseCodecHeader(packet);
+
+        // 如果是视频
+        if (packet->IsVideo())
         {
-            // 设置流为准备状态
-            SetReady(true);
+            // 标记为有视频
+            has_video_ = true;
 
-            // 设置数据包类型为视频关键帧
-            packet->SetPacketType(kPacketTypeVideo | kFrameTypeKeyFrame);
+            // 增加流版本
+            stream_version_++;
         }
+        // 如果是音频
+        else if (packet->IsAudio())
+        {
+            // 标记为有音频
+            has_audio_ = true;
 
-        // 如果是编解码头
-        if (CodecUtils::IsCodecHeader(packet))
+            // 增加流版本
+            stream_version_++;
+        }
+        // 如果是元数据
+        else if (packet->IsMeta())
         {
-            // 解析编解码头
-            codec_headers_.ParseCodecHeader(packet);
+            // 标记为有元数据
+            has_meta_ = true;
 
-            // 如果是视频
-            if (packet->IsVideo())
-            {
-                // 标记为有视频
-                has_video_ = true;
+            // 增加流版本
+            stream_version_++;
+        }
+    }
 
-                // 增加流版本
-                stream_version_++;
-            }
-            // 如果是音频
-            else if (packet->IsAudio())
-            {
-                // 标记为有音频
-                has_audio_ = true;
+    // 将帧添加到 GOP 管理器
+    gop_mgr_.AddFrame(packet);
 
-                // 增加流版本
-                stream_version_++;
-            }
-            // 如果是元数据
-            else if (packet->IsMeta())
-            {
-                // 标记为有元数据
-                has_meta_ = true;
+    // 记录待投递给各事件循环转发器的数据包
+    relay_packets_.emplace_back(packet);
+    bool is_keyframe = packet->IsKeyFrame();
 
-                // 增加流版本
-                stream_version_++;
-            }
-        }
+    // 缓冲区已满时先淘汰最旧的数据包，保证内存统计与缓冲区内容一致
+    if (packet_buffer_.Size() >= packet_buffer_.Capacity())
+    {
+        buffer_bytes_ -= PacketBytes(packet_buffer_.Front());
+        packet_buffer_.PopFront();
+    }
 
-        // 将帧添加到 GOP 管理器
-        gop_mgr_.AddFrame(packet);
+    // 将数据包写入环形缓冲区，写入后播放者即可读取
+    buffer_bytes_ += PacketBytes(packet);
+    packet_buffer_.Push(std::move(packet));
 
-        // 将数据包移动到缓冲区
-        packet_buffer_[index % packet_buffer_size_] = std::move(packet);
+    // 按内存和时长上限淘汰数据包，并清除过期的 GOP 和编解码头
+    EvictPackets();
 
-        // 计算最小索引
-        auto min_idx = frame_index_ - packet_buffer_size_;
+    // 获取当前时间
+    auto now = TTime::NowMS();
 
-        // 如果最小索引大于 0
-        if (min_idx > 0)
+    // 如果数据到达时间为 0
+    if (data_coming_time_ == 0)
+    {
+        // 将当前时间赋值给 data_coming_time_
+        data_coming_time_ = now;
+    }
+
+    // 将当前时间赋值给 stream_time_
+    stream_time_ = now;
+
+    // 按应用配置的唤醒粒度合并唤醒：每个唤醒周期（或每个关键帧）只向各事件循环投递一次，
+    // 期间到达的数据包合并成一批。没有视频的流不会有关键帧，仍按唤醒周期合并
+    bool wakeup = true;
+    int64_t max_delay = 0;
+    auto &app_info = session_.GetAppInfo();
+    if (app_info)
+    {
+        if (app_info->wakeup_on_keyframe_ && has_video_)
+        {
+            // 关键帧间隔过长或缺少关键帧时，按最长等待时间和最大包数兜底投递，
+            // 避免待投递的数据包无限增长、播放者长时间收不到数据
+            max_delay = kMaxKeyframeWakeup;
+            wakeup = is_keyframe || now - last_wakeup_time_ >= max_delay ||
+                     relay_packets_.size() >= (size_t)kMaxRelayPackets;
+        }
+        else
         {
-            // 清除过期的 GOP
-            gop_mgr_.ClearExpriedGop(min_idx);
+            max_delay = app_info->wakeup_tick_;
+            wakeup = now - last_wakeup_time_ >= max_delay;
         }
     }
 
-    // 如果数据到达时间为 0
-    if (data_coming_time_ == 0)
+    if (wakeup)
+    {
+        // 将新的数据包投递给各事件循环的转发器，由转发器唤醒本循环的播放者
+        last_wakeup_time_ = now;
+        ActiveRelays();
+    }
+    else
     {
-        // 获取当前时间并赋值给 data_coming_time_
-        data_coming_time_ = TTime::NowMS();
+        // 发布者在唤醒周期内停止发送时，被合并的数据包不能等到下一个数据包到达才投递
+        ScheduleFlush(max_delay - (now - last_wakeup_time_));
     }
+}
 
-    // 获取当前时间并赋值给 stream_time_
-    stream_time_ = TTime::NowMS();
+void Stream::ScheduleFlush(int64_t delay)
+{
+    auto loop = EventLoop::Current();
+    if (!loop)
+    {
+        return;
+    }
 
-    // 加载当前帧索引
-    auto frame = frame_index_.load();
+    if (!flush_timer_)
+    {
+        // 定时器不持有流，流释放后回调不做任何事。不更新上次唤醒的时间，
+        // 否则之后到达的数据包都要等到下一个周期结束，每个唤醒周期最多两次投递
+        std::weak_ptr<Stream> weak = shared_from_this();
+        flush_timer_ = std::make_shared<Timer>([weak]() {
+            auto stream = weak.lock();
+            if (stream)
+            {
+                stream->ActiveRelays();
+            }
+        });
+    }
 
-    // 如果帧索引小于 300 或每 5 帧一次
-    if (frame < 300 || frame % 5 == 0)
+    // 一个唤醒周期内只设置一次，期间到达的数据包由同一次投递带走
+    if (!flush_timer_->Pending())
     {
-        // 激活所有播放
-        session_.ActiveAllPlayers();
+        loop->AddTimer(flush_timer_, delay);
     }
 }
 
+void Stream::EvictPackets()
+{
+    auto &app_info = session_.GetAppInfo();
+    uint64_t max_bytes = app_info ? app_info->max_buffer_bytes_ : 0;
+    uint32_t max_time = app_info ? app_info->max_buffer_time_ : 0;
+    auto lastest_timestamp = gop_mgr_.LastestTimeStamp();
+
+    // 最新的 GOP 始终保留，否则新加入的播放者要等到下一个关键帧；没有视频时至少保留最新的数据包
+    auto keep_idx = keyframe_index_ >= 0 ? keyframe_index_ : packet_buffer_.LastestIndex();
+
+    // 从最旧的数据包开始淘汰
+    while (packet_buffer_.MinIndex() < keep_idx)
+    {
+        auto &packet = packet_buffer_.Front();
+
+        // 检查内存和时长是否超出上限
+        bool over_bytes = max_bytes > 0 && (uint64_t)buffer_bytes_ > max_bytes;
+        bool over_time =
+            max_time > 0 && lastest_timestamp - (int64_t)packet->TimeStamp() > (int64_t)max_time;
+
+        // 都没有超出上限时停止淘汰
+        if (!over_bytes && !over_time)
+        {
+            break;
+        }
+
+        // 淘汰最旧的数据包
+        buffer_bytes_ -= PacketBytes(packet);
+        packet_buffer_.PopFront();
+    }
+
+    // 淘汰点之前的 GOP 已经无法播放
+    auto min_idx = packet_buffer_.MinIndex();
+    gop_mgr_.ClearExpriedGop(min_idx - 1);
+
+    // 编解码头的历史记录按同一个淘汰点清除
+    codec_headers_.Prune(min_idx);
+}
+
+void Stream::ActiveRelays()
+{
+    // 没有新的数据包
+    if (relay_packets_.empty())
+    {
+        return;
+    }
+
+    // 同一批数据包由所有转发器共享
+    auto packets = std::make_shared<std::vector<PacketPtr>>();
+    packets->swap(relay_packets_);
+
+    std::lock_guard<std::mutex> lk(relay_lock_);
+    for (auto const &iter : relays_)
+    {
+        auto relay = iter.second;
+
+        // 每个事件循环只投递一次，与该循环上的播放者数量无关
+        relay->Loop()->RunInLoop([relay, packets]() {
+            relay->OnPackets(*packets);
+        });
+    }
+}
+
+void Stream::AddPlayer(const PlayerUserPtr &user)
+{
+    auto loop = user->GetConnection()->Loop();
+
+    // 转发器只在其所属的事件循环中修改。user 持有本流的指针，保证执行时本流仍然有效
+    loop->RunInLoop([this, user, loop]() {
+        std::lock_guard<std::mutex> lk(relay_lock_);
+
+        // 获取或创建该事件循环的转发器
+        auto &relay = relays_[loop];
+        if (!relay)
+        {
+            relay = std::make_shared<StreamRelay>(loop);
+        }
+        relay->AddPlayer(user);
+        user->relay_ = relay;
+    });
+}
+
+void Stream::RemovePlayer(const PlayerUserPtr &user)
+{
+    auto loop = user->GetConnection()->Loop();
+
+    // 转发器只在其所属的事件循环中修改。user 持有本流的指针，保证执行时本流仍然有效
+    loop->RunInLoop([this, user, loop]() {
+        std::lock_guard<std::mutex> lk(relay_lock_);
+
+        auto iter = relays_.find(loop);
+        if (iter != relays_.end())
+        {
+            iter->second->RemovePlayer(user);
+
+            // 该事件循环已经没有播放者，不再向其投递数据包
+            if (iter->second->PlayerSize() == 0)
+            {
+                relays_.erase(iter);
+            }
+        }
+        user->relay_.reset();
+    });
+}
+
 void Stream::GetFrames(const PlayerUserPtr &user)
 {
     // 如果没有媒体
@@ -198,27 +389,25 @@ void Stream::GetFrames(const PlayerUserPtr &user)
         return;
     }
 
-    // 如果用户有元数据、音频头、视频头或输出帧不为空
-    if (user->meta_ || user->audio_header_ || user->video_header_ || !user->out_frames_.empty())
+    // 如果用户有首屏数据、元数据、音频头、视频头或输出帧不为空
+    if (user->first_screen_ || user->meta_ || user->audio_header_ || user->video_header_ ||
+        !user->out_frames_.empty())
     {
         // 直接返回
         return;
     }
 
-    // 创建互斥锁，保护临界区
-    std::lock_guard<std::mutex> lk(lock_);
-
     // 如果用户的输出索引有效
     if (user->out_index_ >= 0)
     {
-        // 计算最小索引
-        int min_idx = frame_index_ - packet_buffer_size_;
+        // 获取缓冲区的淘汰点
+        auto min_idx = packet_buffer_.MinIndex();
 
-        // 获取用户应用的信息中的内容延迟
-        int content_lantency = user->GetAppInfo()->content_latency_;
+        // 获取用户可接受的延迟
+        int content_lantency = ContentLatency(user);
 
         // 如果用户的输出索引小于最小索引，或者当前时间戳与用户输出帧时间戳的差值大于两倍的内容延迟
-        if ((user->out_index_ < min_idx) ||
+        if ((user->out_index_ + 1 < min_idx) ||
             ((gop_mgr_.LastestTimeStamp() - user->out_frame_timestamp_) > 2 * content_lantency))
         {
             LIVE_INFO << " need skip out index : " << user->out_index_ << " , min idx : " << min_idx
@@ -228,6 +417,18 @@ void Stream::GetFrames(const PlayerUserPtr &user)
             // 跳过当前帧
             SkipFrame(user);
         }
+        // 按应用配置的目标延迟压缩时间戳追赶到直播边缘
+        else if (!CheckTargetLatency(user))
+        {
+            // 尚未落后到需要跳帧，按应用配置的策略处理慢速播放者
+            CheckSlowConsumer(user);
+
+            // 慢速状态持续太久，不再发送数据，等待断开连接
+            if (user->slow_close_)
+            {
+                return;
+            }
+        }
     }
     else // 如果用户的输出索引无效
     {
@@ -236,22 +437,56 @@ void Stream::GetFrames(const PlayerUserPtr &user)
         {
             return;
         }
+
+        // 按应用配置限速追赶缓存的数据
+        StartJoinBurst(user);
+
+        // 使用流共享的首屏数据，元数据、编解码头和 GOP 开头的帧一次发送，不再逐个等待发送完成
+        auto first_screen = GetFirstScreen(user->out_index_ + 1);
+        if (first_screen)
+        {
+            user->first_screen_ = first_screen;
+            user->meta_.reset();
+            user->audio_header_.reset();
+            user->video_header_.reset();
+            user->out_index_ = first_screen->LastIndex();
+            user->out_frame_timestamp_ = first_screen->LastTimeStamp();
+            user->burst_bytes_ += first_screen->Bytes();
+
+            // 从最新的关键帧加入时，关键帧到直播边缘的帧压缩时间戳快速追上
+            if (first_screen->CatchupEnd() > 0)
+            {
+                user->StartCatchup(first_screen->GopTimeStamp(), first_screen->CatchupEnd());
+            }
+        }
     }
 
     // 获取下一帧
     GetNextFrame(user);
 }
 
-bool Stream::LocateGop(const PlayerUserPtr &user)
+int Stream::ContentLatency(const PlayerUserPtr &user) const
 {
     // 获取用户应用的信息中的内容延迟
-    int content_lantency = user->GetAppInfo()->content_latency_;
+    int64_t content_latency = user->GetAppInfo()->content_latency_;
+
+    // GOP 比内容延迟还长时，延迟范围内可能没有关键帧，此时放宽到一个平均 GOP 时长，
+    // 让播放者可以立即加入，也避免跳帧条件反复成立却找不到可跳转的 GOP
+    return std::max(content_latency, gop_mgr_.AvgGopDuration());
+}
+
+bool Stream::LocateGop(const PlayerUserPtr &user)
+{
+    // 获取用户可接受的延迟
+    int content_lantency = ContentLatency(user);
 
     // 初始化延迟变量
     int lantency = 0;
 
-    // 根据内容延迟获取 GOP 索引
-    auto idx = gop_mgr_.GetGopByLatency(content_lantency, lantency);
+    // 从直播边缘加入时使用最新的 GOP，否则根据内容延迟获取 GOP 索引
+    auto idx = user->GetAppInfo()->live_edge_join_
+                   ? gop_mgr_.GetLastestGop(lantency)
+                   : gop_mgr_.GetGopByLatency(content_lantency, lantency);
 
     // 如果找到有效的 GOP 索引
     if (idx != -1)
@@ -276,6 +511,9 @@ bool Stream::LocateGop(const PlayerUserPtr &user)
         return false;
     }
 
+    // 取得编解码头信息表的快照，之后的查询无需加锁且彼此一致
+    auto headers = codec_headers_.Headers();
+
     // 检查用户是否仍在等待元数据
     user->wait_meta_ = (user->wait_meta_ && has_meta_);
 
@@ -283,7 +521,7 @@ bool Stream::LocateGop(const PlayerUserPtr &user)
     if (user->wait_meta_)
     {
         // 获取指定索引的元数据
-        auto meta = codec_headers_.Meta(idx);
+        auto meta = headers->Meta(idx);
 
         // 如果找到了元数据
         if (meta)
@@ -304,7 +542,7 @@ bool Stream::LocateGop(const PlayerUserPtr &user)
     if (user->wait_audio_)
     {
         // 获取指定索引的音频头
-        auto audio_header = codec_headers_.AudioHeader(idx);
+        auto audio_header = headers->AudioHeader(idx);
 
         // 如果找到了音频头
         if (audio_header)
@@ -325,7 +563,7 @@ bool Stream::LocateGop(const PlayerUserPtr &user)
     if (user->wait_video_)
     {
         // 获取指定索引的视频头
-        auto video_header = codec_headers_.VideoHeader(idx);
+        auto video_header = headers->VideoHeader(idx);
 
         // 如果找到了视频头
         if (video_header)
@@ -350,7 +588,7 @@ bool Stream::LocateGop(const PlayerUserPtr &user)
         {
             // 记录超时日志
             LIVE_DEBUG << " wait Gop keyframe timeout elapsed : " << elapsed
-                       << " ms, frame index : " << frame_index_
+                       << " ms, frame index : " << packet_buffer_.LastestIndex()
                        << " , gop size : " << gop_mgr_.GopSize() << " . host : " << user->user_id_;
 
             // 设置用户等待超时标志
@@ -372,17 +610,188 @@ bool Stream::LocateGop(const PlayerUserPtr &user)
 
     // 记录成功定位 GOP 的日志
     LIVE_DEBUG << " locate GOP sucess, elapsed : " << elapsed << " ms, gop idx : " << idx
-               << " , frame index : " << frame_index_ << " , lantency : " << lantency
-               << " , user : " << user->user_id_;
+               << " , frame index : " << packet_buffer_.LastestIndex() << " , lantency : " << lantency
+               << " , avg gop duration : " << gop_mgr_.AvgGopDuration()
+               << " , avg gop bytes : " << gop_mgr_.AvgGopBytes() << " , user : " << user->user_id_;
 
     // 返回 true，表示成功
     return true;
 }
 
+FirstScreenPtr Stream::GetFirstScreen(int32_t idx)
+{
+    std::lock_guard<std::mutex> lk(first_screen_lock_);
+    auto &app_info = session_.GetAppInfo();
+    bool live_edge = app_info && app_info->live_edge_join_;
+    auto lastest_timestamp = gop_mgr_.LastestTimeStamp();
+
+    // 同一个 GOP 的首屏数据被截断或没有落后最新帧太多时直接复用，剩下的帧由播放者正常获取。
+    // 从直播边缘加入时追赶的终点不能落后最新帧太多，否则播放者追上后仍有延迟
+    if (first_screen_ && first_screen_->GopIndex() == idx &&
+        (live_edge ? lastest_timestamp - first_screen_->CatchupEnd() <= kFirstScreenMaxLag
+                   : (first_screen_->Truncated() ||
+                      lastest_timestamp - first_screen_->LastTimeStamp() <= kFirstScreenMaxLag)))
+    {
+        return first_screen_;
+    }
+
+    // 加入追赶限速时首屏只包含开头的少量帧，其余的按追赶速率发送
+    auto max_bytes = app_info && app_info->join_burst_rate_ > 0 ? kMinBatchBytes : kMaxBatchBytes;
+
+    // 该 GOP 位置的元数据和编解码头在前
+    std::vector<PacketPtr> packets;
+    auto headers = codec_headers_.Headers();
+    for (auto const &header : {headers->Meta(idx), headers->AudioHeader(idx), headers->VideoHeader(idx)})
+    {
+        if (header)
+        {
+            packets.emplace_back(header);
+        }
+    }
+    size_t header_count = packets.size();
+
+    // 从关键帧开始的帧，字节数不超过上限
+    int64_t bytes = 0;
+    auto max_idx = packet_buffer_.LastestIndex();
+    int64_t i = idx;
+    for (; i <= max_idx && bytes < max_bytes; i++)
+    {
+        auto pkt = packet_buffer_.Get(i);
+        if (!pkt)
+        {
+            break;
+        }
+
+        // 追赶区间内的音频压缩时间戳后无法正常播放，不发送
+        if (live_edge && pkt->IsAudio() && !CodecUtils::IsCodecHeader(pkt) &&
+            (int64_t)pkt->TimeStamp() < lastest_timestamp)
+        {
+            continue;
+        }
+        bytes += pkt->PacketSize();
+        packets.emplace_back(std::move(pkt));
+    }
+
+    // 关键帧已经被淘汰
+    if (packets.size() == header_count)
+    {
+        return nullptr;
+    }
+
+    first_screen_ = std::make_shared<FirstScreen>(idx, std::move(packets), header_count,
+                                                  i <= max_idx, live_edge ? lastest_timestamp : 0);
+    return first_screen_;
+}
+
+void Stream::StartJoinBurst(const PlayerUserPtr &user)
+{
+    auto &app_info = user->GetAppInfo();
+    if (!app_info || app_info->join_burst_rate_ == 0)
+    {
+        return;
+    }
+
+    // 按待追赶的数据估算流的码率：从关键帧到最新帧的字节数和媒体时长
+    auto idx = user->out_index_ + 1;
+    auto keyframe = packet_buffer_.Get(idx);
+    if (!keyframe)
+    {
+        return;
+    }
+    auto duration = gop_mgr_.LastestTimeStamp() - (int64_t)keyframe->TimeStamp();
+
+    // 本来就在直播边缘附近，不需要追赶
+    if (duration <= kJoinBurstEndLag)
+    {
+        return;
+    }
+
+    int64_t bytes = 0;
+    auto max_idx = packet_buffer_.LastestIndex();
+    for (int64_t i = idx; i <= max_idx; i++)
+    {
+        auto pkt = packet_buffer_.Get(i);
+        if (!pkt)
+        {
+            break;
+        }
+        bytes += pkt->PacketSize();
+    }
+
+    user->burst_start_ = TTime::NowMS();
+    user->burst_rate_ = bytes * 1000 / duration * app_info->join_burst_rate_ / 100;
+    user->burst_bytes_ = 0;
+    session_.GetJoinBurstStats().bursts++;
+
+    // 由内核按追赶速率均匀发送，避免一次写入的首屏数据瞬间占满网卡队列
+    if (app_info->join_socket_pacing_)
+    {
+        network::SocketOpt opt(user->GetConnection()->Fd());
+        opt.SetMaxPacingRate((uint32_t)std::min<int64_t>(user->burst_rate_, UINT32_MAX - 1));
+    }
+
+    LIVE_DEBUG << " join burst start, rate : " << user->burst_rate_
+               << " bytes/s , host : " << user->user_id_;
+}
+
+void Stream::EndJoinBurst(const PlayerUserPtr &user)
+{
+    auto elapsed = TTime::NowMS() - user->burst_start_;
+    auto &stats = session_.GetJoinBurstStats();
+
+    // 更新追赶耗时和字节数的统计
+    stats.finished++;
+    stats.total_time += elapsed;
+    stats.bytes += user->burst_bytes_;
+    auto max_time = stats.max_time.load();
+    while (elapsed > max_time && !stats.max_time.compare_exchange_weak(max_time, elapsed))
+    {
+    }
+
+    // 之后按直播速率发送，恢复连接的发送速率
+    if (user->GetAppInfo()->join_socket_pacing_)
+    {
+        network::SocketOpt opt(user->GetConnection()->Fd());
+        opt.SetMaxPacingRate(~0U);
+    }
+
+    LIVE_DEBUG << " join burst end, elapsed : " << elapsed << " ms, bytes : " << user->burst_bytes_
+               << " , host : " << user->user_id_;
+    user->burst_start_ = 0;
+}
+
+void Stream::ScheduleBurstRefill(const PlayerUserPtr &user, int64_t delay)
+{
+    auto loop = EventLoop::Current();
+    if (!loop)
+    {
+        return;
+    }
+
+    if (!user->burst_timer_)
+    {
+        // 定时器不持有播放者，播放者释放后回调不做任何事
+        std::weak_ptr<PlayerUser> weak = user;
+        user->burst_timer_ = std::make_shared<Timer>([weak]() {
+            auto u = weak.lock();
+            if (u)
+            {
+                u->Active();
+            }
+        });
+    }
+
+    // 已经设置时不再重复设置，期间的转发器唤醒也会检查额度
+    if (!user->burst_timer_->Pending())
+    {
+        loop->AddTimer(user->burst_timer_, delay);
+    }
+}
+
 void Stream::SkipFrame(const PlayerUserPtr &user)
 {
-    // 获取用户应用的信息中的内容延迟
-    int content_lantency = user->GetAppInfo()->content_latency_;
+    // 获取用户可接受的延迟
+    int content_lantency = ContentLatency(user);
 
     // 初始化延迟变量
     int lantency = 0;
@@ -390,6 +799,12 @@ void Stream::SkipFrame(const PlayerUserPtr &user)
     // 根据内容延迟获取 GOP 索引
     auto idx = gop_mgr_.GetGopByLatency(content_lantency, lantency);
 
+    // 跳转到找到的 GOP
+    SkipToGop(user, idx, lantency);
+}
+
+void Stream::SkipToGop(const PlayerUserPtr &user, int idx, int lantency)
+{
     // 如果未找到有效的 GOP 索引或索引小于等于用户的输出索引
     if (idx == -1 || idx <= user->out_index_)
     {
@@ -397,8 +812,11 @@ void Stream::SkipFrame(const PlayerUserPtr &user)
         return;
     }
 
+    // 取得编解码头信息表的快照，之后的查询无需加锁且彼此一致
+    auto headers = codec_headers_.Headers();
+
     // 获取指定索引的元数据
-    auto meta = codec_headers_.Meta(idx);
+    auto meta = headers->Meta(idx);
 
     // 如果找到了元数据
     if (meta)
@@ -415,7 +833,7 @@ void Stream::SkipFrame(const PlayerUserPtr &user)
     }
 
     // 获取指定索引的音频头
-    auto audio_header = codec_headers_.AudioHeader(idx);
+    auto audio_header = headers->AudioHeader(idx);
 
     // 如果找到了音频头
     if (audio_header)
@@ -432,7 +850,7 @@ void Stream::SkipFrame(const PlayerUserPtr &user)
     }
 
     // 获取指定索引的视频头
-    auto video_header = codec_headers_.VideoHeader(idx);
+    auto video_header = headers->VideoHeader(idx);
 
     // 如果找到了视频头
     if (video_header)
@@ -450,23 +868,200 @@ void Stream::SkipFrame(const PlayerUserPtr &user)
 
     // 记录跳过帧的日志
     LIVE_DEBUG << " skip frame " << user->out_index_ << " -> " << idx
-               << " , lantency : " << lantency << " , frame_index : " << frame_index_
+               << " , lantency : " << lantency << " , frame_index : " << packet_buffer_.LastestIndex()
                << " , host : " << user->user_id_;
 
+    // 调整用户的输出时间戳偏移，使跳转目标的关键帧紧接上一输出帧，播放端看到的时间戳保持连续。
+    // 之前的追赶区间并入偏移后清除
+    auto keyframe = packet_buffer_.Get(idx);
+    if (keyframe)
+    {
+        user->out_ts_offset_ = user->OutTimeStamp(user->out_frame_timestamp_) + kSkipFrameDelta -
+                               (int64_t)keyframe->TimeStamp();
+        user->catchup_base_ = 0;
+        user->catchup_end_ = 0;
+    }
+
     // 更新用户的输出索引为当前索引减一
     user->out_index_ = idx - 1;
 }
 
+bool Stream::CheckTargetLatency(const PlayerUserPtr &user)
+{
+    auto target = (int64_t)user->GetAppInfo()->target_latency_;
+    auto lastest_timestamp = gop_mgr_.LastestTimeStamp();
+
+    // 未启用，正在追赶，或者没有超出目标延迟
+    if (target == 0 || user->out_frame_timestamp_ < user->catchup_end_ ||
+        lastest_timestamp - user->out_frame_timestamp_ <= target)
+    {
+        return false;
+    }
+
+    // 有更新的 GOP 时先跳到最新的关键帧，否则从当前位置开始追赶
+    int lantency = 0;
+    auto idx = gop_mgr_.GetLastestGop(lantency);
+    auto keyframe = idx > user->out_index_ + 1 ? packet_buffer_.Get(idx) : nullptr;
+    int64_t base = user->out_frame_timestamp_;
+    if (keyframe)
+    {
+        SkipToGop(user, idx, lantency);
+        base = keyframe->TimeStamp();
+    }
+
+    LIVE_DEBUG << " catch up to live edge, lag : " << lastest_timestamp - user->out_frame_timestamp_
+               << " ms, from : " << base << " , to : " << lastest_timestamp
+               << " , host : " << user->user_id_;
+    user->StartCatchup(base, lastest_timestamp);
+    return true;
+}
+
+void Stream::CheckSlowConsumer(const PlayerUserPtr &user)
+{
+    auto &app_info = user->GetAppInfo();
+    auto &stats = session_.GetSlowConsumerStats();
+
+    // 计算用户落后直播边缘的时长。加入时本就允许落后一个内容延迟，超出部分才计入慢速
+    auto lag = gop_mgr_.LastestTimeStamp() - (int64_t)user->out_frame_timestamp_;
+    auto max_lag = ContentLatency(user) + (int64_t)app_info->slow_lag_;
+
+    // 没有超出落后时长，退出慢速状态
+    if (lag <= max_lag)
+    {
+        if (user->slow_since_ > 0)
+        {
+            LIVE_DEBUG << " slow consumer recovered, slow time : "
+                       << TTime::NowMS() - user->slow_since_ << " ms, host : " << user->user_id_;
+            user->slow_since_ = 0;
+        }
+        return;
+    }
+
+    auto now = TTime::NowMS();
+
+    // 进入慢速状态
+    if (user->slow_since_ == 0)
+    {
+        user->slow_since_ = now;
+        stats.slow_players++;
+        LIVE_INFO << " slow consumer, lag : " << lag << " ms, policy : " << app_info->slow_policy_
+                  << " , host : " << user->user_id_;
+    }
+
+    // 仅音频模式：开始丢弃视频帧，恢复后从下一个关键帧开始发送视频
+    if (app_info->slow_policy_ == kSlowPolicyAudioOnly)
+    {
+        user->drop_video_ = true;
+    }
+    // 跳到下一个 GOP
+    else if (app_info->slow_policy_ == kSlowPolicySkipGop)
+    {
+        int lantency = 0;
+        auto idx = gop_mgr_.GetNextGop(user->out_index_, lantency);
+        if (idx != -1 && idx > user->out_index_ + 1)
+        {
+            stats.gop_skips++;
+            SkipToGop(user, idx, lantency);
+        }
+    }
+
+    // 慢速状态持续超过配置的时长，断开连接，每个播放者只统计和记录一次
+    if (!user->slow_close_ && app_info->slow_disconnect_time_ > 0 &&
+        now - user->slow_since_ > (int64_t)app_info->slow_disconnect_time_)
+    {
+        stats.disconnects++;
+        user->slow_close_ = true;
+        LIVE_INFO << " slow consumer disconnect, slow time : " << now - user->slow_since_
+                  << " ms, host : " << user->user_id_;
+    }
+}
+
+bool Stream::DropFrame(const PlayerUserPtr &user, const PacketPtr &packet)
+{
+    // 编解码头始终发送
+    if (CodecUtils::IsCodecHeader(packet))
+    {
+        return false;
+    }
+
+    // 压缩时间戳追赶区间内的音频无法正常播放，不发送
+    if (packet->IsAudio())
+    {
+        return (int64_t)packet->TimeStamp() < user->catchup_end_;
+    }
+
+    // 其余只处理视频帧
+    if (!packet->IsVideo())
+    {
+        return false;
+    }
+
+    auto &stats = session_.GetSlowConsumerStats();
+
+    // 仅音频模式
+    if (user->drop_video_)
+    {
+        // 已经恢复并且遇到关键帧，从该帧开始恢复发送视频
+        if (user->slow_since_ == 0 && packet->IsKeyFrame())
+        {
+            user->drop_video_ = false;
+            return false;
+        }
+        stats.dropped_video++;
+        return true;
+    }
+
+    // 慢速状态下丢弃非参考视频帧
+    if (user->slow_since_ > 0 && user->GetAppInfo()->slow_policy_ == kSlowPolicyDropNonRef &&
+        CodecUtils::IsNonReferenceFrame(packet))
+    {
+        stats.dropped_nonref++;
+        return true;
+    }
+    return false;
+}
+
 void Stream::GetNextFrame(const PlayerUserPtr &user)
 {
     // 从用户的输出索引加一开始
     auto idx = user->out_index_ + 1;
 
     // 获取当前最大帧索引
-    auto max_idx = frame_index_.load();
+    auto max_idx = packet_buffer_.LastestIndex();
+
+    // 字节预算：按连接发送速率估算一段时间内能发送的字节数
+    auto byte_budget = std::min(std::max((int64_t)user->send_rate_ * kBatchDrainTime, kMinBatchBytes),
+                                kMaxBatchBytes);
+
+    // 加入追赶期间，字节预算不超过按追赶速率累计的额度，额度用完时等额度恢复再获取
+    if (user->burst_start_ > 0)
+    {
+        auto allowed = kMinBatchBytes +
+                       user->burst_rate_ * (TTime::NowMS() - user->burst_start_) / 1000 -
+                       user->burst_bytes_;
+        if (allowed <= 0)
+        {
+            // 还有待获取的帧时，在额度恢复到一批的最小字节数时重新获取
+            if (idx <= max_idx && user->burst_rate_ > 0)
+            {
+                auto refill = (kMinBatchBytes - allowed) * 1000 / user->burst_rate_ + 1;
+                ScheduleBurstRefill(user, refill);
+            }
+            return;
+        }
+        byte_budget = std::min(byte_budget, allowed);
+    }
+
+    // 媒体时长预算：用户落后越多，一批内允许的媒体时长越长
+    auto time_budget =
+        std::max(gop_mgr_.LastestTimeStamp() - (int64_t)user->out_frame_timestamp_, kMinBatchTime);
 
-    // 最多获取 10 帧
-    for (int i = 0; i < 10; i++)
+    // 本批已获取的字节数和第一帧的时间戳
+    int64_t bytes = 0;
+    int64_t start_timestamp = -1;
+
+    // 在预算内获取帧
+    for (int i = 0; i < kMaxBatchPackets; i++)
     {
         // 如果索引超出最大帧索引
         if (idx > max_idx)
@@ -475,28 +1070,65 @@ void Stream::GetNextFrame(const PlayerUserPtr &user)
             break;
         }
 
-        // 获取对应索引的数据包
-        auto &pkt = packet_buffer_[idx % packet_buffer_size_];
+        // 优先从本循环转发器的缓存中读取，不在缓存中时再无锁读取环形缓冲区
+        PacketPtr pkt;
+        if (user->relay_)
+        {
+            pkt = user->relay_->GetPacket(idx);
+        }
+        if (!pkt)
+        {
+            pkt = packet_buffer_.Get(idx);
+        }
 
-        // 如果数据包存在
-        if (pkt)
+        // 如果数据包不存在
+        if (!pkt)
         {
-            // 将数据包添加到用户的输出帧列表
-            user->out_frames_.emplace_back(pkt);
+            // 结束循环
+            break;
+        }
+
+        // 更新用户的输出索引为当前数据包的索引
+        user->out_index_ = pkt->Index();
 
-            // 更新用户的输出索引为当前数据包的索引
-            user->out_index_ = pkt->Index();
+        // 更新用户的输出帧时间戳为当前数据包的时间戳
+        user->out_frame_timestamp_ = pkt->TimeStamp();
 
-            // 更新用户的输出帧时间戳为当前数据包的时间戳
-            user->out_frame_timestamp_ = pkt->TimeStamp();
+        // 更新索引为当前数据包的索引加一，以便获取下一帧
+        idx = pkt->Index() + 1;
 
-            // 更新索引为当前数据包的索引加一，以便获取下一帧
-            idx = pkt->Index() + 1;
+        // 按慢速播放者策略丢弃的帧不发送，也不计入预算
+        if (DropFrame(user, pkt))
+        {
+            continue;
         }
-        else // 如果数据包不存在
+
+        // 将数据包添加到用户的输出帧列表
+        user->out_frames_.emplace_back(pkt);
+
+        // 累计字节数，记录第一帧的时间戳
+        bytes += pkt->PacketSize();
+        if (start_timestamp < 0)
+        {
+            start_timestamp = pkt->TimeStamp();
+        }
+
+        // 超出字节预算或媒体时长预算时结束本批
+        if (bytes >= byte_budget || (int64_t)pkt->TimeStamp() - start_timestamp >= time_budget)
         {
-            // 结束循环
             break;
         }
     }
-}
\ No newline at end of file
+
+    // 追上直播边缘，或者追赶时间已经超过两倍内容延迟（码率估算有误时），结束加入追赶
+    if (user->burst_start_ > 0)
+    {
+        user->burst_bytes_ += bytes;
+        auto lag = gop_mgr_.LastestTimeStamp() - (int64_t)user->out_frame_timestamp_;
+        if (lag <= kJoinBurstEndLag ||
+            TTime::NowMS() - user->burst_start_ > 2 * (int64_t)ContentLatency(user))
+        {
+            EndJoinBurst(user);
+        }
+    }
+}
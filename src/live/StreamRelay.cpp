@@ -0,0 +1,73 @@
+#include "StreamRelay.h"
+
+using namespace tmms::live;
+
+StreamRelay::StreamRelay(EventLoop *loop) : loop_(loop)
+{
+}
+
+EventLoop *StreamRelay::Loop() const
+{
+    // 返回转发器所属的事件循环
+    return loop_;
+}
+
+void StreamRelay::AddPlayer(const PlayerUserPtr &user)
+{
+    // 将播放者加入本循环的播放者集合
+    players_.insert(user);
+}
+
+void StreamRelay::RemovePlayer(const PlayerUserPtr &user)
+{
+    // 从本循环的播放者集合中移除
+    players_.erase(user);
+}
+
+size_t StreamRelay::PlayerSize() const
+{
+    // 返回本循环的播放者数量
+    return players_.size();
+}
+
+void StreamRelay::OnPackets(const std::vector<PacketPtr> &packets)
+{
+    for (auto const &packet : packets)
+    {
+        // 帧索引不连续时（例如转发器刚创建），丢弃旧的缓存重新开始
+        if (first_index_ < 0 || packet->Index() != first_index_ + (int64_t)packets_.size())
+        {
+            packets_.clear();
+            first_index_ = packet->Index();
+        }
+        packets_.emplace_back(packet);
+    }
+
+    // 超出缓存上限时丢弃最旧的数据包
+    while (packets_.size() > kMaxRelayPackets)
+    {
+        packets_.pop_front();
+        first_index_++;
+    }
+
+    // 唤醒本循环的播放者。播放者在发送过程中可能关闭并从集合中移除，所以先复制一份
+    active_players_.assign(players_.begin(), players_.end());
+    for (auto const &user : active_players_)
+    {
+        user->Active();
+    }
+    active_players_.clear();
+}
+
+PacketPtr StreamRelay::GetPacket(int64_t index) const
+{
+    // 索引不在本地缓存范围内
+    if (first_index_ < 0 || index < first_index_ ||
+        index >= first_index_ + (int64_t)packets_.size())
+    {
+        return PacketPtr();
+    }
+
+    // 返回本地缓存的数据包
+    return packets_[index - first_index_];
+}
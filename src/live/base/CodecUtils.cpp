@@ -1,4 +1,5 @@
 #include "CodecUtils.h"
+#include "mmedia/base/BytesReader.h"
 
 using namespace tmms::live;
 
@@ -34,4 +35,57 @@ bool CodecUtils::IsKeyFrame(const PacketPtr &packet)
     }
     // 包大小为0，返回 false
     return false;
-}
\ No newline at end of file
+}
+
+bool CodecUtils::IsNonReferenceFrame(const PacketPtr &packet)
+{
+    // 不是视频或数据不完整
+    if (!packet->IsVideo() || packet->PacketSize() < 5)
+    {
+        return false;
+    }
+
+    const char *data = packet->Data();
+    int32_t size = packet->PacketSize();
+
+    // FLV 帧类型为 3，表示可丢弃的帧间帧
+    if (((data[0] >> 4) & 0x0f) == 3)
+    {
+        return true;
+    }
+
+    // 只解析 AVC 的 NALU 数据
+    if ((data[0] & 0x0f) != 7 || data[1] != 1)
+    {
+        return false;
+    }
+
+    // 跳过 FLV 视频标签头和合成时间，遍历长度前缀的 NALU
+    int32_t pos = 5;
+    bool has_slice = false;
+    while (pos + 4 < size)
+    {
+        int32_t len = BytesReader::ReadUint32T(data + pos);
+        pos += 4;
+        if (len <= 0 || len > size - pos)
+        {
+            break;
+        }
+
+        // 片数据（类型 1 到 5）的 nal_ref_idc 不为 0 时，该帧会被其他帧参考
+        uint8_t nal = data[pos];
+        int32_t type = nal & 0x1f;
+        if (type >= 1 && type <= 5)
+        {
+            if (nal & 0x60)
+            {
+                return false;
+            }
+            has_slice = true;
+        }
+        pos += len;
+    }
+
+    // 所有片都不被参考
+    return has_slice;
+}
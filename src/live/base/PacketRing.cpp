@@ -0,0 +1,106 @@
+#include "PacketRing.h"
+#include <thread>
+
+using namespace tmms::live;
+
+PacketRing::PacketRing(uint32_t capacity)
+    : capacity_(capacity > 0 ? capacity : 1), slots_(new Slot[capacity_])
+{
+}
+
+void PacketRing::Reset(uint32_t capacity)
+{
+    // 重新分配槽位数组，只在尚无读写时调用
+    capacity_ = capacity > 0 ? capacity : 1;
+    slots_.reset(new Slot[capacity_]);
+    lastest_index_.store(-1, std::memory_order_release);
+    min_index_.store(0, std::memory_order_release);
+}
+
+void PacketRing::Invalidate(Slot &slot)
+{
+    // 先作废槽位序列号，之后到来的读者都会校验失败而不会再访问槽位
+    slot.seq.store(-1, std::memory_order_seq_cst);
+
+    // 等待已经通过校验的读者完成复制，读者只做一次引用计数递增，等待时间很短
+    while (slot.readers.load(std::memory_order_seq_cst) != 0)
+    {
+        std::this_thread::yield();
+    }
+}
+
+void PacketRing::Push(PacketPtr &&packet)
+{
+    int64_t index = packet->Index();
+    Slot &slot = slots_[index % capacity_];
+
+    // 缓冲区已满，最旧的数据包将被覆盖，先前移最小索引
+    if (index - min_index_.load(std::memory_order_relaxed) >= capacity_)
+    {
+        min_index_.store(index - capacity_ + 1, std::memory_order_release);
+    }
+
+    Invalidate(slot);
+
+    // 覆盖槽位，旧的数据包在没有其他引用时随之释放
+    slot.packet = std::move(packet);
+
+    // 发布新的序列号和最新索引
+    slot.seq.store(index, std::memory_order_release);
+    lastest_index_.store(index, std::memory_order_release);
+}
+
+void PacketRing::PopFront()
+{
+    auto index = min_index_.load(std::memory_order_relaxed);
+
+    // 缓冲区为空
+    if (index > lastest_index_.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    // 先前移最小索引，再作废并释放槽位
+    min_index_.store(index + 1, std::memory_order_release);
+    Slot &slot = slots_[index % capacity_];
+    Invalidate(slot);
+    slot.packet.reset();
+}
+
+const PacketPtr &PacketRing::Front() const
+{
+    static const PacketPtr kNullPacket;
+    auto index = min_index_.load(std::memory_order_relaxed);
+
+    // 缓冲区为空
+    if (index > lastest_index_.load(std::memory_order_relaxed))
+    {
+        return kNullPacket;
+    }
+
+    // 只有写者修改槽位，写者读取时无需同步
+    return slots_[index % capacity_].packet;
+}
+
+PacketPtr PacketRing::Get(int64_t index) const
+{
+    // 索引超出有效范围
+    if (index < min_index_.load(std::memory_order_acquire) ||
+        index > lastest_index_.load(std::memory_order_acquire))
+    {
+        return PacketPtr();
+    }
+
+    const Slot &slot = slots_[index % capacity_];
+    PacketPtr packet;
+
+    // 登记读者后再校验序列号，与写者的“作废序列号-检查读者数”配对
+    slot.readers.fetch_add(1, std::memory_order_seq_cst);
+    if (slot.seq.load(std::memory_order_seq_cst) == index)
+    {
+        packet = slot.packet;
+    }
+    slot.readers.fetch_sub(1, std::memory_order_release);
+
+    return packet;
+}
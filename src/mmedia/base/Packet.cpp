@@ -1,23 +1,124 @@
 #include "Packet.h"
+#include "PacketPool.h"
+#include <cstddef>
 
 using namespace tmms::mm;
 
+namespace
+{
+    /**
+     * @brief 供 std::allocate_shared 使用的分配器
+     *
+     * 分配控制块（其中包含 Packet 对象）时，在同一个内存块的末尾额外留出数据区，
+     * 并通过 data 返回数据区地址。内存块来自 PacketPool，释放时归还内存池。
+     */
+    template <typename T> struct PacketAllocator
+    {
+        using value_type = T;
+
+        PacketAllocator(PacketPool *pool, size_t extra, char **data)
+            : pool(pool), extra(extra), data(data)
+        {
+        }
+
+        template <typename U>
+        PacketAllocator(const PacketAllocator<U> &other)
+            : pool(other.pool), extra(other.extra), data(other.data)
+        {
+        }
+
+        T *allocate(size_t n)
+        {
+            // 数据区紧跟在控制块之后
+            char *block = (char *)pool->Allocate(n * sizeof(T) + extra);
+            *data = block + n * sizeof(T);
+            return (T *)block;
+        }
+
+        void deallocate(T *p, size_t)
+        {
+            // 可能在其他线程释放，由内存池归还给所属线程
+            PacketPool::Free(p);
+        }
+
+        template <typename U> bool operator==(const PacketAllocator<U> &other) const
+        {
+            return pool == other.pool;
+        }
+
+        template <typename U> bool operator!=(const PacketAllocator<U> &other) const
+        {
+            return pool != other.pool;
+        }
+
+        PacketPool *pool{nullptr}; ///< 分配内存块的内存池
+        size_t extra{0};           ///< 数据区大小
+        char **data{nullptr};      ///< 返回数据区地址
+    };
+} // namespace
+
 PacketPtr Packet::NewPacket(int32_t size)
 {
-    auto block_size = size + sizeof(Packet);
-    
-    // 分配内存并初始化
-    Packet *packet = (Packet *)new char[block_size];
-    memset((void *)packet, 0x00, block_size);
-    
-    // 设置包的基本属性
-    packet->index_ = -1;
-    packet->type_ = kPacketTypeUnknowed;
-    packet->capacity_ = size;
-    packet->ext_.reset();
-    
-    // 返回带自定义删除器的智能指针
-    return PacketPtr(packet, [](Packet *p) {
-        delete[] (char *)p;
-    });
+    char *data = nullptr;
+
+    // 数据包、控制块和数据区一次从内存池分配，构造函数只初始化包头
+    PacketPtr packet = std::allocate_shared<Packet>(
+        PacketAllocator<Packet>(PacketPool::ThisPool(), size, &data), size);
+    packet->data_ = data;
+    return packet;
+}
+
+const PacketCache *Packet::FindCache(uint64_t key) const
+{
+    // 缓存节点只会在链表头插入，遍历时不需要加锁
+    PacketCache *cache = cache_.load(std::memory_order_acquire);
+    while (cache)
+    {
+        if (cache->key == key)
+        {
+            return cache;
+        }
+        cache = cache->next;
+    }
+    return nullptr;
+}
+
+const PacketCache *Packet::AddCache(PacketCache *cache)
+{
+    PacketCache *head = cache_.load(std::memory_order_acquire);
+    while (true)
+    {
+        // 其他线程可能已经生成了相同键的缓存，直接使用已有的
+        for (PacketCache *c = head; c; c = c->next)
+        {
+            if (c->key == cache->key)
+            {
+                delete cache;
+                return c;
+            }
+        }
+
+        // 插入到链表头，失败时 head 会被更新为最新的链表头，重新检查
+        cache->next = head;
+        if (cache_.compare_exchange_weak(head, cache, std::memory_order_acq_rel,
+                                         std::memory_order_acquire))
+        {
+            return cache;
+        }
+    }
+}
+
+Packet::~Packet()
+{
+    // 缓存链表头通过 CAS 并发更新，必须按原子类型的要求对齐
+    static_assert(offsetof(Packet, cache_) % alignof(std::atomic<PacketCache *>) == 0,
+                  "Packet::cache_ must be naturally aligned");
+
+    PacketCache *cache = cache_.load(std::memory_order_acquire);
+    while (cache)
+    {
+        PacketCache *next = cache->next;
+        delete cache;
+        cache = next;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,156 @@
+#include "PacketPool.h"
+#include <new>
+
+using namespace tmms::mm;
+
+namespace
+{
+    // 本线程的内存池，只在分配时创建，只释放内存的线程保持为空
+    thread_local PacketPool *t_pool = nullptr;
+} // namespace
+
+std::mutex PacketPool::pools_lock_;
+std::vector<PacketPool *> PacketPool::pools_;
+
+PacketPool *PacketPool::ThisPool()
+{
+    // 每个线程一个内存池，线程退出后也不销毁，其他线程仍可能向它归还内存块
+    if (!t_pool)
+    {
+        t_pool = new PacketPool();
+        std::lock_guard<std::mutex> lk(pools_lock_);
+        pools_.push_back(t_pool);
+    }
+    return t_pool;
+}
+
+void *PacketPool::Allocate(size_t size)
+{
+    allocs_.fetch_add(1, std::memory_order_relaxed);
+
+    // 计算尺寸级别：包含头部的总大小向上取整到 2 的幂
+    size_t total = size + sizeof(BlockHeader);
+    int32_t size_class = 0;
+    while (size_class < kSizeClasses && ((size_t)1 << (size_class + kMinClassShift)) < total)
+    {
+        size_class++;
+    }
+
+    // 超出最大级别的大块直接分配，不经过内存池
+    if (size_class >= kSizeClasses)
+    {
+        large_allocs_.fetch_add(1, std::memory_order_relaxed);
+        BlockHeader *block = new (::operator new(total)) BlockHeader();
+        return block + 1;
+    }
+
+    // 本级空闲链表为空时，先取回其他线程归还的内存块
+    if (!free_lists_[size_class] && remote_frees_.load(std::memory_order_relaxed))
+    {
+        DrainRemoteFrees();
+    }
+
+    // 优先复用空闲链表中的内存块
+    BlockHeader *block = free_lists_[size_class];
+    if (block)
+    {
+        free_lists_[size_class] = block->next;
+        free_counts_[size_class]--;
+        cached_bytes_.fetch_sub((int64_t)1 << (size_class + kMinClassShift),
+                                std::memory_order_relaxed);
+        pool_hits_.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        // 新分配一个本级大小的内存块
+        block = new (::operator new((size_t)1 << (size_class + kMinClassShift))) BlockHeader();
+        block->owner = this;
+        block->size_class = size_class;
+        pool_misses_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    block->next = nullptr;
+    return block + 1;
+}
+
+void PacketPool::Free(void *ptr)
+{
+    BlockHeader *block = (BlockHeader *)ptr - 1;
+    PacketPool *owner = block->owner;
+
+    // 大块直接释放
+    if (!owner)
+    {
+        ::operator delete(block);
+        return;
+    }
+
+    owner->frees_.fetch_add(1, std::memory_order_relaxed);
+
+    // 在所属线程释放时直接放回空闲链表。不能调用 ThisPool，否则只释放数据包的线程
+    // 也会创建一个不会销毁的内存池
+    if (owner == t_pool)
+    {
+        owner->PushFree(block);
+        return;
+    }
+
+    // 在其他线程释放时压入所属内存池的归还栈
+    owner->remote_frees_count_.fetch_add(1, std::memory_order_relaxed);
+    BlockHeader *head = owner->remote_frees_.load(std::memory_order_relaxed);
+    do
+    {
+        block->next = head;
+    } while (!owner->remote_frees_.compare_exchange_weak(head, block, std::memory_order_release,
+                                                         std::memory_order_relaxed));
+}
+
+void PacketPool::DrainRemoteFrees()
+{
+    // 一次取走整个归还栈
+    BlockHeader *block = remote_frees_.exchange(nullptr, std::memory_order_acquire);
+    while (block)
+    {
+        BlockHeader *next = block->next;
+        PushFree(block);
+        block = next;
+    }
+}
+
+void PacketPool::PushFree(BlockHeader *block)
+{
+    auto size_class = block->size_class;
+    size_t block_size = (size_t)1 << (size_class + kMinClassShift);
+
+    // 本级缓存已满，直接释放
+    if ((free_counts_[size_class] + 1) * block_size > kMaxCachedBytes && free_counts_[size_class] > 0)
+    {
+        ::operator delete(block);
+        return;
+    }
+
+    // 放入本级空闲链表
+    block->next = free_lists_[size_class];
+    free_lists_[size_class] = block;
+    free_counts_[size_class]++;
+    cached_bytes_.fetch_add(block_size, std::memory_order_relaxed);
+}
+
+PacketPoolStats PacketPool::Stats()
+{
+    PacketPoolStats stats;
+    std::lock_guard<std::mutex> lk(pools_lock_);
+
+    // 汇总所有线程内存池的计数器
+    for (auto pool : pools_)
+    {
+        stats.allocs += pool->allocs_.load(std::memory_order_relaxed);
+        stats.pool_hits += pool->pool_hits_.load(std::memory_order_relaxed);
+        stats.pool_misses += pool->pool_misses_.load(std::memory_order_relaxed);
+        stats.large_allocs += pool->large_allocs_.load(std::memory_order_relaxed);
+        stats.frees += pool->frees_.load(std::memory_order_relaxed);
+        stats.remote_frees += pool->remote_frees_count_.load(std::memory_order_relaxed);
+        stats.cached_bytes += pool->cached_bytes_.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
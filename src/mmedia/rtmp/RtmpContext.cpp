@@ -1,12 +1,38 @@
 #include "RtmpContext.h"
 #include "base/StringUtils.h"
+#include "base/TTime.h"
 #include "mmedia/base/BytesReader.h"
 #include "mmedia/base/BytesWriter.h"
 #include "mmedia/base/MMediaLog.h"
 #include "mmedia/rtmp/amf/AMFObject.h"
+#include "network/base/SocketOpt.h"
+#include <algorithm>
 
 using namespace tmms::mm;
 
+namespace
+{
+    // 写入块的基本头部，返回写入的字节数
+    int32_t WriteBasicHeader(char *p, int fmt, uint32_t cs_id)
+    {
+        if (cs_id < 64)
+        {
+            p[0] = (char)((fmt << 6) | cs_id);
+            return 1;
+        }
+        if (cs_id < (64 + 256))
+        {
+            p[0] = (char)((fmt << 6) | 0);
+            p[1] = (char)(cs_id - 64);
+            return 2;
+        }
+        p[0] = (char)((fmt << 6) | 1);
+        p[1] = (char)((cs_id - 64) & 0xFF);
+        p[2] = (char)((cs_id - 64) >> 8);
+        return 3;
+    }
+} // namespace
+
 RtmpContext::RtmpContext(const TcpConnectionPtr &conn, RtmpHandler *handler, bool client)
     : handshake_(conn, client) // 初始化 handshake_ 对象，传入 TCP 连接和客户端标识
       ,
@@ -30,9 +56,6 @@ RtmpContext::RtmpContext(const TcpConnectionPtr &conn, RtmpHandler *handler, boo
     commands_["play"] = std::bind(&RtmpContext::HandlePlay, this, std::placeholders::_1);
     // 绑定 "publish" 命令到 HandlePublish 函数
     commands_["publish"] = std::bind(&RtmpContext::HandlePublish, this, std::placeholders::_1);
-
-    // 初始化 out_current_ 指针，使其指向 out_buffer_ 的起始位置
-    out_current_ = out_buffer_;
 }
 
 int32_t RtmpContext::Parse(MsgBuffer &buff)
@@ -126,36 +149,47 @@ void RtmpContext::StartHandShake()
 
 int32_t RtmpContext::ParseMessage(MsgBuffer &buff)
 {
-    // 消息格式（FMT）
-    uint8_t fmt;
-    // 消息 CSID、长度、流 ID
-    uint32_t csid, msg_len = 0, msg_sid = 0;
-    // 消息类型
-    uint8_t msg_type = 0;
-    // 缓冲区内可读字节数
-    uint32_t total_bytes = buff.ReadableBytes();
-    // 已解析的字节数
-    int32_t parsed = 0;
-
-    // 获取当前缓冲区指针
-    in_bytes_ += (buff.ReadableBytes() - last_left_);
-
-    // 计算缓冲区内可读字节数
+    // 上次读取时直接写入数据包的字节数
+    size_t direct = buff.TakeReadTargetBytes();
+
+    // 累计接收的字节数，包括直接写入数据包、没有经过缓冲区的部分
+    in_bytes_ += (buff.ReadableBytes() - last_left_) + direct;
+
+    // 接收的字节数达到确认窗口时发送确认
     SendBytesRecv();
 
-    // 当缓冲区内有足够的数据时进行解析
-    while (total_bytes > 1)
+    // 直接写入数据包的数据都属于当前还没有收完的块
+    if (direct > 0)
+    {
+        OnChunkBody(direct);
+    }
+
+    // 当缓冲区内有数据时进行解析
+    while (buff.ReadableBytes() > 0)
     {
+        // 当前块的数据还没有收完，有多少先复制多少，不需要等整个块到齐再重新解析块头
+        if (in_chunk_left_ > 0)
+        {
+            PacketPtr &packet = InChunkStream(in_csid_).packet;
+            size_t bytes = std::min<size_t>(in_chunk_left_, buff.ReadableBytes());
+            memcpy(packet->Data() + packet->PacketSize(), buff.Peek(), bytes);
+            buff.Retrieve(bytes);
+            OnChunkBody(bytes);
+            continue;
+        }
+
         // 获取当前缓冲区指针
         const char *pos = buff.Peek();
-
-        parsed = 0;
+        // 缓冲区内可读字节数
+        uint32_t total_bytes = buff.ReadableBytes();
+        // 已解析的字节数
+        int32_t parsed = 0;
 
         // 解析基本头部（Basic Header）
         // 获取 FMT（格式信息），占 2 位
-        fmt = (*pos >> 6) & 0x03;
+        uint8_t fmt = (*pos >> 6) & 0x03;
         // 获取 CSID（流 ID），占 6 位
-        csid = *pos & 0x3F;
+        uint32_t csid = *pos & 0x3F;
         parsed++;
 
         // 如果 CSID 为 0，需要额外读取 1 个字节
@@ -192,37 +226,52 @@ int32_t RtmpContext::ParseMessage(MsgBuffer &buff)
             parsed++;
         }
 
-        // 计算剩余数据大小
-        int size = total_bytes - parsed;
+        // 根据不同的 FMT 值，计算消息头部的长度
+        int32_t header_len = 0;
+        if (fmt == kRtmpFmt0)
+        {
+            header_len = 11;
+        }
+        else if (fmt == kRtmpFmt1)
+        {
+            header_len = 7;
+        }
+        else if (fmt == kRtmpFmt2)
+        {
+            header_len = 3;
+        }
 
-        // 根据不同的 FMT 值，检查剩余数据是否足够解析
-        if (size == 0 || (fmt == 0 && size < 11) || (fmt == 1 && size < 7) ||
-            (fmt == 2 && size < 3))
+        // 检查剩余数据是否足够解析消息头部
+        if ((int32_t)total_bytes - parsed < header_len)
         {
             // 数据不足，返回 1 表示需要更多数据
             return 1;
         }
 
-        // 初始化消息长度
-        msg_len = 0;
-        // 初始化流 ID
-        msg_sid = 0;
-        // 初始化消息类型
-        msg_type = 0;
-        // 定义新的时间戳
+        // 获取该块流的解析状态
+        RtmpChunkStream &stream = InChunkStream(csid);
+        // 上一个块的消息头部
+        RtmpMsgHeader *prev = &stream.header;
+
+        // 读取 24 位的时间戳（或时间戳增量）
         int32_t ts = 0;
+        if (fmt != kRtmpFmt3)
+        {
+            ts = BytesReader::ReadUint24T(pos + parsed);
+        }
 
-        // 获取上一次的消息头部，使用 CSID 作为键
-        RtmpMsgHeaderPtr &prev = in_message_headers_[csid];
+        // 检查是否使用扩展时间戳，FMT3 使用之前保存的扩展时间戳标志
+        bool ext = fmt == kRtmpFmt3 ? stream.ext : (ts == 0xFFFFFF);
 
-        if (!prev)
+        // 检查是否有足够的字节用于读取扩展时间戳，消息头部完整之前不修改任何状态
+        if (ext && (int32_t)total_bytes - parsed - header_len < 4)
         {
-            // 如果之前没有消息头部，创建一个新的
-            prev = std::make_shared<RtmpMsgHeader>();
+            // 数据不足，返回 1 表示需要更多数据
+            return 1;
         }
 
         // 获取当前消息的长度
-        msg_len = prev->msg_len;
+        uint32_t msg_len = prev->msg_len;
 
         // 根据 fmt 值判断消息格式
         if (fmt == kRtmpFmt0 || fmt == kRtmpFmt1)
@@ -236,48 +285,35 @@ int32_t RtmpContext::ParseMessage(MsgBuffer &buff)
             msg_len = in_chunk_size_;
         }
 
-        // 从 in_packets_ 中获取对应 csid 的数据包
-        PacketPtr &packet = in_packets_[csid];
+        // 获取该块流正在组装的数据包
+        PacketPtr &packet = stream.packet;
 
         // 如果该数据包尚不存在，创建一个新的数据包
-        if (!packet)
+        bool new_message = !packet;
+        if (new_message)
         {
             // 根据消息长度创建新的数据包
             packet = Packet::NewPacket(msg_len);
 
-            // 创建新的消息头
-            RtmpMsgHeaderPtr header = std::make_shared<RtmpMsgHeader>();
+            // 使用数据包内嵌的 RTMP 消息头
+            RtmpMsgHeader *header = packet->MsgHeader();
 
             // 设置 chunk stream ID
             header->cs_id = csid;
 
             // 设置消息长度
             header->msg_len = msg_len;
-
-            // 设置消息序列 ID
-            header->msg_sid = msg_sid;
-
-            // 设置消息类型
-            header->msg_type = msg_type;
-
-            // 设置时间戳为 0
-            header->timestamp = 0;
-
-            // 将消息头附加到数据包中
-            packet->SetExt(header);
         }
 
         // 获取数据包的消息头
-        RtmpMsgHeaderPtr header = packet->Ext<RtmpMsgHeader>();
+        RtmpMsgHeader *header = packet->MsgHeader();
 
         // 根据不同的 FMT 值，解析消息头部
         if (fmt == kRtmpFmt0) // FMT0：完整消息头部
         {
-            // 读取 24 位的时间戳
-            ts = BytesReader::ReadUint24T(pos + parsed);
             parsed += 3;
             // 重置时间戳增量
-            in_deltas_[csid] = 0;
+            stream.delta = 0;
             // 当前时间戳
             header->timestamp = ts;
             // 读取 24 位的消息长度
@@ -292,11 +328,9 @@ int32_t RtmpContext::ParseMessage(MsgBuffer &buff)
         }
         else if (fmt == kRtmpFmt1) // FMT1：部分消息头部
         {
-            // 读取 24 位的时间戳增量
-            ts = BytesReader::ReadUint24T(pos + parsed);
             parsed += 3;
             // 保存时间戳增量
-            in_deltas_[csid] = ts;
+            stream.delta = ts;
             // 计算当前时间戳
             header->timestamp = ts + prev->timestamp;
             // 读取 24 位的消息长度
@@ -310,11 +344,9 @@ int32_t RtmpContext::ParseMessage(MsgBuffer &buff)
         }
         else if (fmt == kRtmpFmt2) // FMT2：最小消息头部
         {
-            // 读取 24 位的时间戳增量
-            ts = BytesReader::ReadUint24T(pos + parsed);
             parsed += 3;
             // 保存时间戳增量
-            in_deltas_[csid] = ts;
+            stream.delta = ts;
             // 计算当前时间戳
             header->timestamp = ts + prev->timestamp;
             // 使用之前的消息长度
@@ -326,10 +358,10 @@ int32_t RtmpContext::ParseMessage(MsgBuffer &buff)
         }
         else if (fmt == kRtmpFmt3) // FMT3：无消息头部
         {
-            if (header->timestamp == 0)
+            if (new_message)
             {
-                // 使用之前的时间戳增量计算当前时间戳
-                header->timestamp = in_deltas_[csid] + prev->timestamp;
+                // 新消息使用之前的时间戳增量计算当前时间戳，同一消息的后续块沿用第一个块的时间戳
+                header->timestamp = stream.delta + prev->timestamp;
             }
             // 使用之前的消息长度
             header->msg_len = prev->msg_len;
@@ -339,123 +371,89 @@ int32_t RtmpContext::ParseMessage(MsgBuffer &buff)
             header->msg_sid = prev->msg_sid;
         }
 
-        // 检查是否使用扩展时间戳
-        bool ext = (ts == 0xFFFFFF);
-
-        if (fmt == kRtmpFmt3) // FMT3 使用之前保存的扩展时间戳标志
-        {
-            ext = in_ext_[csid];
-        }
-
         // 更新扩展时间戳标志
-        in_ext_[csid] = ext;
+        stream.ext = ext;
 
         // 如果使用扩展时间戳
         if (ext)
         {
-            // 检查是否有足够的字节用于读取扩展时间戳
-            if (total_bytes - parsed < 4)
-            {
-                // 数据不足，返回 1 表示需要更多数据
-                return 1;
-            }
-
             // 读取 32 位的扩展时间戳
             ts = BytesReader::ReadUint32T(pos + parsed);
             parsed += 4;
 
-            // 如果格式不是 FMT0，则更新时间戳
-            if (fmt != kRtmpFmt0)
+            // FMT0 的扩展时间戳就是当前时间戳
+            if (fmt == kRtmpFmt0)
+            {
+                header->timestamp = ts;
+            }
+            // FMT1 和 FMT2 的扩展时间戳是时间戳增量
+            else if (fmt != kRtmpFmt3)
             {
                 // 更新当前时间戳
                 header->timestamp = ts + prev->timestamp;
                 // 保存当前时间戳增量
-                in_deltas_[csid] = ts;
+                stream.delta = ts;
             }
+            // FMT3 的扩展时间戳与之前的块相同，时间戳已经按增量计算过
         }
 
-        // // 获取当前 CSID 对应的数据包指针
-        // PacketPtr &packet = in_packets_[csid];
-
-        // // 如果尚未初始化数据包
-        // if (!packet)
-        // {
-        //     // 创建一个新数据包，大小为消息长度
-        //     packet = Packet::NewPacket(msg_len);
-        // }
-
-        // // 从数据包中获取消息头部的扩展信息
-        // RtmpMsgHeaderPtr header = packet->Ext<RtmpMsgHeader>();
-
-        // // 如果数据包中没有消息头部扩展信息
-        // if (!header)
-        // {
-        //     // 创建新的消息头部
-        //     header = std::make_shared<RtmpMsgHeader>();
-        //     // 将消息头部设置为数据包的扩展信息
-        //     packet->SetExt(header);
-        // }
-
-        // // 更新消息头部信息
-        // header->cs_id = csid;
-        // header->msg_len = msg_len;
-        // header->msg_sid = msg_sid;
-        // header->msg_type = msg_type;
-        // header->timestamp = timestamp;
-
-        // 计算本次可读取的字节数，受限于数据包剩余空间和块大小
-        int bytes = std::min(packet->Space(), in_chunk_size_);
-
-        // 如果剩余数据不足以填充数据包
-        if (total_bytes - parsed < bytes)
-        {
-            // 返回 1 表示需要更多数据
-            return 1;
-        }
-
-        // 获取当前数据包的写入位置
-        const char *body = packet->Data() + packet->PacketSize();
-        // 将数据从缓冲区复制到数据包中
-        memcpy((void *)body, pos + parsed, bytes);
-        // 更新数据包的大小
-        packet->UpdatePacketSize(bytes);
-        // 更新解析的字节数
-        parsed += bytes;
-
-        // 从缓冲区中移除已解析的数据
+        // 块头已经完整，从缓冲区中移除
         buff.Retrieve(parsed);
-        // 更新剩余字节数
-        total_bytes -= parsed;
 
         // 更新上次的消息头部信息
-        prev->cs_id = header->cs_id;
-        prev->msg_len = header->msg_len;
-        prev->msg_sid = header->msg_sid;
-        prev->msg_type = header->msg_type;
-        prev->timestamp = header->timestamp;
-
-        // 如果数据包已填满
-        if (packet->Space() == 0)
-        {
-            // if (timestamp == 1031)
-            // {
-            //     RTMP_DEBUG << "aaa";
-            // }
-            // 设置数据包的消息类型
-            packet->SetPacketType(header->msg_type);
-            // 设置数据包的时间戳
-            packet->SetTimeStamp(header->timestamp);
-            // 调用 MessageComplete 函数处理完整的消息
-            MessageComplete(std::move(packet));
-            // 重置数据包指针
-            packet.reset();
-        }
+        *prev = *header;
+
+        // 本块的数据长度，受限于数据包剩余空间和块大小，数据随后按到达的多少逐段接收
+        in_csid_ = csid;
+        in_chunk_left_ = std::min(packet->Space(), in_chunk_size_);
+        OnChunkBody(0);
+    }
+
+    // 当前块的数据还没有收完，缓冲区也已经读空，下次读取时直接读入数据包，不再经过缓冲区
+    if (in_chunk_left_ > 0)
+    {
+        PacketPtr &packet = InChunkStream(in_csid_).packet;
+        buff.SetReadTarget(packet->Data() + packet->PacketSize(), in_chunk_left_);
     }
 
     // 返回 1 表示解析成功
     return 1;
 }
 
+RtmpChunkStream &RtmpContext::InChunkStream(uint32_t csid)
+{
+    // 常用的块流直接用数组下标访问
+    if (csid < kFlatChunkStreams)
+    {
+        return in_streams_[csid];
+    }
+    return in_streams_ext_[csid];
+}
+
+void RtmpContext::OnChunkBody(size_t bytes)
+{
+    PacketPtr &packet = InChunkStream(in_csid_).packet;
+
+    // 更新数据包的大小和当前块剩余的字节数
+    packet->UpdatePacketSize(bytes);
+    in_chunk_left_ -= bytes;
+
+    // 块还没有收完，或者消息还有后续的块
+    if (in_chunk_left_ > 0 || packet->Space() > 0)
+    {
+        return;
+    }
+
+    // 消息已完整，设置数据包的消息类型和时间戳
+    RtmpMsgHeader *header = packet->MsgHeader();
+    packet->SetPacketType(header->msg_type);
+    packet->SetTimeStamp(header->timestamp);
+    // 调用 MessageComplete 函数处理完整的消息
+    MessageComplete(std::move(packet));
+    // 重置数据包指针
+    packet.reset();
+}
+
 void RtmpContext::SetPacketType(PacketPtr &packet)
 {
     // 如果包的类型是音频类型
@@ -470,12 +468,6 @@ void RtmpContext::SetPacketType(PacketPtr &packet)
         // 将包的类型设置为视频包类型
         packet->SetPacketType(kPacketTypeVideo);
     }
-    // 如果包的类型是元数据类型
-    else if (packet->PacketType() == kRtmpMsgTypeMetadata)
-    {
-        // 将包的类型设置为元数据包类型
-        packet->SetPacketType(kPacketTypeMeta);
-    }
     // 如果包的类型是 AMF3 元数据类型
     else if (packet->PacketType() == kRtmpMsgTypeAMF3Meta)
     {
@@ -538,6 +530,13 @@ void RtmpContext::MessageComplete(PacketPtr &&data)
         break;
     }
 
+    // 处理聚合消息
+    case kRtmpMsgTypeAggregate: {
+        // 拆分为单独的消息后逐个处理
+        HandleAggregate(data);
+        break;
+    }
+
     // 处理 AMF 元数据
     case kRtmpMsgTypeAMFMeta:
 
@@ -569,240 +568,472 @@ void RtmpContext::MessageComplete(PacketPtr &&data)
     }
 }
 
-bool RtmpContext::BuildChunk(const PacketPtr &packet, uint32_t timestamp, bool fmt0)
+uint32_t RtmpContext::BuildChunkHeader(const RtmpMsgHeader *h, uint32_t cs_id, uint32_t timestamp,
+                                       bool fmt0)
 {
-    // 获取数据包的消息头
-    RtmpMsgHeaderPtr h = packet->Ext<RtmpMsgHeader>();
+    // 获取该 CSID 上次发送的消息头
+    RtmpMsgHeaderPtr &prev = out_message_headers_[cs_id];
+    // 判断是否可以使用时间戳增量，减少数据冗余
+    bool use_delta = !fmt0 && prev && timestamp >= prev->timestamp && h->msg_sid == prev->msg_sid;
 
-    // 如果消息头存在，开始构建块
-    if (h)
+    // 如果没有上次的消息头，则创建一个新的
+    if (!prev)
     {
-        out_sending_packets_.emplace_back(packet);
+        prev = std::make_shared<RtmpMsgHeader>();
+    }
 
-        // 获取该 CSID 上次发送的消息头
-        RtmpMsgHeaderPtr &prev = out_message_headers_[h->cs_id];
-        // 判断是否可以使用时间戳增量，减少数据冗余
-        bool use_delta =
-            !fmt0 && !prev && timestamp >= prev->timestamp && h->msg_sid == prev->msg_sid;
+    // 默认使用格式0
+    int fmt = kRtmpFmt0;
 
-        // 如果没有上次的消息头，则创建一个新的
-        if (!prev)
+    // 如果可以使用增量更新
+    if (use_delta)
+    {
+        // 使用格式1
+        fmt = kRtmpFmt1;
+        // 计算时间戳的增量
+        timestamp -= prev->timestamp;
+
+        // 如果消息类型和长度相同，使用格式2
+        if (h->msg_type == prev->msg_type && h->msg_len == prev->msg_len)
         {
-            prev = std::make_shared<RtmpMsgHeader>();
+            fmt = kRtmpFmt2;
+
+            // 如果增量相同，使用格式3
+            if (timestamp == out_deltas_[cs_id])
+            {
+                fmt = kRtmpFmt3;
+            }
         }
+    }
 
-        // 默认使用格式0
-        int fmt = kRtmpFmt0;
+    // 获取写入块头的位置，构建基本头部
+    char *p = HeaderBuffer(kMaxChunkHeaderSize);
+    p += WriteBasicHeader(p, fmt, cs_id);
 
-        // 如果可以使用增量更新
-        if (use_delta)
-        {
-            // 使用格式1
-            fmt = kRtmpFmt1;
-            // 计算时间戳的增量
-            timestamp -= prev->timestamp;
+    // 时间戳处理，如果超过最大值，则使用最大值
+    auto ts = timestamp;
 
-            // 如果消息类型和长度相同，使用格式2
-            if (h->msg_type == prev->msg_type && h->msg_len == prev->msg_len)
-            {
-                fmt = kRtmpFmt2;
+    if (timestamp >= 0xFFFFFF)
+    {
+        ts = 0xFFFFFF;
+    }
 
-                // 如果增量相同，使用格式3
-                if (timestamp == out_deltas_[h->cs_id])
-                {
-                    fmt = kRtmpFmt3;
-                }
+    // 根据不同格式写入消息头部信息
+    if (fmt == kRtmpFmt0)
+    {
+        // 格式0：写入时间戳、消息长度、消息类型和消息流ID
+        p += BytesWriter::WriteUint24T(p, ts);
+        p += BytesWriter::WriteUint24T(p, h->msg_len);
+        p += BytesWriter::WriteUint8T(p, h->msg_type);
+
+        memcpy(p, &h->msg_sid, 4);
+        p += 4;
+
+        // 重置增量
+        out_deltas_[cs_id] = 0;
+    }
+    else if (fmt == kRtmpFmt1)
+    {
+        // 格式1：写入时间戳、消息长度和消息类型
+        p += BytesWriter::WriteUint24T(p, ts);
+        p += BytesWriter::WriteUint24T(p, h->msg_len);
+        p += BytesWriter::WriteUint8T(p, h->msg_type);
+        out_deltas_[cs_id] = timestamp;
+    }
+    else if (fmt == kRtmpFmt2)
+    {
+        // 格式2：仅写入时间戳
+        p += BytesWriter::WriteUint24T(p, ts);
+        // 更新增量
+        out_deltas_[cs_id] = timestamp;
+    }
+
+    // 如果时间戳达到最大值，写入扩展时间戳
+    if (ts == 0xFFFFFF)
+    {
+        // 扩展时间戳按网络字节序写入
+        p += BytesWriter::WriteUint32T(p, timestamp);
+    }
+
+    // 将构建好的消息头部数据保存到发送缓冲区
+    BufferNodePtr nheader =
+        std::make_shared<BufferNode>(out_current_, p - out_current_, HeaderOwner());
+    sending_bufs_.emplace_back(std::move(nheader));
+    out_current_ = p;
+
+    // 更新上次的消息头信息
+    prev->cs_id = cs_id;
+    prev->msg_len = h->msg_len;
+    prev->msg_sid = h->msg_sid;
+    prev->msg_type = h->msg_type;
+
+    // 如果使用格式0，直接更新时间戳；否则，增量更新
+    if (fmt == kRtmpFmt0)
+    {
+        prev->timestamp = timestamp;
+    }
+    else
+    {
+        prev->timestamp += timestamp;
+    }
+
+    // 返回时间戳字段的值，后续块的扩展时间戳与它相同
+    return timestamp;
+}
+
+int32_t RtmpContext::BuildChunkBody(const PacketPtr &packet, uint32_t cs_id, uint32_t timestamp,
+                                    int32_t offset, int32_t max_bytes)
+{
+    int32_t msg_len = packet->MsgHeader()->msg_len;
+
+    // 本次构建到哪里结束：至少一个块，按块边界对齐
+    int32_t end = msg_len;
+    if (max_bytes < msg_len - offset)
+    {
+        int32_t chunks = std::max(1, (max_bytes + out_chunk_size_ - 1) / out_chunk_size_);
+        end = std::min<int64_t>(msg_len, offset + (int64_t)chunks * out_chunk_size_);
+    }
+
+    // 没有扩展时间戳时，后续块的头部与连接无关，消息体分块后的数据可以在
+    // 所有使用相同块大小的连接间共享，连续的多个块只需要一个发送节点
+    if (timestamp < 0xFFFFFF && msg_len > out_chunk_size_)
+    {
+        const PacketCache *cache = GetChunkCache(packet, cs_id, msg_len);
+
+        // 第 k 个块（k > 0）在缓存中的位置：第一个块没有块头，之后每个块带一个格式3的基本头部
+        int32_t header_len = cs_id < 64 ? 1 : (cs_id < (64 + 256) ? 2 : 3);
+        auto position = [&](int32_t pos) -> size_t {
+            if (pos == 0)
+            {
+                return 0;
             }
-        }
+            if (pos >= msg_len)
+            {
+                return cache->data.size();
+            }
+            return pos + (pos / out_chunk_size_ - 1) * header_len;
+        };
+        size_t from = position(offset);
+        size_t to = position(end);
+        BufferNodePtr node = std::make_shared<BufferNode>(
+            (void *)(cache->data.data() + from), to - from, packet);
+        sending_bufs_.emplace_back(std::move(node));
+        return end;
+    }
 
-        // 设置输出缓冲区当前指针
-        char *p = out_current_;
+    // 处理消息体部分，将数据分块并添加到发送队列中
+    // 指向消息体数据的起始位置
+    const char *body = packet->Data();
 
-        // 构建基本头部，根据 CSID 来决定如何编码
-        if (h->cs_id < 64)
-        {
-            // 小于64，直接编码
-            *p++ = (char)((fmt << 6) | h->cs_id);
-        }
-        else if (h->cs_id < (64 + 256))
-        {
-            // 使用1字节编码CSID
-            *p++ = (char)((fmt << 6) | 0);
-            *p++ = (char)(h->cs_id - 64);
-        }
-        else
+    // 持续处理消息体数据，直到本次要构建的数据全部分块
+    while (offset < end)
+    {
+        // 除第一个块外，每个块前都需要格式3的块头，块头空间不足时自动切换到新的内存块
+        if (offset > 0)
         {
-            // 使用2字节编码CSID
-            *p++ = (char)((fmt << 6) | 1);
-            uint16_t cs = h->cs_id - 64;
-            memcpy(p, &cs, sizeof(uint16_t));
-            p += sizeof(uint16_t);
+            char *p = HeaderBuffer(kMaxChunkHeaderSize);
+            p += WriteBasicHeader(p, kRtmpFmt3, cs_id);
+
+            // 对于时间戳超过最大值的情况，写入扩展时间戳
+            if (timestamp >= 0xFFFFFF)
+            {
+                p += BytesWriter::WriteUint32T(p, timestamp);
+            }
+
+            // 构建完头部后，将其保存到发送缓冲区，并更新 out_current_ 指针
+            BufferNodePtr nheader =
+                std::make_shared<BufferNode>(out_current_, p - out_current_, HeaderOwner());
+            sending_bufs_.emplace_back(std::move(nheader));
+            out_current_ = p;
         }
 
-        // 时间戳处理，如果超过最大值，则使用最大值
-        auto ts = timestamp;
+        // 当前块的大小，等于剩余消息体长度和输出块大小之间的较小值
+        int32_t size = std::min(end - offset, out_chunk_size_);
 
-        if (timestamp >= 0xFFFFFF)
+        // 将当前块数据封装为发送节点，数据直接引用数据包的内存，节点持有数据包
+        BufferNodePtr node = std::make_shared<BufferNode>((void *)(body + offset), size, packet);
+        sending_bufs_.emplace_back(std::move(node));
+        offset += size;
+    }
+    return end;
+}
+
+const PacketCache *RtmpContext::GetChunkCache(const PacketPtr &packet, uint32_t cs_id,
+                                              int32_t msg_len)
+{
+    // 缓存键：高32位为块大小，低32位为 CSID
+    uint64_t key = ((uint64_t)out_chunk_size_ << 32) | cs_id;
+    const PacketCache *cache = packet->FindCache(key);
+    if (cache)
+    {
+        return cache;
+    }
+
+    // 构建格式3的基本头部，后续每个块前都需要插入
+    char header[3];
+    int32_t header_len = WriteBasicHeader(header, kRtmpFmt3, cs_id);
+
+    // 按块大小切分消息体，块之间插入格式3头部
+    PacketCache *node = new PacketCache();
+    node->key = key;
+    int32_t chunks = (msg_len + out_chunk_size_ - 1) / out_chunk_size_;
+    node->data.reserve(msg_len + (chunks - 1) * header_len);
+
+    const char *body = packet->Data();
+    int32_t bytes_parsed = 0;
+    while (bytes_parsed < msg_len)
+    {
+        if (bytes_parsed > 0)
         {
-            ts = 0xFFFFFF;
+            node->data.append(header, header_len);
         }
+        int32_t size = std::min(msg_len - bytes_parsed, out_chunk_size_);
+        node->data.append(body + bytes_parsed, size);
+        bytes_parsed += size;
+    }
 
-        // 根据不同格式写入消息头部信息
-        if (fmt == kRtmpFmt0)
-        {
-            // 格式0：写入时间戳、消息长度、消息类型和消息流ID
-            p += BytesWriter::WriteUint24T(p, ts);
-            p += BytesWriter::WriteUint24T(p, h->msg_len);
-            p += BytesWriter::WriteUint8T(p, h->msg_type);
+    // 多个连接可能同时构建同一份缓存，以先挂到数据包上的为准
+    return packet->AddCache(node);
+}
 
-            memcpy(p, &h->msg_sid, 4);
-            p += 4;
+size_t RtmpContext::AggregateCount(const PacketPtr *packets, size_t count) const
+{
+    if (aggregate_size_ <= 0 || count == 0)
+    {
+        return 0;
+    }
 
-            // 重置增量
-            out_deltas_[h->cs_id] = 0;
-        }
-        else if (fmt == kRtmpFmt1)
+    // 从第一个帧开始累加，遇到非音视频消息、媒体类型变化或超出聚合消息的最大长度时停止。
+    // 聚合消息只包含音频或只包含视频，按各自的队列发送，每个队列内的时间戳保持递增
+    size_t n = 0;
+    int64_t bytes = 0;
+    uint8_t first = packets[0]->MsgHeader()->msg_type;
+    while (n < count)
+    {
+        uint8_t type = packets[n]->MsgHeader()->msg_type;
+        if ((type != kRtmpMsgTypeAudio && type != kRtmpMsgTypeVideo) || type != first)
         {
-            // 格式1：写入时间戳、消息长度和消息类型
-            p += BytesWriter::WriteUint24T(p, ts);
-            p += BytesWriter::WriteUint24T(p, h->msg_len);
-            p += BytesWriter::WriteUint8T(p, h->msg_type);
-            out_deltas_[h->cs_id] = timestamp;
+            break;
         }
-        else if (fmt == kRtmpFmt2)
+        bytes += kAggregateTagSize + packets[n]->PacketSize();
+        if (bytes > aggregate_size_)
         {
-            // 格式2：仅写入时间戳
-            p += BytesWriter::WriteUint24T(p, ts);
-            // 更新增量
-            out_deltas_[h->cs_id] = timestamp;
+            break;
         }
+        n++;
+    }
+    return n;
+}
 
-        // 如果时间戳达到最大值，写入扩展时间戳
-        if (ts == 0xFFFFFF)
-        {
-            memcpy(p, &timestamp, 4);
-            p += 4;
-        }
+bool RtmpContext::BuildAggregateChunk(const PacketPtr *packets, const uint32_t *timestamps,
+                                      size_t count, uint32_t cs_id)
+{
+    if (count == 0)
+    {
+        return false;
+    }
 
-        // 将构建好的消息头部数据保存到发送缓冲区
-        BufferNodePtr nheader = std::make_shared<BufferNode>(out_current_, p - out_current_);
-        sending_bufs_.emplace_back(std::move(nheader));
-        out_current_ = p;
+    // 聚合消息体由子消息依次组成：11 字节的标签头、帧数据、4 字节的反向指针
+    RtmpMsgHeader header;
+    header.cs_id = cs_id;
+    header.msg_type = kRtmpMsgTypeAggregate;
+    header.msg_sid = packets[0]->MsgHeader()->msg_sid;
+    for (size_t i = 0; i < count; i++)
+    {
+        header.msg_len += kAggregateTagSize + packets[i]->PacketSize();
+    }
 
-        // 更新上次的消息头信息
-        prev->cs_id = h->cs_id;
-        prev->msg_len = h->msg_len;
-        prev->msg_sid = h->msg_sid;
-        prev->msg_type = h->msg_type;
+    // 写入第一个块的块头，与普通消息一样按该块流上次发送的消息头压缩，时间戳为第一个帧的输出时间戳
+    uint32_t field = BuildChunkHeader(&header, cs_id, timestamps[0], false);
 
-        // 如果使用格式0，直接更新时间戳；否则，增量更新
-        if (fmt == kRtmpFmt0)
-        {
-            prev->timestamp = timestamp;
-        }
-        else
+    int32_t chunk_left = out_chunk_size_;
+    uint32_t tag_size = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const PacketPtr &packet = packets[i];
+
+        // 上一个子消息的反向指针和本子消息的标签头写在一起，通常只占一个发送节点。
+        // 每个子消息使用各自的输出时间戳，追赶区间的压缩对聚合中的每一帧都生效
+        uint32_t ts = timestamps[i];
+        char *p = HeaderBuffer(kAggregateTagSize);
+        char *start = p;
+        if (i > 0)
         {
-            prev->timestamp += timestamp;
+            p += BytesWriter::WriteUint32T(p, tag_size);
         }
+        p += BytesWriter::WriteUint8T(p, packet->MsgHeader()->msg_type);
+        p += BytesWriter::WriteUint24T(p, packet->PacketSize());
+        p += BytesWriter::WriteUint24T(p, ts & 0xFFFFFF);
+        p += BytesWriter::WriteUint8T(p, ts >> 24);
+        p += BytesWriter::WriteUint24T(p, 0);
+        out_current_ = p;
+        AppendAggregateBody(start, p - start, HeaderOwner(), cs_id, field, chunk_left);
+
+        // 帧数据直接引用数据包的内存，节点持有数据包
+        AppendAggregateBody(packet->Data(), packet->PacketSize(), packet, cs_id, field,
+                            chunk_left);
+        tag_size = 11 + packet->PacketSize();
+    }
 
-        // 处理消息体部分，将数据分块并添加到发送队列中
-        // 指向消息体数据的起始位置
-        const char *body = packet->Data();
-        // 用于跟踪已经处理的数据字节数
-        int32_t bytes_parsed = 0;
+    // 最后一个子消息的反向指针
+    char *p = HeaderBuffer(4);
+    char *start = p;
+    p += BytesWriter::WriteUint32T(p, tag_size);
+    out_current_ = p;
+    AppendAggregateBody(start, p - start, HeaderOwner(), cs_id, field, chunk_left);
+    return true;
+}
 
-        // 持续处理消息体数据，直到所有数据被分块处理完毕
-        while (true)
+void RtmpContext::AppendAggregateBody(const char *data, int32_t len,
+                                      const std::shared_ptr<void> &owner, uint32_t cs_id,
+                                      uint32_t timestamp, int32_t &chunk_left)
+{
+    while (len > 0)
+    {
+        // 当前块已写满，先写入下一个块的格式3块头
+        if (chunk_left == 0)
         {
-            // 计算每次发送的数据块大小
-            // 指向当前要处理的消息体数据的开始位置
-            const char *chunk = body + bytes_parsed;
-            // 表示当前块的大小，等于剩余消息体长度和设定的最大块大小（out_chunk_size_）之间的较小值
-            int32_t size = h->msg_len - bytes_parsed;
-            size = std::min(size, out_chunk_size_);
-
-            // 创建一个新的 BufferNode 对象，将当前块数据封装进去，并添加到 sending_bufs_
-            // 缓冲区队列中
-            BufferNodePtr node = std::make_shared<BufferNode>((void *)chunk, size);
-            sending_bufs_.emplace_back(std::move(node));
-            // 更新 bytes_parsed，以记录已经处理的数据量
-            bytes_parsed += size;
-
-            // 如果数据还未发送完，继续处理
-            if (bytes_parsed < h->msg_len)
+            char *p = HeaderBuffer(kMaxChunkHeaderSize);
+            char *start = p;
+            p += WriteBasicHeader(p, kRtmpFmt3, cs_id);
+            if (timestamp >= 0xFFFFFF)
             {
-                // 如果缓冲区不够用，输出错误信息并停止处理
-                if (out_current_ - out_buffer_ >= 4096)
-                {
-                    RTMP_ERROR << " rtmp had no enough out header buffer.";
+                p += BytesWriter::WriteUint32T(p, timestamp);
+            }
+            out_current_ = p;
+            AppendSendBuffer(start, p - start, HeaderOwner());
+            chunk_left = out_chunk_size_;
+        }
 
-                    break;
-                }
+        int32_t size = std::min(len, chunk_left);
+        AppendSendBuffer(data, size, owner);
+        data += size;
+        len -= size;
+        chunk_left -= size;
+    }
+}
 
-                // 构建后续的数据块头部
-                char *p = out_current_;
+void RtmpContext::AppendSendBuffer(const char *data, size_t len,
+                                   const std::shared_ptr<void> &owner)
+{
+    // 与上一个节点属于同一块内存且首尾相连（如相邻写入的块头和标签头）时直接扩展上一个节点
+    if (!sending_bufs_.empty())
+    {
+        BufferNodePtr &last = sending_bufs_.back();
+        if (last->owner == owner && (const char *)last->addr + last->size == data)
+        {
+            last->size += len;
+            return;
+        }
+    }
+    sending_bufs_.emplace_back(std::make_shared<BufferNode>((void *)data, len, owner));
+}
 
-                // 对于不同的 cs_id 范围，分别使用不同的方式构建头部
-                // 如果 Chunk Stream ID (cs_id) 小于 64
-                if (h->cs_id < 64)
-                {
-                    // 将格式3的标志位与 cs_id 结合编码到一个字节中，并存入缓冲区，同时指针 p
-                    // 向后移动一位
-                    *p++ = (char)(0xC0 | h->cs_id);
-                }
-                // 如果 Chunk Stream ID (cs_id) 在 64 到 319 之间
-                else if (h->cs_id < (64 + 256))
-                {
-                    // 首先将格式3的标志位和高位部分0编码到一个字节中，并存入缓冲区，同时指针 p
-                    // 向后移动一位
-                    *p++ = (char)(0xC0 | 0);
-                    // 将 cs_id 减去 64 的结果编码到第二个字节中，并存入缓冲区，同时指针 p
-                    // 向后移动一位
-                    *p++ = (char)(h->cs_id - 64);
-                }
-                // 如果 Chunk Stream ID (cs_id) 大于等于 320
-                else
-                {
-                    // 首先将格式3的标志位和高位部分1编码到一个字节中，并存入缓冲区，同时指针 p
-                    // 向后移动一位
-                    *p++ = (char)(0xC0 | 1);
-                    // 计算出需要编码的 cs_id 值（减去 64）
-                    uint16_t cs = h->cs_id - 64;
-                    // 将这个 16 位的 cs_id 复制到缓冲区中
-                    memcpy(p, &cs, sizeof(uint16_t));
-                    // 指针 p 向后移动两个字节，为后续数据存储做准备
-                    p += sizeof(uint16_t);
-                }
+PacketPtr RtmpContext::EncodeMessages(const PacketPtr *packets, size_t count,
+                                      const uint32_t *timestamps, int32_t chunk_size)
+{
+    // 先计算编码后的总长度：每条消息一个格式0的块头，之后每个块一个格式3的基本头部，
+    // 使用扩展时间戳时每个块头后面还有 4 字节
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        int32_t msg_len = packets[i]->MsgHeader()->msg_len;
+        int32_t ext = timestamps[i] >= 0xFFFFFF ? 4 : 0;
+        int32_t chunks = std::max(1, (msg_len + chunk_size - 1) / chunk_size);
+        total += 12 + ext + msg_len + (chunks - 1) * (1 + ext);
+    }
 
-                // 对于时间戳超过最大值的情况，写入扩展时间戳
-                if (ts == 0xFFFFFF)
-                {
-                    memcpy(p, &timestamp, 4);
-                    p += 4;
-                }
+    PacketPtr data = Packet::NewPacket(total);
+    char *p = data->Data();
+    for (size_t i = 0; i < count; i++)
+    {
+        const PacketPtr &packet = packets[i];
+        RtmpMsgHeader *h = packet->MsgHeader();
+        uint32_t cs_id = h->msg_type == kRtmpMsgTypeAudio ? kRtmpCSIDAudio : kRtmpCSIDVideo;
+        uint32_t timestamp = timestamps[i];
+
+        // 格式0的块头：时间戳、消息长度、消息类型和消息流ID
+        p += WriteBasicHeader(p, kRtmpFmt0, cs_id);
+        p += BytesWriter::WriteUint24T(p, std::min<uint32_t>(timestamp, 0xFFFFFF));
+        p += BytesWriter::WriteUint24T(p, h->msg_len);
+        p += BytesWriter::WriteUint8T(p, h->msg_type);
+        memcpy(p, &h->msg_sid, 4);
+        p += 4;
+        if (timestamp >= 0xFFFFFF)
+        {
+            p += BytesWriter::WriteUint32T(p, timestamp);
+        }
 
-                // 构建完头部后，将其保存到发送缓冲区，并更新 out_current_ 指针
-                BufferNodePtr nheader =
-                    std::make_shared<BufferNode>(out_current_, p - out_current_);
-                sending_bufs_.emplace_back(std::move(nheader));
-                out_current_ = p;
-            }
-            else
+        // 消息体按块大小切分，块之间插入格式3的块头
+        int32_t offset = 0;
+        while (offset < (int32_t)h->msg_len)
+        {
+            if (offset > 0)
             {
-                // 数据发送完毕，退出循环
-                break;
+                p += WriteBasicHeader(p, kRtmpFmt3, cs_id);
+                if (timestamp >= 0xFFFFFF)
+                {
+                    p += BytesWriter::WriteUint32T(p, timestamp);
+                }
             }
+            int32_t size = std::min<int32_t>(h->msg_len - offset, chunk_size);
+            memcpy(p, packet->Data() + offset, size);
+            p += size;
+            offset += size;
         }
+    }
+    data->SetPacketSize(p - data->Data());
+    return data;
+}
 
-        // 将数据包添加到正在发送的队列中
-        // out_sending_packets_.emplace_back(std::move(packet));
+char *RtmpContext::HeaderBuffer(int32_t len)
+{
+    // 当前内存块剩余空间不足，切换到下一个内存块，没有可复用的就新分配一个
+    if (out_end_ - out_current_ < len)
+    {
+        if (out_header_used_ >= out_header_blocks_.size())
+        {
+            out_header_blocks_.emplace_back();
+        }
+        auto &block = out_header_blocks_[out_header_used_++];
+        if (!block)
+        {
+            block.reset(new char[kHeaderBlockSize]);
+        }
+        out_current_ = block.get();
+        out_end_ = out_current_ + kHeaderBlockSize;
+    }
+    return out_current_;
+}
 
-        // 如果消息体的所有块都成功构建并添加到发送队列，返回 true 表示成功
-        return true;
+std::shared_ptr<void> RtmpContext::HeaderOwner() const
+{
+    // 本批还没有调用过 HeaderBuffer 时没有当前内存块
+    if (out_header_used_ == 0)
+    {
+        return nullptr;
     }
+    return out_header_blocks_[out_header_used_ - 1];
+}
 
-    // 如果消息头不存在，返回失败
-    return false;
+void RtmpContext::ResetHeaderBuffer()
+{
+    // 内存块留给下一批复用，超出上限的部分释放。仍被发送节点引用的内存块
+    // 交给节点释放，这里换成新的内存块，不覆盖还没有写出的块头
+    if (out_header_blocks_.size() > kMaxHeaderBlocks)
+    {
+        out_header_blocks_.resize(kMaxHeaderBlocks);
+    }
+    for (auto &block : out_header_blocks_)
+    {
+        if (block.use_count() > 1)
+        {
+            block.reset();
+        }
+    }
+    out_header_used_ = 0;
+    out_current_ = nullptr;
+    out_end_ = nullptr;
 }
 
 void RtmpContext::Send()
@@ -817,7 +1048,11 @@ void RtmpContext::Send()
     // 标记当前状态为正在发送
     sending_ = true;
 
-    // 最多处理 10 个数据包
+    // 是否有消息正在分批发送
+    bool pending = (!out_audio_queue_.empty() && out_audio_queue_.front().sent >= 0) ||
+                   (!out_video_queue_.empty() && out_video_queue_.front().sent >= 0);
+
+    // 控制消息优先，最多处理 10 个数据包
     for (int i = 0; i < 10; i++)
     {
         // 如果等待队列为空
@@ -827,291 +1062,481 @@ void RtmpContext::Send()
             break;
         }
 
+        // 新的块大小对之后的所有块生效，需要等分批发送中的消息发完
+        if (pending && out_waiting_queue_.front()->MsgHeader()->msg_type == kRtmpMsgTypeChunkSize)
+        {
+            break;
+        }
+
         // 取出等待队列中的第一个数据包
         PacketPtr packet = std::move(out_waiting_queue_.front());
         // 从等待队列中移除该数据包
         out_waiting_queue_.pop_front();
+
+        // Set Chunk Size 消息写出后，之后的消息按新的块大小分块
+        int32_t chunk_size = 0;
+        if (packet->MsgHeader()->msg_type == kRtmpMsgTypeChunkSize && packet->PacketSize() >= 4)
+        {
+            chunk_size = BytesReader::ReadUint32T(packet->Data());
+        }
+
         // 将数据包构建为 RTMP 块
         BuildChunk(std::move(packet));
+
+        if (chunk_size > 0)
+        {
+            out_chunk_size_ = chunk_size;
+        }
     }
 
-    // 将准备好的数据块通过连接发送出去
-    connection_->Send(sending_bufs_);
-}
+    // 然后是音频和视频，本批构建的媒体数据不超过 kSendQuantum，
+    // 大的消息按块边界分批发送，下一批之前新到的音频可以插在它的块之间
+    int32_t budget = kSendQuantum;
+    budget -= BuildOutQueue(out_audio_queue_, budget);
+    budget -= BuildOutQueue(out_video_queue_, budget);
 
-bool RtmpContext::Ready() const
-{
-    // 如果当前没有在发送数据，返回 true，表示准备好
-    return !sending_;
+    // 没有需要发送的数据
+    if (sending_bufs_.empty())
+    {
+        sending_ = false;
+        return;
+    }
+
+    // 记录本次发送的字节数和开始时间，发送完成时据此估算发送速率
+    send_bytes_ = 0;
+    for (auto const &node : sending_bufs_)
+    {
+        send_bytes_ += node->size;
+    }
+    send_time_ = tmms::base::TTime::NowMS();
+
+    // 将准备好的数据块通过连接发送出去，节点持有数据包和块头内存块
+    connection_->Send(std::move(sending_bufs_));
+    sending_bufs_.clear();
 }
 
-bool RtmpContext::BuildChunk(PacketPtr &&packet, uint32_t timestamp, bool fmt0)
+int32_t RtmpContext::BuildOutQueue(std::list<RtmpOutMessage> &queue, int32_t budget)
 {
-    // 获取数据包中的 RTMP 消息头
-    RtmpMsgHeaderPtr h = packet->Ext<RtmpMsgHeader>();
-
-    // 如果消息头存在
-    if (h)
+    int32_t built = 0;
+    while (!queue.empty() && built < budget)
     {
-        // 获取之前的消息头，用于与当前消息头进行比较
-        RtmpMsgHeaderPtr &prev = out_message_headers_[h->cs_id];
-        // 检查是否使用时间戳增量（非格式0，之前的消息头存在，且时间戳合法，消息流ID相同）
-        bool use_delta =
-            !fmt0 && prev && timestamp >= prev->timestamp && h->msg_sid == prev->msg_sid;
+        RtmpOutMessage &msg = queue.front();
 
-        // 如果之前的消息头不存在，则初始化
-        if (!prev)
+        // 音频最多比正在发送的视频超前 kMaxAudioLead 毫秒，避免追帧时所有音频都排到视频前面
+        if (&queue == &out_audio_queue_ && !out_video_queue_.empty() &&
+            msg.timestamp > out_video_queue_.front().timestamp + kMaxAudioLead)
         {
-            prev = std::make_shared<RtmpMsgHeader>();
+            break;
         }
 
-        // 默认使用格式0
-        int fmt = kRtmpFmt0;
+        built += BuildOutMessage(msg, budget - built);
 
-        // 如果使用时间戳增量
-        if (use_delta)
+        // 本批的预算已经用完，消息剩余的块下一批继续发送
+        if (msg.sent < msg.msg_len)
         {
-            // 使用格式1
-            fmt = kRtmpFmt1;
+            break;
+        }
+        out_queued_bytes_ -= msg.msg_len;
+        queue.pop_front();
+    }
+    return built;
+}
 
-            // 计算时间戳差值
-            timestamp -= prev->timestamp;
+int32_t RtmpContext::BuildOutMessage(RtmpOutMessage &msg, int32_t budget)
+{
+    // 预先编码好的块数据整体发送。其中每条消息都以格式0开头，之后音频和视频块流上的
+    // 第一条消息也需要格式0，不能按编码前的压缩状态计算增量
+    if (msg.encoded)
+    {
+        AppendSendBuffer(msg.packet->Data(), msg.packet->PacketSize(), msg.packet);
+        out_message_headers_.erase(kRtmpCSIDAudio);
+        out_message_headers_.erase(kRtmpCSIDVideo);
+        msg.sent = msg.msg_len;
+        return msg.msg_len;
+    }
 
-            // 如果消息类型和长度相同，使用格式2
-            if (h->msg_type == prev->msg_type && h->msg_len == prev->msg_len)
-            {
-                fmt = kRtmpFmt2;
+    // 聚合消息一次构建完
+    if (!msg.packets.empty())
+    {
+        BuildAggregateChunk(&msg.packets[0], &msg.timestamps[0], msg.packets.size(), msg.cs_id);
+        msg.sent = msg.msg_len;
+        return msg.msg_len;
+    }
 
-                // 如果时间戳差值相同，使用格式3
-                if (timestamp == out_deltas_[h->cs_id])
-                {
-                    fmt = kRtmpFmt3;
-                }
-            }
-        }
+    // 第一次构建时写入消息头，记录时间戳字段的值，后续块的扩展时间戳与它相同
+    if (msg.sent < 0)
+    {
+        msg.field = BuildChunkHeader(msg.packet->MsgHeader(), msg.cs_id, msg.timestamp, msg.fmt0);
+        msg.sent = 0;
+    }
 
-        // 指向当前缓冲区位置的指针
-        char *p = out_current_;
+    int32_t from = msg.sent;
+    msg.sent = BuildChunkBody(msg.packet, msg.cs_id, msg.field, msg.sent, budget);
+    return msg.sent - from;
+}
 
-        // 如果 chunk stream ID 小于 64，直接使用单字节表示
-        if (h->cs_id < 64)
-        {
-            // 将 fmt 左移 6 位，然后与 cs_id 进行按位或操作，将结果存入 p，并且 p 指针自增
-            *p++ = (char)((fmt << 6) | h->cs_id);
-        }
-        // 如果 chunk stream ID 在 64 到 319 之间，使用两字节表示
-        else if (h->cs_id < (64 + 256))
-        {
-            *p++ = (char)((fmt << 6) | 0); // 第一字节：fmt 左移 6 位，与 0 进行按位或操作
-            *p++ = (char)(h->cs_id - 64); // 第二字节：存储 cs_id 减去 64 的值
-        }
-        // 如果 chunk stream ID 大于等于 320，使用三字节表示
-        else
-        {
-            *p++ = (char)((fmt << 6) | 1); // 第一字节：fmt 左移 6 位，与 1 进行按位或操作
-            uint16_t cs =
-                h->cs_id - 64; // 计算 cs_id 减去 64 的值，并将其存入一个 16 位无符号整数中
-            memcpy(p, &cs, sizeof(uint16_t)); // 将 cs 的内容复制到 p 所指向的位置
-            p += sizeof(uint16_t);            // p 指针向前移动 2 字节
-        }
+void RtmpContext::QueueMessage(const PacketPtr &packet, uint32_t timestamp, bool fmt0)
+{
+    // 音频和视频使用各自的块流，两者的块可以任意交错
+    bool audio = packet->MsgHeader()->msg_type == kRtmpMsgTypeAudio;
+
+    RtmpOutMessage msg;
+    msg.packet = packet;
+    msg.cs_id = audio ? kRtmpCSIDAudio : kRtmpCSIDVideo;
+    msg.timestamp = timestamp;
+    msg.fmt0 = fmt0;
+    msg.msg_len = packet->MsgHeader()->msg_len;
+
+    out_queued_bytes_ += msg.msg_len;
+    if (audio)
+    {
+        out_audio_queue_.emplace_back(std::move(msg));
+    }
+    else
+    {
+        out_video_queue_.emplace_back(std::move(msg));
+    }
+}
 
-        // 设置时间戳变量
-        auto ts = timestamp;
+void RtmpContext::QueueAggregate(const PacketPtr *packets, const uint32_t *timestamps,
+                                 size_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
 
-        // 如果时间戳超过最大值，设置为最大值
-        if (timestamp >= 0xFFFFFF)
-        {
-            ts = 0xFFFFFF;
-        }
+    // 聚合消息只包含一种媒体，与普通消息一样按音频或视频排队
+    bool audio = packets[0]->MsgHeader()->msg_type == kRtmpMsgTypeAudio;
 
-        // 根据格式不同，设置不同的消息头
-        if (fmt == kRtmpFmt0)
-        {
-            // 写入24位时间戳
-            p += BytesWriter::WriteUint24T(p, ts);
-            // 写入消息长度
-            p += BytesWriter::WriteUint24T(p, h->msg_len);
-            // 写入消息类型
-            p += BytesWriter::WriteUint8T(p, h->msg_type);
-
-            // 写入消息流 ID
-            memcpy(p, &h->msg_sid, 4);
-            p += 4;
-            // 重置增量时间戳
-            out_deltas_[h->cs_id] = 0;
-        }
-        else if (fmt == kRtmpFmt1)
-        {
-            // 写入24位时间戳
-            p += BytesWriter::WriteUint24T(p, ts);
-            // 写入消息长度
-            p += BytesWriter::WriteUint24T(p, h->msg_len);
-            // 写入消息类型
-            p += BytesWriter::WriteUint8T(p, h->msg_type);
-            // 更新增量时间戳
-            out_deltas_[h->cs_id] = timestamp;
-        }
-        else if (fmt == kRtmpFmt2)
-        {
-            // 写入24位时间戳
-            p += BytesWriter::WriteUint24T(p, ts);
-            // 更新增量时间戳
-            out_deltas_[h->cs_id] = timestamp;
-        }
+    RtmpOutMessage msg;
+    msg.packets.assign(packets, packets + count);
+    msg.timestamps.assign(timestamps, timestamps + count);
+    msg.cs_id = audio ? kRtmpCSIDAudio : kRtmpCSIDVideo;
+    msg.timestamp = timestamps[0];
+    for (size_t i = 0; i < count; i++)
+    {
+        msg.msg_len += kAggregateTagSize + packets[i]->PacketSize();
+    }
 
-        // 如果时间戳为最大值，写入完整的时间戳
-        if (ts == 0xFFFFFF)
-        {
-            memcpy(p, &timestamp, 4);
-            p += 4;
-        }
+    out_queued_bytes_ += msg.msg_len;
+    if (audio)
+    {
+        out_audio_queue_.emplace_back(std::move(msg));
+    }
+    else
+    {
+        out_video_queue_.emplace_back(std::move(msg));
+    }
+}
 
-        // 创建并保存数据块头部
-        BufferNodePtr nheader = std::make_shared<BufferNode>(out_current_, p - out_current_);
-        sending_bufs_.emplace_back(std::move(nheader));
-        out_current_ = p;
+bool RtmpContext::QueueEncoded(const PacketPtr &data, int32_t chunk_size)
+{
+    // 编码时的块大小必须与对端使用的一致
+    if (chunk_size != out_chunk_size_conf_)
+    {
+        return false;
+    }
 
-        // 更新之前的消息头信息
-        prev->cs_id = h->cs_id;
-        prev->msg_len = h->msg_len;
-        prev->msg_sid = h->msg_sid;
-        prev->msg_type = h->msg_type;
+    RtmpOutMessage msg;
+    msg.packet = data;
+    msg.cs_id = kRtmpCSIDVideo;
+    msg.encoded = true;
+    msg.msg_len = data->PacketSize();
 
-        // 更新时间戳
-        if (fmt == kRtmpFmt0)
-        {
-            prev->timestamp = timestamp;
-        }
-        else
-        {
-            prev->timestamp += timestamp;
-        }
+    out_queued_bytes_ += msg.msg_len;
+    out_video_queue_.emplace_back(std::move(msg));
+    return true;
+}
+
+bool RtmpContext::Ready() const
+{
+    // 没有在发送数据，且排队的媒体数据不足一批时，可以接收新的数据
+    return !sending_ && out_queued_bytes_ < (size_t)kSendQuantum;
+}
+
+uint32_t RtmpContext::SendRate() const
+{
+    // 返回发送速率的滑动平均值
+    return send_rate_;
+}
+
+int32_t RtmpContext::OutChunkSize() const
+{
+    return out_chunk_size_conf_;
+}
+
+void RtmpContext::SetOutChunkSize(int32_t size)
+{
+    // 块大小至少为 128，不超过消息长度的上限
+    size = std::max(128, std::min(size, 0xFFFFFF));
+
+    // 与已经通知对端的块大小相同，不需要重新协商
+    if (size == out_chunk_size_conf_)
+    {
+        return;
+    }
+
+    out_chunk_size_conf_ = size;
+    SendSetChunkSize();
+}
+
+void RtmpContext::SetAggregateSize(int32_t size)
+{
+    aggregate_size_ = std::max(0, size);
+}
 
-        // 处理消息体，将其分块并添加到发送缓冲区
-        const char *body = packet->Data();
-        int32_t bytes_parsed = 0;
+bool RtmpContext::BuildChunk(PacketPtr &&packet, uint32_t timestamp, bool fmt0)
+{
+    // 获取数据包中的 RTMP 消息头
+    RtmpMsgHeader *h = packet->MsgHeader();
+
+    // 获取之前的消息头，用于与当前消息头进行比较
+    RtmpMsgHeaderPtr &prev = out_message_headers_[h->cs_id];
+    // 检查是否使用时间戳增量（非格式0，之前的消息头存在，且时间戳合法，消息流ID相同）
+    bool use_delta = !fmt0 && prev && timestamp >= prev->timestamp && h->msg_sid == prev->msg_sid;
+
+    // 如果之前的消息头不存在，则初始化
+    if (!prev)
+    {
+        prev = std::make_shared<RtmpMsgHeader>();
+    }
 
-        while (true)
+    // 默认使用格式0
+    int fmt = kRtmpFmt0;
+
+    // 如果使用时间戳增量
+    if (use_delta)
+    {
+        // 使用格式1
+        fmt = kRtmpFmt1;
+
+        // 计算时间戳差值
+        timestamp -= prev->timestamp;
+
+        // 如果消息类型和长度相同，使用格式2
+        if (h->msg_type == prev->msg_type && h->msg_len == prev->msg_len)
         {
-            // 获取当前数据块
-            const char *chunk = body + bytes_parsed;
-            // 计算剩余的消息体长度
-            int32_t size = h->msg_len - bytes_parsed;
-            // 计算本次发送的数据块大小
-            size = std::min(size, out_chunk_size_);
-
-            // 创建数据块节点
-            BufferNodePtr node = std::make_shared<BufferNode>((void *)chunk, size);
-            // 添加到发送缓冲区
-            sending_bufs_.emplace_back(std::move(node));
-            // 更新已解析的字节数
-            bytes_parsed += size;
-
-            // 如果还有数据未发送完
-            if (bytes_parsed < h->msg_len)
+            fmt = kRtmpFmt2;
+
+            // 如果时间戳差值相同，使用格式3
+            if (timestamp == out_deltas_[h->cs_id])
             {
-                // 检查缓冲区是否足够
-                if (out_current_ - out_buffer_ >= 4096)
-                {
-                    // 缓冲区不足时输出错误信息
-                    RTMP_ERROR << " rtmp had no enough out header buffer.";
+                fmt = kRtmpFmt3;
+            }
+        }
+    }
 
-                    break;
-                }
+    // 获取写入块头的位置
+    char *p = HeaderBuffer(kMaxChunkHeaderSize);
+
+    // 如果 chunk stream ID 小于 64，直接使用单字节表示
+    if (h->cs_id < 64)
+    {
+        // 将 fmt 左移 6 位，然后与 cs_id 进行按位或操作，将结果存入 p，并且 p 指针自增
+        *p++ = (char)((fmt << 6) | h->cs_id);
+    }
+    // 如果 chunk stream ID 在 64 到 319 之间，使用两字节表示
+    else if (h->cs_id < (64 + 256))
+    {
+        *p++ = (char)((fmt << 6) | 0); // 第一字节：fmt 左移 6 位，与 0 进行按位或操作
+        *p++ = (char)(h->cs_id - 64); // 第二字节：存储 cs_id 减去 64 的值
+    }
+    // 如果 chunk stream ID 大于等于 320，使用三字节表示
+    else
+    {
+        *p++ = (char)((fmt << 6) | 1); // 第一字节：fmt 左移 6 位，与 1 进行按位或操作
+        uint16_t cs =
+            h->cs_id - 64; // 计算 cs_id 减去 64 的值，并将其存入一个 16 位无符号整数中
+        memcpy(p, &cs, sizeof(uint16_t)); // 将 cs 的内容复制到 p 所指向的位置
+        p += sizeof(uint16_t);            // p 指针向前移动 2 字节
+    }
 
-                // 获取当前缓冲区指针
-                char *p = out_current_;
+    // 设置时间戳变量
+    auto ts = timestamp;
 
-                // 对于不同的 cs_id 范围，分别使用不同的方式构建头部
-                // 如果 Chunk Stream ID (cs_id) 小于 64
-                if (h->cs_id < 64)
-                {
-                    // 将格式3的标志位与 cs_id 结合编码到一个字节中，并存入缓冲区，同时指针 p
-                    // 向后移动一位
-                    *p++ = (char)(0xC0 | h->cs_id);
-                }
-                // 如果 Chunk Stream ID (cs_id) 在 64 到 319 之间
-                else if (h->cs_id < (64 + 256))
-                {
-                    // 首先将格式3的标志位和高位部分0编码到一个字节中，并存入缓冲区，同时指针 p
-                    // 向后移动一位
-                    *p++ = (char)(0xC0 | 0);
-                    // 将 cs_id 减去 64 的结果编码到第二个字节中，并存入缓冲区，同时指针 p
-                    // 向后移动一位
-                    *p++ = (char)(h->cs_id - 64);
-                }
-                // 如果 Chunk Stream ID (cs_id) 大于等于 320
-                else
-                {
-                    // 首先将格式3的标志位和高位部分1编码到一个字节中，并存入缓冲区，同时指针 p
-                    // 向后移动一位
-                    *p++ = (char)(0xC0 | 1);
-                    // 计算出需要编码的 cs_id 值（减去 64）
-                    uint16_t cs = h->cs_id - 64;
-                    // 将这个 16 位的 cs_id 复制到缓冲区中
-                    memcpy(p, &cs, sizeof(uint16_t));
-                    // 指针 p 向后移动两个字节，为后续数据存储做准备
-                    p += sizeof(uint16_t);
-                }
+    // 如果时间戳超过最大值，设置为最大值
+    if (timestamp >= 0xFFFFFF)
+    {
+        ts = 0xFFFFFF;
+    }
 
-                // 如果时间戳为最大值，写入完整的时间戳
-                if (ts == 0xFFFFFF)
-                {
-                    memcpy(p, &timestamp, 4);
-                    p += 4;
-                }
+    // 根据格式不同，设置不同的消息头
+    if (fmt == kRtmpFmt0)
+    {
+        // 写入24位时间戳
+        p += BytesWriter::WriteUint24T(p, ts);
+        // 写入消息长度
+        p += BytesWriter::WriteUint24T(p, h->msg_len);
+        // 写入消息类型
+        p += BytesWriter::WriteUint8T(p, h->msg_type);
+
+        // 写入消息流 ID
+        memcpy(p, &h->msg_sid, 4);
+        p += 4;
+        // 重置增量时间戳
+        out_deltas_[h->cs_id] = 0;
+    }
+    else if (fmt == kRtmpFmt1)
+    {
+        // 写入24位时间戳
+        p += BytesWriter::WriteUint24T(p, ts);
+        // 写入消息长度
+        p += BytesWriter::WriteUint24T(p, h->msg_len);
+        // 写入消息类型
+        p += BytesWriter::WriteUint8T(p, h->msg_type);
+        // 更新增量时间戳
+        out_deltas_[h->cs_id] = timestamp;
+    }
+    else if (fmt == kRtmpFmt2)
+    {
+        // 写入24位时间戳
+        p += BytesWriter::WriteUint24T(p, ts);
+        // 更新增量时间戳
+        out_deltas_[h->cs_id] = timestamp;
+    }
+
+    // 如果时间戳为最大值，写入完整的时间戳
+    if (ts == 0xFFFFFF)
+    {
+        // 扩展时间戳按网络字节序写入
+        p += BytesWriter::WriteUint32T(p, timestamp);
+    }
+
+    // 创建并保存数据块头部
+    BufferNodePtr nheader =
+        std::make_shared<BufferNode>(out_current_, p - out_current_, HeaderOwner());
+    sending_bufs_.emplace_back(std::move(nheader));
+    out_current_ = p;
+
+    // 更新之前的消息头信息
+    prev->cs_id = h->cs_id;
+    prev->msg_len = h->msg_len;
+    prev->msg_sid = h->msg_sid;
+    prev->msg_type = h->msg_type;
+
+    // 更新时间戳
+    if (fmt == kRtmpFmt0)
+    {
+        prev->timestamp = timestamp;
+    }
+    else
+    {
+        prev->timestamp += timestamp;
+    }
 
-                // 创建并保存后续数据块头部
-                BufferNodePtr nheader =
-                    std::make_shared<BufferNode>(out_current_, p - out_current_);
-                sending_bufs_.emplace_back(std::move(nheader));
-                // 更新缓冲区指针
-                out_current_ = p;
+    // 处理消息体，将其分块并添加到发送缓冲区
+    const char *body = packet->Data();
+    int32_t bytes_parsed = 0;
+
+    while (true)
+    {
+        // 获取当前数据块
+        const char *chunk = body + bytes_parsed;
+        // 计算剩余的消息体长度
+        int32_t size = h->msg_len - bytes_parsed;
+        // 计算本次发送的数据块大小
+        size = std::min(size, out_chunk_size_);
+
+        // 创建数据块节点，节点持有数据包
+        BufferNodePtr node = std::make_shared<BufferNode>((void *)chunk, size, packet);
+        // 添加到发送缓冲区
+        sending_bufs_.emplace_back(std::move(node));
+        // 更新已解析的字节数
+        bytes_parsed += size;
+
+        // 如果还有数据未发送完
+        if (bytes_parsed < h->msg_len)
+        {
+            // 获取写入块头的位置，块头空间不足时自动切换到新的内存块
+            char *p = HeaderBuffer(kMaxChunkHeaderSize);
+
+            // 对于不同的 cs_id 范围，分别使用不同的方式构建头部
+            // 如果 Chunk Stream ID (cs_id) 小于 64
+            if (h->cs_id < 64)
+            {
+                // 将格式3的标志位与 cs_id 结合编码到一个字节中，并存入缓冲区，同时指针 p
+                // 向后移动一位
+                *p++ = (char)(0xC0 | h->cs_id);
+            }
+            // 如果 Chunk Stream ID (cs_id) 在 64 到 319 之间
+            else if (h->cs_id < (64 + 256))
+            {
+                // 首先将格式3的标志位和高位部分0编码到一个字节中，并存入缓冲区，同时指针 p
+                // 向后移动一位
+                *p++ = (char)(0xC0 | 0);
+                // 将 cs_id 减去 64 的结果编码到第二个字节中，并存入缓冲区，同时指针 p
+                // 向后移动一位
+                *p++ = (char)(h->cs_id - 64);
             }
+            // 如果 Chunk Stream ID (cs_id) 大于等于 320
             else
             {
-                // 数据发送完毕，退出循环
-                break;
+                // 首先将格式3的标志位和高位部分1编码到一个字节中，并存入缓冲区，同时指针 p
+                // 向后移动一位
+                *p++ = (char)(0xC0 | 1);
+                // 计算出需要编码的 cs_id 值（减去 64）
+                uint16_t cs = h->cs_id - 64;
+                // 将这个 16 位的 cs_id 复制到缓冲区中
+                memcpy(p, &cs, sizeof(uint16_t));
+                // 指针 p 向后移动两个字节，为后续数据存储做准备
+                p += sizeof(uint16_t);
             }
-        }
 
-        // 将数据包添加到正在发送的队列中
-        out_sending_packets_.emplace_back(std::move(packet));
+            // 如果时间戳为最大值，写入完整的时间戳
+            if (ts == 0xFFFFFF)
+            {
+                // 扩展时间戳按网络字节序写入
+                p += BytesWriter::WriteUint32T(p, timestamp);
+            }
 
-        // 构建成功，返回 true
-        return true;
+            // 创建并保存后续数据块头部
+            BufferNodePtr nheader =
+                std::make_shared<BufferNode>(out_current_, p - out_current_, HeaderOwner());
+            sending_bufs_.emplace_back(std::move(nheader));
+            // 更新缓冲区指针
+            out_current_ = p;
+        }
+        else
+        {
+            // 数据发送完毕，退出循环
+            break;
+        }
     }
 
-    // 消息头不存在，返回 false
-    return false;
+    // 构建成功，返回 true
+    return true;
 }
 
 void RtmpContext::CheckAndSend()
 {
+    // 本次发送完成，用发送字节数除以耗时得到发送速率，不足 1 毫秒按 1 毫秒计算
+    if (send_bytes_ > 0)
+    {
+        int64_t elapsed = std::max<int64_t>(tmms::base::TTime::NowMS() - send_time_, 1);
+        int64_t rate = send_bytes_ / elapsed;
+
+        // 滑动平均中新样本的权重为 1/4
+        send_rate_ = send_rate_ == 0 ? rate : send_rate_ + (rate - (int64_t)send_rate_) / 4;
+        send_bytes_ = 0;
+    }
+
     // 将发送标志设置为 false，表示当前不再发送数据
     sending_ = false;
-    // 重置当前缓冲区指针到缓冲区的起始位置
-    out_current_ = out_buffer_;
+    // 回收本批使用的块头内存块
+    ResetHeaderBuffer();
     // 清空正在发送的缓冲区
     sending_bufs_.clear();
-    // 清空正在发送的数据包列表
-    out_sending_packets_.clear();
 
-    // 如果等待发送队列不为空
-    if (!out_waiting_queue_.empty())
+    // 排队的媒体数据不多时，先让处理器补充新的数据，新到的音频可以排到积压的视频前面
+    if (rtmp_handler_ && Ready())
     {
-        // 调用 Send() 方法开始发送数据
-        Send();
-    }
-    else // 如果等待发送队列为空
-    {
-        // 检查是否存在 RTMP 处理器
-        if (rtmp_handler_)
-        {
-            // 调用处理器的 OnActive 方法，表示当前连接活跃
-            rtmp_handler_->OnActive(connection_);
-        }
+        // 调用处理器的 OnActive 方法，表示当前连接活跃
+        rtmp_handler_->OnActive(connection_);
     }
+
+    // 继续发送控制消息和积压的媒体数据，处理器已经发起了发送时直接返回
+    Send();
 }
 
 void RtmpContext::PushOutQueue(PacketPtr &&packet)
@@ -1128,31 +1553,26 @@ void RtmpContext::SendSetChunkSize()
     // 创建一个新的数据包，初始大小为 64 字节
     PacketPtr packet = Packet::NewPacket(64);
 
-    // 创建一个 RTMP 消息头的共享指针
-    RtmpMsgHeaderPtr header = std::make_shared<RtmpMsgHeader>();
+    // 使用数据包内嵌的 RTMP 消息头
+    RtmpMsgHeader *header = packet->MsgHeader();
 
-    // 如果消息头创建成功
-    if (header)
-    {
-        header->cs_id = kRtmpCSIDCommand; // 设置 Chunk Stream ID 为 RTMP 命令类型的固定 ID
-        header->msg_len = 0;              // 初始化消息长度为 0，稍后会设置
-        header->msg_type = kRtmpMsgTypeChunkSize; // 设置消息类型为设置 Chunk Size 类型
-        header->timestamp = 0;                    // 设置时间戳为 0
-        header->msg_sid = kRtmpMsID0; // 设置消息 Stream ID 为 0，表示系统控制消息
-        packet->SetExt(header);       // 将消息头附加到数据包中
-    }
+    header->cs_id = kRtmpCSIDCommand; // 设置 Chunk Stream ID 为 RTMP 命令类型的固定 ID
+    header->msg_len = 0;              // 初始化消息长度为 0，稍后会设置
+    header->msg_type = kRtmpMsgTypeChunkSize; // 设置消息类型为设置 Chunk Size 类型
+    header->timestamp = 0;                    // 设置时间戳为 0
+    header->msg_sid = kRtmpMsID0; // 设置消息 Stream ID 为 0，表示系统控制消息
 
     // 获取数据包的指针
     char *body = packet->Data();
 
-    // 将当前的 Chunk Size 写入到数据包的 body 部分
-    header->msg_len = BytesWriter::WriteUint32T(body, out_chunk_size_);
+    // 将要通知对端的 Chunk Size 写入到数据包的 body 部分，该消息写出后才生效
+    header->msg_len = BytesWriter::WriteUint32T(body, out_chunk_size_conf_);
 
     // 设置数据包的实际大小
     packet->SetPacketSize(header->msg_len);
 
     // 打印调试信息，输出当前发送的 Chunk Size 以及目标主机的 IP 和端口
-    RTMP_DEBUG << " send chuck size : " << out_chunk_size_
+    RTMP_DEBUG << " send chuck size : " << out_chunk_size_conf_
                << " to host : " << connection_->PeerAddr().ToIpPort();
 
     // 将数据包放入发送队列，并触发发送
@@ -1164,19 +1584,14 @@ void RtmpContext::SendAckWindowSize()
     // 创建一个新的数据包，初始大小为 64 字节
     PacketPtr packet = Packet::NewPacket(64);
 
-    // 创建一个 RTMP 消息头的共享指针
-    RtmpMsgHeaderPtr header = std::make_shared<RtmpMsgHeader>();
+    // 使用数据包内嵌的 RTMP 消息头
+    RtmpMsgHeader *header = packet->MsgHeader();
 
-    // 如果消息头创建成功
-    if (header)
-    {
-        header->cs_id = kRtmpCSIDCommand; // 设置 Chunk Stream ID 为 RTMP 命令类型的固定 ID
-        header->msg_len = 0;              // 初始化消息长度为 0，稍后会设置
-        header->msg_type = kRtmpMsgTypeWindowACKSize; // 设置消息类型为窗口确认大小
-        header->timestamp = 0;                        // 设置时间戳为 0
-        header->msg_sid = kRtmpMsID0; // 设置消息 Stream ID 为 0，表示系统控制消息
-        packet->SetExt(header);       // 将消息头附加到数据包中
-    }
+    header->cs_id = kRtmpCSIDCommand; // 设置 Chunk Stream ID 为 RTMP 命令类型的固定 ID
+    header->msg_len = 0;              // 初始化消息长度为 0，稍后会设置
+    header->msg_type = kRtmpMsgTypeWindowACKSize; // 设置消息类型为窗口确认大小
+    header->timestamp = 0;                        // 设置时间戳为 0
+    header->msg_sid = kRtmpMsID0; // 设置消息 Stream ID 为 0，表示系统控制消息
 
     // 获取数据包的指针，用于写入数据
     char *body = packet->Data();
@@ -1200,18 +1615,14 @@ void RtmpContext::SendSetPeerBandwidth()
     // 创建一个新的数据包，初始大小为 64 字节
     PacketPtr packet = Packet::NewPacket(64);
 
-    // 创建一个 RTMP 消息头的共享指针
-    RtmpMsgHeaderPtr header = std::make_shared<RtmpMsgHeader>();
+    // 使用数据包内嵌的 RTMP 消息头
+    RtmpMsgHeader *header = packet->MsgHeader();
 
-    if (header) // 如果消息头创建成功
-    {
-        header->cs_id = kRtmpCSIDCommand; // 设置 Chunk Stream ID 为 RTMP 命令类型的固定 ID
-        header->msg_len = 0;              // 初始化消息长度为 0，稍后会设置
-        header->msg_type = kRtmpMsgTypeSetPeerBW; // 设置消息类型为 Set Peer Bandwidth
-        header->timestamp = 0;                    // 设置时间戳为 0
-        header->msg_sid = kRtmpMsID0; // 设置消息 Stream ID 为 0，表示系统控制消息
-        packet->SetExt(header);       // 将消息头附加到数据包中
-    }
+    header->cs_id = kRtmpCSIDCommand; // 设置 Chunk Stream ID 为 RTMP 命令类型的固定 ID
+    header->msg_len = 0;              // 初始化消息长度为 0，稍后会设置
+    header->msg_type = kRtmpMsgTypeSetPeerBW; // 设置消息类型为 Set Peer Bandwidth
+    header->timestamp = 0;                    // 设置时间戳为 0
+    header->msg_sid = kRtmpMsID0; // 设置消息 Stream ID 为 0，表示系统控制消息
 
     // 获取数据包的指针，用于写入数据
     char *body = packet->Data();
@@ -1243,20 +1654,15 @@ void RtmpContext::SendBytesRecv()
         // 创建一个新的数据包，初始大小为 64 字节
         PacketPtr packet = Packet::NewPacket(64);
 
-        // 创建一个 RTMP 消息头的共享指针
-        RtmpMsgHeaderPtr header = std::make_shared<RtmpMsgHeader>();
+        // 使用数据包内嵌的 RTMP 消息头
+        RtmpMsgHeader *header = packet->MsgHeader();
 
-        // 如果消息头创建成功
-        if (header)
-        {
-            header->cs_id = kRtmpCSIDCommand; // 设置 Chunk Stream ID 为 RTMP 命令类型的固定 ID
-            header->msg_len = 0;              // 初始化消息长度为 0，稍后会设置
-            header->msg_type =
-                kRtmpMsgTypeBytesRead;    // 设置消息类型为 Bytes Received (BytesRead) 消息
-            header->timestamp = 0;        // 设置时间戳为 0
-            header->msg_sid = kRtmpMsID0; // 设置消息 Stream ID 为 0，表示系统控制消息
-            packet->SetExt(header);       // 将消息头附加到数据包中
-        }
+        header->cs_id = kRtmpCSIDCommand; // 设置 Chunk Stream ID 为 RTMP 命令类型的固定 ID
+        header->msg_len = 0;              // 初始化消息长度为 0，稍后会设置
+        header->msg_type =
+            kRtmpMsgTypeBytesRead;    // 设置消息类型为 Bytes Received (BytesRead) 消息
+        header->timestamp = 0;        // 设置时间戳为 0
+        header->msg_sid = kRtmpMsID0; // 设置消息 Stream ID 为 0，表示系统控制消息
 
         // 获取数据包的指针，用于写入数据
         char *body = packet->Data();
@@ -1283,19 +1689,14 @@ void RtmpContext::SendUserCtrlMessage(short nType, uint32_t value1, uint32_t val
     // 创建一个新的数据包，初始大小为 64 字节
     PacketPtr packet = Packet::NewPacket(64);
 
-    // 创建一个 RTMP 消息头的共享指针
-    RtmpMsgHeaderPtr header = std::make_shared<RtmpMsgHeader>();
+    // 使用数据包内嵌的 RTMP 消息头
+    RtmpMsgHeader *header = packet->MsgHeader();
 
-    // 如果消息头创建成功
-    if (header)
-    {
-        header->cs_id = kRtmpCSIDCommand; // 设置 Chunk Stream ID 为 RTMP 命令类型的固定 ID
-        header->msg_len = 0; // 初始化消息长度为 0，稍后会根据写入的数据内容进行设置
-        header->msg_type = kRtmpMsgTypeUserControl; // 设置消息类型为 User Control Message
-        header->timestamp = 0;                      // 设置时间戳为 0
-        header->msg_sid = kRtmpMsID0; // 设置消息 Stream ID 为 0，表示系统控制消息
-        packet->SetExt(header);       // 将消息头附加到数据包中
-    }
+    header->cs_id = kRtmpCSIDCommand; // 设置 Chunk Stream ID 为 RTMP 命令类型的固定 ID
+    header->msg_len = 0; // 初始化消息长度为 0，稍后会根据写入的数据内容进行设置
+    header->msg_type = kRtmpMsgTypeUserControl; // 设置消息类型为 User Control Message
+    header->timestamp = 0;                      // 设置时间戳为 0
+    header->msg_sid = kRtmpMsID0; // 设置消息 Stream ID 为 0，表示系统控制消息
 
     // 获取数据包的指针，用于写入数据
     char *body = packet->Data();
@@ -1332,12 +1733,20 @@ void RtmpContext::HandleChunkSize(PacketPtr &packet)
     if (packet->PacketSize() >= 4)
     {
         // 从数据包的内容中读取 4 字节无符号整数，即 Chunk Size 的新值
-        auto size = BytesReader::ReadUint32T(packet->Data());
+        // 最高位保留为 0
+        auto size = BytesReader::ReadUint32T(packet->Data()) & 0x7FFFFFFF;
 
         // 输出调试信息，显示当前的 Chunk Size 以及即将更新的新值
         RTMP_DEBUG << " recv chunk size in_chunk_size : " << in_chunk_size_
                    << " change to : " << size;
 
+        // 块大小为 0 时无法继续解析，忽略该消息
+        if (size == 0)
+        {
+            RTMP_ERROR << " invalid chunk size 0 host : " << connection_->PeerAddr().ToIpPort();
+            return;
+        }
+
         // 更新当前的 Chunk Size 值
         in_chunk_size_ = size;
     }
@@ -1458,6 +1867,64 @@ void RtmpContext::HandleUserMessage(PacketPtr &packet)
     }
 }
 
+void RtmpContext::HandleAggregate(PacketPtr &packet)
+{
+    const RtmpMsgHeader *agg = packet->MsgHeader();
+    const char *p = packet->Data();
+    int32_t left = packet->PacketSize();
+    bool first = true;
+    uint32_t base = 0;
+
+    // 依次取出子消息：11 字节的标签头、消息体、4 字节的反向指针
+    while (left >= 11)
+    {
+        uint8_t type = BytesReader::ReadUint8T(p);
+        int32_t size = BytesReader::ReadUint24T(p + 1);
+        uint32_t ts = BytesReader::ReadUint24T(p + 4) | ((uint32_t)(uint8_t)p[7] << 24);
+        if (size > left - 11)
+        {
+            RTMP_ERROR << " aggregate sub message out of range, type : " << (int)type
+                       << " size : " << size << " left : " << left;
+            break;
+        }
+
+        // 子消息的时间戳是相对的，以聚合消息的时间戳加上与第一个子消息的时间差为准
+        if (first)
+        {
+            base = ts;
+            first = false;
+        }
+
+        if (type == kRtmpMsgTypeAudio || type == kRtmpMsgTypeVideo ||
+            type == kRtmpMsgTypeAMFMeta || type == kRtmpMsgTypeAMF3Meta)
+        {
+            PacketPtr sub = Packet::NewPacket(size);
+            RtmpMsgHeader *header = sub->MsgHeader();
+            header->cs_id = agg->cs_id;
+            header->timestamp = agg->timestamp + (ts - base);
+            header->msg_len = size;
+            header->msg_type = type;
+            header->msg_sid = agg->msg_sid;
+            memcpy(sub->Data(), p + 11, size);
+            sub->SetPacketSize(size);
+            sub->SetPacketType(type);
+            sub->SetTimeStamp(header->timestamp);
+            MessageComplete(std::move(sub));
+        }
+        else
+        {
+            RTMP_ERROR << " not surpport aggregate sub message type : " << (int)type;
+        }
+
+        // 跳过消息体和反向指针
+        p += 11 + size;
+        left -= 11 + size;
+        int32_t back = std::min(left, 4);
+        p += back;
+        left -= back;
+    }
+}
+
 void RtmpContext::HandleAmfCommand(PacketPtr &data, bool amf3)
 {
     // 打印 AMF 消息的长度和来源主机地址
@@ -1523,8 +1990,8 @@ void RtmpContext::SendConnect()
     // 创建一个新的Packet，大小为1024字节
     PacketPtr packet = Packet::NewPacket(1024);
 
-    // 创建一个新的RTMP消息头对象，并初始化头部信息
-    RtmpMsgHeaderPtr header = std::make_shared<RtmpMsgHeader>();
+    // 使用数据包内嵌的 RTMP 消息头
+    RtmpMsgHeader *header = packet->MsgHeader();
 
     // 设置Chunk Stream ID为AMF初始化流的ID
     header->cs_id = kRtmpCSIDAMFIni;
@@ -1538,8 +2005,6 @@ void RtmpContext::SendConnect()
     // 设置消息类型为AMF消息
     header->msg_type = kRtmpMsgTypeAMFMessage;
 
-    // 将消息头部设置到Packet中
-    packet->SetExt(header);
 
     // 获取Packet的Data指针，指向消息体的开始位置
     char *body = packet->Data();
@@ -1631,8 +2096,8 @@ void RtmpContext::HandleConnect(AMFObject &obj)
     // 创建一个新的Packet，大小为1024字节
     PacketPtr packet = Packet::NewPacket(1024);
 
-    // 创建一个新的RTMP消息头对象，并初始化头部信息
-    RtmpMsgHeaderPtr header = std::make_shared<RtmpMsgHeader>();
+    // 使用数据包内嵌的 RTMP 消息头
+    RtmpMsgHeader *header = packet->MsgHeader();
 
     // 设置Chunk Stream ID为AMF初始化流的ID
     header->cs_id = kRtmpCSIDAMFIni;
@@ -1646,8 +2111,6 @@ void RtmpContext::HandleConnect(AMFObject &obj)
     // 设置消息类型为AMF消息
     header->msg_type = kRtmpMsgTypeAMFMessage;
 
-    // 将消息头部设置到Packet中
-    packet->SetExt(header);
 
     // 获取Packet的Data指针，指向消息体的开始位置
     char *body = packet->Data();
@@ -1712,8 +2175,8 @@ void RtmpContext::SendCreateStream()
     // 创建一个新的Packet，大小为1024字节
     PacketPtr packet = Packet::NewPacket(1024);
 
-    // 创建一个新的RTMP消息头对象，并初始化头部信息
-    RtmpMsgHeaderPtr header = std::make_shared<RtmpMsgHeader>();
+    // 使用数据包内嵌的 RTMP 消息头
+    RtmpMsgHeader *header = packet->MsgHeader();
 
     // 设置Chunk Stream ID为AMF初始化流的ID
     header->cs_id = kRtmpCSIDAMFIni;
@@ -1727,8 +2190,6 @@ void RtmpContext::SendCreateStream()
     // 设置消息类型为AMF消息
     header->msg_type = kRtmpMsgTypeAMFMessage;
 
-    // 将消息头部设置到Packet中
-    packet->SetExt(header);
 
     // 获取Packet的Data指针，指向消息体的开始位置
     char *body = packet->Data();
@@ -1765,8 +2226,8 @@ void RtmpContext::HandleCreateStream(AMFObject &obj)
     // 创建一个新的Packet，大小为1024字节
     PacketPtr packet = Packet::NewPacket(1024);
 
-    // 创建一个新的RTMP消息头对象，并初始化头部信息
-    RtmpMsgHeaderPtr header = std::make_shared<RtmpMsgHeader>();
+    // 使用数据包内嵌的 RTMP 消息头
+    RtmpMsgHeader *header = packet->MsgHeader();
 
     // 设置Chunk Stream ID为AMF初始化流的ID
     header->cs_id = kRtmpCSIDAMFIni;
@@ -1780,8 +2241,6 @@ void RtmpContext::HandleCreateStream(AMFObject &obj)
     // 设置消息类型为AMF消息
     header->msg_type = kRtmpMsgTypeAMFMessage;
 
-    // 将消息头部设置到Packet中
-    packet->SetExt(header);
 
     // 获取Packet的Data指针，指向消息体的开始位置
     char *body = packet->Data();
@@ -1819,8 +2278,8 @@ void RtmpContext::SendStatus(const std::string &level, const std::string &code,
     // 创建一个新的Packet对象，大小为1024字节
     PacketPtr packet = Packet::NewPacket(1024);
 
-    // 创建一个新的RTMP消息头对象，并初始化头部信息
-    RtmpMsgHeaderPtr header = std::make_shared<RtmpMsgHeader>();
+    // 使用数据包内嵌的 RTMP 消息头
+    RtmpMsgHeader *header = packet->MsgHeader();
 
     // 设置Chunk Stream ID为AMF初始化流的ID
     header->cs_id = kRtmpCSIDAMFIni;
@@ -1834,8 +2293,6 @@ void RtmpContext::SendStatus(const std::string &level, const std::string &code,
     // 设置消息类型为AMF消息
     header->msg_type = kRtmpMsgTypeAMFMessage;
 
-    // 将消息头部设置到Packet中
-    packet->SetExt(header);
 
     // 获取Packet的Data指针，指向消息体的开始位置
     char *body = packet->Data();
@@ -1886,8 +2343,8 @@ void RtmpContext::SendPlay()
     // 创建一个新的Packet对象，大小为1024字节
     PacketPtr packet = Packet::NewPacket(1024);
 
-    // 创建一个新的RTMP消息头对象，并初始化头部信息
-    RtmpMsgHeaderPtr header = std::make_shared<RtmpMsgHeader>();
+    // 使用数据包内嵌的 RTMP 消息头
+    RtmpMsgHeader *header = packet->MsgHeader();
 
     // 设置Chunk Stream ID为AMF初始化流的ID
     header->cs_id = kRtmpCSIDAMFIni;
@@ -1901,8 +2358,6 @@ void RtmpContext::SendPlay()
     // 设置消息类型为AMF消息
     header->msg_type = kRtmpMsgTypeAMFMessage;
 
-    // 将消息头部设置到Packet中
-    packet->SetExt(header);
 
     // 获取Packet的Data指针，指向消息体的开始位置
     char *body = packet->Data();
@@ -1955,6 +2410,10 @@ void RtmpContext::HandlePlay(AMFObject &obj)
     // 设置is_player_为true，表示当前连接为播放端
     is_player_ = true;
 
+    // 限制内核中尚未发送的数据量，积压的数据留在发送队列中按优先级调度
+    SocketOpt opt(connection_->Fd());
+    opt.SetNotSentLowat(kSendQuantum);
+
     // 发送Stream Begin用户控制消息，通知客户端流已经开始
     SendUserCtrlMessage(kRtmpEventTypeStreamBegin, 1, 0);
 
@@ -2040,8 +2499,8 @@ void RtmpContext::SendPublish()
     // 创建一个新的数据包，大小为1024字节
     PacketPtr packet = Packet::NewPacket(1024);
 
-    // 创建一个新的RTMP消息头对象
-    RtmpMsgHeaderPtr header = std::make_shared<RtmpMsgHeader>();
+    // 使用数据包内嵌的 RTMP 消息头
+    RtmpMsgHeader *header = packet->MsgHeader();
 
     // 设置消息头的各个字段
     header->cs_id = kRtmpCSIDAMFIni;           // 设置控制消息的CSID为AMF初始化
@@ -2049,8 +2508,6 @@ void RtmpContext::SendPublish()
     header->msg_len = 0;                       // 初始消息长度为0
     header->msg_type = kRtmpMsgTypeAMFMessage; // 设置消息类型为AMF消息
 
-    // 将消息头附加到数据包中
-    packet->SetExt(header);
 
     // 获取数据包的内容区域
     char *body = packet->Data();
@@ -140,26 +140,51 @@ void MsgBuffer::RetrieveAll()
 ssize_t MsgBuffer::ReadFd(int fd, int *retErrno)
 {
     char extBuffer[8192];
-    struct iovec vec[2];
+    struct iovec vec[3];
+    int iovcnt = 0;
+
+    // 缓冲区为空且设置了读取目标时，数据先读入目标内存
+    size_t direct = 0;
+    if (target_ && target_read_ == 0 && ReadableBytes() == 0)
+    {
+        direct = target_len_;
+        vec[iovcnt].iov_base = target_;
+        vec[iovcnt].iov_len = direct;
+        iovcnt++;
+    }
+
     size_t writable = WritableBytes();
-    vec[0].iov_base = begin() + tail_;
-    vec[0].iov_len = static_cast<int>(writable);
-    vec[1].iov_base = extBuffer;
-    vec[1].iov_len = sizeof(extBuffer);
-    const int iovcnt = (writable < sizeof extBuffer) ? 2 : 1;
+    vec[iovcnt].iov_base = begin() + tail_;
+    vec[iovcnt].iov_len = static_cast<int>(writable);
+    iovcnt++;
+    if (writable < sizeof extBuffer)
+    {
+        vec[iovcnt].iov_base = extBuffer;
+        vec[iovcnt].iov_len = sizeof(extBuffer);
+        iovcnt++;
+    }
+
     ssize_t n = ::readv(fd, vec, iovcnt);
     if (n < 0)
     {
         *retErrno = errno;
+        return n;
     }
-    else if (static_cast<size_t>(n) <= writable)
+
+    // 读取目标只对本次读取有效
+    target_ = nullptr;
+    target_len_ = 0;
+    target_read_ = std::min(static_cast<size_t>(n), direct);
+
+    size_t left = n - target_read_;
+    if (left <= writable)
     {
-        tail_ += n;
+        tail_ += left;
     }
     else
     {
         tail_ = buffer_.size();
-        Append(extBuffer, n - writable);
+        Append(extBuffer, left - writable);
     }
     return n;
 }
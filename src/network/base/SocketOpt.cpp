@@ -158,6 +158,16 @@ void SocketOpt::SetTcpNoDelay(bool on)
     ::setsockopt(sock_, IPPROTO_TCP, TCP_NODELAY, &optvalue, sizeof(optvalue));
 }
 
+void SocketOpt::SetNotSentLowat(int bytes)
+{
+    ::setsockopt(sock_, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &bytes, sizeof(bytes));
+}
+
+void SocketOpt::SetMaxPacingRate(uint32_t rate)
+{
+    ::setsockopt(sock_, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate));
+}
+
 void SocketOpt::SetReuseAddr(bool on)
 {
     int optvalue = on ? 1 : 0;
@@ -28,6 +28,11 @@ int Event::Fd() const
     return fd_;
 }
 
+EventLoop *Event::Loop() const
+{
+    return loop_;
+}
+
 void Event::Close()
 {
     // 文件描述符大于 0 ，关闭并恢复初始化值
@@ -1,13 +1,12 @@
 #include "EventLoop.h"
 #include "Event.h"
 #include "NetWork.h"
-#include "PipeEvent.h"
 #include "TTime.h"
+#include <algorithm>
 #include <asm-generic/socket.h>
 #include <cstdint>
 #include <cstring>
 #include <fcntl.h>
-#include <mutex>
 #include <sys/epoll.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -22,6 +21,11 @@ EventLoop::EventLoop() : epoll_fd_(::epoll_create(1024)), epoll_events_(1024)
         exit(-1);
     }
     t_local_eventloop = this;
+    now_ms_ = tmms::base::TTime::NowMS();
+
+    // 唤醒事件在构造时注册，其他线程可以在事件循环开始之前投递任务
+    wakeup_event_ = std::make_shared<WakeupEvent>(this);
+    AddEvent(wakeup_event_);
 }
 
 EventLoop::~EventLoop()
@@ -32,27 +36,29 @@ EventLoop::~EventLoop()
 void EventLoop::Loop()
 {
     lopping_ = true;
-    int64_t timeout = 1000;
     while (lopping_)
     {
-        memset(&epoll_events_[0], 0x00, sizeof(struct epoll_event) * epoll_events_.size());
+        // 等待到下一个定时器到期，没有定时器时最多等待 kMaxPollTimeout
+        int64_t timeout = wheel_.NextTimeout(tmms::base::TTime::NowMS(), kMaxPollTimeout);
         int ret = ::epoll_wait(epoll_fd_, (struct epoll_event *)&epoll_events_[0],
                                static_cast<int>(epoll_events_.size()), timeout);
+        now_ms_ = tmms::base::TTime::NowMS();
         if (ret >= 0)
         {
             for (int i = 0; i < ret; ++i)
             {
                 struct epoll_event &ev = epoll_events_[i];
-                if (ev.data.fd <= 0)
-                {
-                    continue;
-                }
-                auto iter = events_.find(ev.data.fd);
-                if (iter == events_.end())
+
+                // 低 32 位为文件描述符，高 32 位为注册序号。同一批事件中之前的回调可能已经删除了该事件，
+                // 甚至复用了文件描述符注册新的事件，序号不一致时是残留的通知
+                EventSlot *slot = FindSlot((int)(uint32_t)ev.data.u64);
+                if (!slot || slot->seq != (uint32_t)(ev.data.u64 >> 32))
                 {
                     continue;
                 }
-                EventPtr &event = iter->second;
+
+                // 回调中可能删除自身或扩充事件表，持有事件保证回调期间有效
+                EventPtr event = slot->event;
                 if (ev.events & EPOLLERR)
                 {
                     int error = 0;
@@ -79,8 +85,8 @@ void EventLoop::Loop()
                 epoll_events_.resize(epoll_events_.size() * 2);
             }
             RunFunctions();
-            int64_t now = tmms::base::TTime::NowMS();
-            wheel_.OnTimer(now);
+            now_ms_ = tmms::base::TTime::NowMS();
+            wheel_.OnTimer(now_ms_);
         }
         else if (ret < 0)
         {
@@ -98,21 +104,54 @@ void EventLoop::Quit()
     lopping_ = false;
 }
 
+EventSlot *EventLoop::FindSlot(int fd)
+{
+    if (fd < 0 || fd >= (int)events_.size() || !events_[fd].event)
+    {
+        return nullptr;
+    }
+    return &events_[fd];
+}
+
+EventSlot *EventLoop::FindSlot(const EventPtr &event)
+{
+    EventSlot *slot = FindSlot(event->Fd());
+    if (!slot || slot->event.get() != event.get())
+    {
+        return nullptr;
+    }
+    return slot;
+}
+
+int EventLoop::UpdateEvent(int op, const EventSlot &slot)
+{
+    struct epoll_event ev;
+    memset(&ev, 0x00, sizeof(struct epoll_event));
+    ev.events = slot.event->events_;
+    ev.data.u64 = ((uint64_t)slot.seq << 32) | (uint32_t)slot.event->fd_;
+    return epoll_ctl(epoll_fd_, op, slot.event->fd_, &ev);
+}
+
 void EventLoop::AddEvent(const EventPtr &event)
 {
-    auto iter = events_.find(event->Fd());
-    if (iter != events_.end())
+    int fd = event->Fd();
+    if (fd < 0 || FindSlot(fd))
     {
         return;
     }
     event->events_ |= kEventRead;
-    events_[event->Fd()] = event;
 
-    struct epoll_event ev;
-    memset(&ev, 0x00, sizeof(struct epoll_event));
-    ev.events = event->events_;
-    ev.data.fd = event->fd_;
-    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event->fd_, &ev) == -1)
+    // 事件表按文件描述符扩充，文件描述符总是从最小的可用值分配，表不会过于稀疏
+    if (fd >= (int)events_.size())
+    {
+        events_.resize(std::max<size_t>(fd + 1, events_.size() * 2));
+    }
+    EventSlot &slot = events_[fd];
+    slot.event = event;
+    slot.seq = event_seq_++;
+    event_count_++;
+
+    if (UpdateEvent(EPOLL_CTL_ADD, slot) == -1)
     {
         NETWORK_ERROR << "epoll_ctl add error: " << strerror(errno);
         exit(-1);
@@ -121,27 +160,23 @@ void EventLoop::AddEvent(const EventPtr &event)
 
 void EventLoop::DelEvent(const EventPtr &event)
 {
-    auto iter = events_.find(event->Fd());
-    if (iter == events_.end())
+    EventSlot *slot = FindSlot(event);
+    if (!slot)
     {
         return;
     }
-    events_.erase(iter);
-
-    struct epoll_event ev;
-    memset(&ev, 0x00, sizeof(ev));
-    ev.events = event->events_;
-    ev.data.fd = event->Fd();
-    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, event->fd_, &ev);
+    UpdateEvent(EPOLL_CTL_DEL, *slot);
+    slot->event.reset();
+    event_count_--;
 }
 
 bool EventLoop::EnableEventReading(const EventPtr &event, bool enable)
 {
-    auto iter = events_.find(event->Fd());
-    if (iter == events_.end())
+    EventSlot *slot = FindSlot(event);
+    if (!slot)
     {
         NETWORK_ERROR << "event fd:" << event->Fd() << " not exist, enable:" << enable 
-                     << ", events size:" << events_.size();
+                     << ", events size:" << event_count_;
         return false;
     }
 
@@ -154,18 +189,14 @@ bool EventLoop::EnableEventReading(const EventPtr &event, bool enable)
         event->events_ &= ~kEventRead;
     }
 
-    struct epoll_event ev;
-    memset(&ev, 0x00, sizeof(struct epoll_event));
-    ev.events = event->events_;
-    ev.data.fd = event->fd_;
-    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, event->fd_, &ev);
+    UpdateEvent(EPOLL_CTL_MOD, *slot);
     return true;
 }
 
 bool EventLoop::EnableEventWriting(const EventPtr &event, bool enable)
 {
-    auto iter = events_.find(event->Fd());
-    if (iter == events_.end())
+    EventSlot *slot = FindSlot(event);
+    if (!slot)
     {
         NETWORK_ERROR << "event fd:" << event->Fd() << " not exist";
         return false;
@@ -180,11 +211,7 @@ bool EventLoop::EnableEventWriting(const EventPtr &event, bool enable)
         event->events_ &= ~kEventWrite;
     }
 
-    struct epoll_event ev;
-    memset(&ev, 0x00, sizeof(struct epoll_event));
-    ev.events = event->events_;
-    ev.data.fd = event->Fd();
-    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, event->fd_, &ev);
+    UpdateEvent(EPOLL_CTL_MOD, *slot);
     return true;
 }
 
@@ -202,114 +229,101 @@ bool EventLoop::IsInLoopThread() const
     return t_local_eventloop == this;
 }
 
-void EventLoop::RunInLoop(const Func &func)
+void EventLoop::RunFunctions()
 {
-    if (IsInLoopThread())
-    {
-        func();
-    }
-    else
-    {
-        std::lock_guard<std::mutex> lk(lock_);
-        functions_.push(func);
-
-        WakeUp();
-    }
+    // 先清除唤醒标志再取走任务，之后投递的任务会重新唤醒，不会被遗漏
+    wakeup_pending_.store(false, std::memory_order_seq_cst);
+    tasks_.RunAll();
 }
 
-void EventLoop::RunInLoop(Func &&func)
+void EventLoop::WakeUp()
 {
-    if (IsInLoopThread())
-    {
-        func();
-    }
-    else
+    // 已有未处理的唤醒时，事件循环处理它时会执行刚投递的任务
+    if (!wakeup_pending_.exchange(true, std::memory_order_seq_cst))
     {
-        std::lock_guard<std::mutex> lk(lock_);
-        functions_.push(std::move(func));
-
-        WakeUp();
+        wakeup_event_->Notify();
     }
 }
 
-void EventLoop::RunFunctions()
+int64_t EventLoop::NowMS() const
 {
-    std::lock_guard<std::mutex> lk(lock_);
-    while (!functions_.empty())
-    {
-        auto &func = functions_.front();
-        func();
-        functions_.pop();
-    }
+    return now_ms_;
 }
 
-void EventLoop::WakeUp()
+EventLoop *EventLoop::Current()
 {
-    if (!pipe_event_)
-    {
-        pipe_event_ = std::make_shared<PipeEvent>(this);
-        AddEvent(pipe_event_);
-    }
-    int64_t tmp = 1;
-    pipe_event_->Write((const char *)&tmp, sizeof(tmp));
+    return t_local_eventloop;
 }
 
 void EventLoop::InsertEntry(uint32_t delay, EntryPtr entryPty)
 {
     if (IsInLoopThread())
     {
-        wheel_.InsertEntry(delay, entryPty);
+        wheel_.InsertEntry(delay, std::move(entryPty), tmms::base::TTime::NowMS());
     }
     else
     {
-        RunInLoop([this, delay, entryPty]() { wheel_.InsertEntry(delay, entryPty); });
+        RunInLoop([this, delay, entryPty]() {
+            wheel_.InsertEntry(delay, entryPty, tmms::base::TTime::NowMS());
+        });
     }
 }
 
-void EventLoop::RunAfter(double delay, const Func &cb)
+void EventLoop::AddTimer(const TimerPtr &timer, int64_t delay)
 {
     if (IsInLoopThread())
     {
-        wheel_.RunAfter(delay, cb);
+        wheel_.AddTimer(timer, delay, tmms::base::TTime::NowMS());
     }
     else
     {
-        RunInLoop([this, delay, cb]() { wheel_.RunAfter(delay, cb); });
+        // 延迟从投递时开始计算，扣除在任务队列中等待的时间
+        auto deadline = tmms::base::TTime::NowMS() + delay;
+        RunInLoop([this, timer, deadline]() {
+            auto now = tmms::base::TTime::NowMS();
+            wheel_.AddTimer(timer, deadline - now, now);
+        });
     }
 }
 
-void EventLoop::RunAfter(double delay, Func &&cb)
+void EventLoop::CancelTimer(const TimerPtr &timer)
 {
     if (IsInLoopThread())
     {
-        wheel_.RunAfter(delay, cb);
+        wheel_.CancelTimer(timer);
     }
     else
     {
-        RunInLoop([this, delay, cb]() { wheel_.RunAfter(delay, cb); });
+        RunInLoop([this, timer]() { wheel_.CancelTimer(timer); });
     }
 }
 
-void EventLoop::RunEvery(double interval, const Func &cb)
+TimerPtr EventLoop::RunAfter(double delay, const Func &cb)
 {
-    if (IsInLoopThread())
-    {
-        wheel_.RunEvery(interval, cb);
-    }
-    else
-    {
-        RunInLoop([this, interval, cb]() { wheel_.RunEvery(interval, cb); });
-    }
+    auto timer = std::make_shared<Timer>(cb);
+    AddTimer(timer, static_cast<int64_t>(delay * 1000));
+    return timer;
 }
 
-void EventLoop::RunEvery(double interval, Func &&cb)
+TimerPtr EventLoop::RunAfter(double delay, Func &&cb)
 {
-    if (IsInLoopThread())
-    {
-        wheel_.RunEvery(interval, cb);
-    }
-    else
-    {
-        RunInLoop([this, interval, cb]() { wheel_.RunEvery(interval, cb); });
-    }
-}
\ No newline at end of file
+    auto timer = std::make_shared<Timer>(std::move(cb));
+    AddTimer(timer, static_cast<int64_t>(delay * 1000));
+    return timer;
+}
+
+TimerPtr EventLoop::RunEvery(double interval, const Func &cb)
+{
+    auto ms = std::max<int64_t>(static_cast<int64_t>(interval * 1000), 1);
+    auto timer = std::make_shared<Timer>(cb, ms);
+    AddTimer(timer, ms);
+    return timer;
+}
+
+TimerPtr EventLoop::RunEvery(double interval, Func &&cb)
+{
+    auto ms = std::max<int64_t>(static_cast<int64_t>(interval * 1000), 1);
+    auto timer = std::make_shared<Timer>(std::move(cb), ms);
+    AddTimer(timer, ms);
+    return timer;
+}
@@ -0,0 +1,43 @@
+#include "TaskQueue.h"
+
+using namespace tmms::network;
+
+TaskQueue::~TaskQueue()
+{
+    // 没有执行的任务只析构可调用对象
+    Task *task = head_.exchange(nullptr, std::memory_order_acquire);
+    while (task)
+    {
+        Task *next = task->next;
+        task->destroy(task);
+        delete task;
+        task = next;
+    }
+}
+
+size_t TaskQueue::RunAll()
+{
+    // 一次取走全部任务，生产者之后放入的任务进入新的链表
+    Task *task = head_.exchange(nullptr, std::memory_order_seq_cst);
+
+    // 链表是放入的逆序，反转后按放入顺序执行
+    Task *list = nullptr;
+    while (task)
+    {
+        Task *next = task->next;
+        task->next = list;
+        list = task;
+        task = next;
+    }
+
+    size_t count = 0;
+    while (list)
+    {
+        Task *next = list->next;
+        list->run(list);
+        delete list;
+        list = next;
+        count++;
+    }
+    return count;
+}
@@ -1,13 +1,26 @@
 #include "TcpConnection.h"
 #include "base/NetWork.h"
+#include <algorithm>
 #include <cerrno>
+#include <climits>
 #include <fcntl.h>
 #include <memory>
+#include <string>
 #include <sys/uio.h>
 #include <unistd.h>
 #include <iostream>
 using namespace tmms::network;
 
+namespace
+{
+    // 复制一段数据，返回持有这份数据的发送节点
+    BufferNodePtr CopyBuffer(const void *buf, size_t size)
+    {
+        auto data = std::make_shared<std::string>(static_cast<const char *>(buf), size);
+        return std::make_shared<BufferNode>((void *)data->data(), size, data);
+    }
+} // namespace
+
 TcpConnection::TcpConnection(EventLoop *loop, int socketfd, const InetAddress &localAddr,
                              const InetAddress &peerAddr)
     : Connection(loop, socketfd, localAddr, peerAddr)
@@ -35,6 +48,10 @@ void TcpConnection::OnClose()
     if (!close_)
     {
         close_ = true;
+        if (idle_timer_)
+        {
+            loop_->CancelTimer(idle_timer_);
+        }
         if (close_cb_)
         {
             close_cb_(std::dynamic_pointer_cast<TcpConnection>(shared_from_this()));
@@ -121,43 +138,42 @@ void TcpConnection::OnWrite()
         return;
     }
     ExtendLife();
-    if (!io_vec_list_.empty())
+    while (!send_queue_.empty())
     {
-        while (true)
+        // 由发送队列组装本次 writev 的向量，内存连续的相邻节点合并为一项，最多 IOV_MAX 项
+        io_vec_list_.clear();
+        size_t offset = send_offset_;
+        for (auto const &node : send_queue_)
         {
-            auto ret = ::writev(fd_, &io_vec_list_[0], io_vec_list_.size());
-            if (ret >= 0)
+            char *base = static_cast<char *>(node->addr) + offset;
+            size_t len = node->size - offset;
+            offset = 0;
+            if (len == 0)
             {
-                while (ret > 0)
-                {
-                    if (io_vec_list_.front().iov_len > ret)
-                    {
-                        // 将void*转为char*后再进行指针运算
-                        io_vec_list_.front().iov_base =
-                            static_cast<char *>(io_vec_list_.front().iov_base) + ret;
-                        io_vec_list_.front().iov_len -= ret;
-                        break;
-                    }
-                    else
-                    {
-                        ret -= io_vec_list_.front().iov_len;
-                        io_vec_list_.erase(io_vec_list_.begin());
-                    }
-                }
-                if (io_vec_list_.empty())
-                {
-                    EnableWriting(false);
-                    if (write_complete_cb_)
-                    {
-                        write_complete_cb_(
-                            std::dynamic_pointer_cast<TcpConnection>(shared_from_this()));
-                    }
-                    return;
-                }
+                continue;
+            }
+            if (!io_vec_list_.empty() &&
+                static_cast<char *>(io_vec_list_.back().iov_base) + io_vec_list_.back().iov_len ==
+                    base)
+            {
+                io_vec_list_.back().iov_len += len;
+                continue;
             }
-            else
+            if (io_vec_list_.size() >= IOV_MAX)
             {
-                if (errno != EINTR || errno != EAGAIN || errno != EWOULDBLOCK)
+                break;
+            }
+            io_vec_list_.push_back({base, len});
+        }
+
+        ssize_t ret = 0;
+        if (!io_vec_list_.empty())
+        {
+            ret = ::writev(fd_, &io_vec_list_[0], io_vec_list_.size());
+            if (ret < 0)
+            {
+                // 发送缓冲区已满时等待下一次可写事件，其他错误关闭连接
+                if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
                 {
                     NETWORK_ERROR << "host:" << peer_addr_.ToIpPort() << " write error:" << errno;
                     OnClose();
@@ -166,10 +182,29 @@ void TcpConnection::OnWrite()
                 break;
             }
         }
+
+        // 释放已经写完的节点，节点持有的内存随之释放
+        size_t written = ret;
+        while (!send_queue_.empty())
+        {
+            size_t left = send_queue_.front()->size - send_offset_;
+            if (left > written)
+            {
+                send_offset_ += written;
+                break;
+            }
+            written -= left;
+            send_offset_ = 0;
+            send_queue_.pop_front();
+        }
     }
-    else
+
+    if (send_queue_.empty())
     {
-        EnableWriting(false);
+        if (events_ & EPOLLOUT)
+        {
+            EnableWriting(false);
+        }
         if (write_complete_cb_)
         {
             write_complete_cb_(std::dynamic_pointer_cast<TcpConnection>(shared_from_this()));
@@ -177,14 +212,45 @@ void TcpConnection::OnWrite()
     }
 }
 
-void TcpConnection::Send(std::list<BufferNodePtr> &list)
+void TcpConnection::Send(const std::list<BufferNodePtr> &list)
 {
-    loop_->RunInLoop([this, &list]() { SendInLoop(list); });
+    if (loop_->IsInLoopThread())
+    {
+        SendInLoop(list);
+    }
+    else
+    {
+        // 其他线程中调用时复制节点列表，节点本身由引用计数共享
+        auto cp = std::dynamic_pointer_cast<TcpConnection>(shared_from_this());
+        loop_->RunInLoop([cp, list]() { cp->SendInLoop(list); });
+    }
+}
+
+void TcpConnection::Send(std::list<BufferNodePtr> &&list)
+{
+    if (loop_->IsInLoopThread())
+    {
+        SendInLoop(list);
+    }
+    else
+    {
+        auto cp = std::dynamic_pointer_cast<TcpConnection>(shared_from_this());
+        loop_->RunInLoop([cp, list = std::move(list)]() { cp->SendInLoop(list); });
+    }
 }
 
 void TcpConnection::Send(const void *buf, size_t size)
 {
-    loop_->RunInLoop([this, &buf, size]() { SendInLoop(buf, size); });
+    if (loop_->IsInLoopThread())
+    {
+        SendInLoop(buf, size);
+    }
+    else
+    {
+        // 调用返回后缓冲区可能被复用，先复制一份
+        std::list<BufferNodePtr> list{CopyBuffer(buf, size)};
+        Send(std::move(list));
+    }
 }
 
 void TcpConnection::SendInLoop(const void *buf, size_t size)
@@ -194,13 +260,13 @@ void TcpConnection::SendInLoop(const void *buf, size_t size)
         NETWORK_ERROR << "host:" << peer_addr_.ToIpPort() << " had closed.";
         return;
     }
-    size_t send_len = 0;
-    if (io_vec_list_.empty())
+    ssize_t send_len = 0;
+    if (send_queue_.empty())
     {
         send_len = ::write(fd_, buf, size);
         if (send_len < 0)
         {
-            if (errno != EINTR || errno != EAGAIN || errno != EWOULDBLOCK)
+            if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
             {
                 NETWORK_ERROR << "host:" << peer_addr_.ToIpPort() << " write error:" << errno;
                 OnClose();
@@ -208,8 +274,7 @@ void TcpConnection::SendInLoop(const void *buf, size_t size)
             }
             send_len = 0;
         }
-        size -= send_len;
-        if (size == 0)
+        if ((size_t)send_len == size)
         {
             if (write_complete_cb_)
             {
@@ -218,17 +283,16 @@ void TcpConnection::SendInLoop(const void *buf, size_t size)
             return;
         }
     }
-    if (size > 0)
+
+    // 没有写完的部分复制到发送队列，调用方的缓冲区不需要保持到发送完成
+    send_queue_.emplace_back(CopyBuffer(static_cast<const char *>(buf) + send_len, size - send_len));
+    if (!(events_ & EPOLLOUT))
     {
-        struct iovec vec;
-        vec.iov_base = static_cast<char *>(const_cast<void *>(buf)) + send_len;
-        vec.iov_len = size;
-        io_vec_list_.push_back(vec);
         EnableWriting(true);
     }
 }
 
-void TcpConnection::SendInLoop(std::list<BufferNodePtr> &list)
+void TcpConnection::SendInLoop(const std::list<BufferNodePtr> &list)
 {
     if (close_)
     {
@@ -237,13 +301,11 @@ void TcpConnection::SendInLoop(std::list<BufferNodePtr> &list)
     }
     for (auto &l : list)
     {
-        struct iovec vec;
-        vec.iov_base = (void *)l->addr;
-        vec.iov_len = l->size;
-
-        io_vec_list_.push_back(vec);
+        send_queue_.emplace_back(l);
     }
-    if (!io_vec_list_.empty())
+
+    // 已经在等待可写事件时不需要再修改 epoll，本次的数据与队列中的数据一起写出
+    if (!send_queue_.empty() && !(events_ & EPOLLOUT))
     {
         EnableWriting(true);
     }
@@ -253,14 +315,14 @@ void TcpConnection::SetTimeoutCallback(int timeout, const TimeOutCallback &cb)
 {
     auto cp = std::dynamic_pointer_cast<TcpConnection>(shared_from_this());
 
-    loop_->RunAfter(timeout, [cp, &cb]() { cb(cp); });
+    loop_->RunAfter(timeout, [cp, cb]() { cb(cp); });
 }
 
 void TcpConnection::SetTimeoutCallback(int timeout, TimeOutCallback &&cb)
 {
     auto cp = std::dynamic_pointer_cast<TcpConnection>(shared_from_this());
 
-    loop_->RunAfter(timeout, [cp, &cb]() { cb(cp); });
+    loop_->RunAfter(timeout, [cp, cb = std::move(cb)]() { cb(cp); });
 }
 
 void TcpConnection::OnTimeout()
@@ -272,18 +334,47 @@ void TcpConnection::OnTimeout()
 
 void TcpConnection::EnableCheckIdleTimeout(int32_t max_time)
 {
-    auto tp = std::make_shared<TimeOutEntry>(
-        std::dynamic_pointer_cast<TcpConnection>(shared_from_this()));
-    max_idle_time_ = max_time;
-    timeout_entry_ = tp;
-    loop_->InsertEntry(max_time, tp);
+    auto cp = std::dynamic_pointer_cast<TcpConnection>(shared_from_this());
+    loop_->RunInLoop([cp, max_time]() {
+        cp->max_idle_time_ = max_time;
+        cp->last_active_time_ = cp->loop_->NowMS();
+        if (!cp->idle_timer_)
+        {
+            // 定时器不持有连接，连接释放后回调不做任何事
+            std::weak_ptr<TcpConnection> weak = cp;
+            cp->idle_timer_ = std::make_shared<Timer>([weak]() {
+                auto c = weak.lock();
+                if (c)
+                {
+                    c->CheckIdleTimeout();
+                }
+            });
+        }
+        cp->loop_->AddTimer(cp->idle_timer_, max_time * 1000ll);
+    });
 }
 
 void TcpConnection::ExtendLife()
 {
-    auto tp = timeout_entry_.lock();
-    if (tp)
+    // 读写路径上只记录时间，不操作定时器
+    last_active_time_ = loop_->NowMS();
+}
+
+void TcpConnection::CheckIdleTimeout()
+{
+    if (close_)
+    {
+        return;
+    }
+
+    auto idle = loop_->NowMS() - last_active_time_;
+    auto max_idle = max_idle_time_ * 1000ll;
+    if (idle >= max_idle)
     {
-        loop_->InsertEntry(max_idle_time_, tp);
+        OnTimeout();
+        return;
     }
+
+    // 期间有过读写，从最后活动的时间重新计时
+    loop_->AddTimer(idle_timer_, max_idle - idle);
 }
@@ -1,144 +1,317 @@
 #include "TimingWheel.h"
-#include "NetWork.h"
-#include <iostream>
+#include <algorithm>
 using namespace tmms::network;
 
-TimingWheel::TimingWheel() : wheels_(4)
+namespace
 {
-    wheels_[kTimingTypeSecond].resize(60);
-    wheels_[kTimingTypeMinute].resize(60);
-    wheels_[kTimingTypeHour].resize(24);
-    wheels_[kTimingTypeDay].resize(30);
-}
+    // 把节点插入到哨兵节点之前，即链表尾部
+    void ListAppend(TimerLink *head, TimerLink *link)
+    {
+        link->prev = head->prev;
+        link->next = head;
+        head->prev->next = link;
+        head->prev = link;
+    }
+
+    // 把节点从链表中摘下，摘下后自成一个空链表
+    void ListRemove(TimerLink *link)
+    {
+        link->prev->next = link->next;
+        link->next->prev = link->prev;
+        link->prev = link;
+        link->next = link;
+    }
+} // namespace
 
-void TimingWheel::InsertSecondEntry(uint32_t delay, EntryPtr entryPty)
+Timer::Timer(const Func &cb, int64_t interval) : interval_(interval), cb_(cb)
 {
-    wheels_[kTimingTypeSecond][delay - 1].emplace(entryPty);
 }
 
-void TimingWheel::InsertMinuteEntry(uint32_t delay, EntryPtr entryPty)
+Timer::Timer(Func &&cb, int64_t interval) : interval_(interval), cb_(std::move(cb))
 {
-    auto minute = delay / kTimingMinute;
-    auto second = delay % kTimingMinute;
-    CallbackEntryPtr newEntryPtr = std::make_shared<CallbackEntry>(
-        [this, second, entryPty]() { InsertEntry(second, entryPty); });
-    wheels_[kTimingTypeMinute][minute - 1].emplace(entryPty);
 }
 
-void TimingWheel::InsertHourEntry(uint32_t delay, EntryPtr entryPty)
+bool Timer::Pending() const
 {
-    auto hour = delay / kTimingHour;
-    auto second = delay % kTimingHour;
-    CallbackEntryPtr newEntryPtr = std::make_shared<CallbackEntry>(
-        [this, second, entryPty]() { InsertEntry(second, entryPty); });
-    wheels_[kTimingTypeHour][hour - 1].emplace(entryPty);
+    return !!self_;
 }
 
-void TimingWheel::InsertDayEntry(uint32_t delay, EntryPtr entryPty)
+TimingWheel::TimingWheel(int64_t tick_ms)
+    : tick_ms_(std::max<int64_t>(tick_ms, 1)), slots_(kRootSize + (kLevels - 1) * kLevelSize)
 {
-    auto day = delay / kTimingDay;
-    auto second = delay % kTimingDay;
-    CallbackEntryPtr newEntryPtr = std::make_shared<CallbackEntry>(
-        [this, second, entryPty]() { InsertEntry(second, entryPty); });
-    wheels_[kTimingTypeDay][day - 1].emplace(entryPty);
 }
 
 TimingWheel::~TimingWheel()
 {
+    // 先把所有定时器摘下，再统一释放，回调对象析构时时间轮已经是空的
+    std::vector<TimerPtr> timers;
+    timers.reserve(count_);
+    for (auto &slot : slots_)
+    {
+        while (slot.next != &slot)
+        {
+            Timer *timer = static_cast<Timer *>(slot.next);
+            ListRemove(timer);
+            timer->slot_ = -1;
+            timers.emplace_back(std::move(timer->self_));
+        }
+    }
+    count_ = 0;
 }
 
-void TimingWheel::InsertEntry(uint32_t delay, EntryPtr entryPty)
+int64_t TimingWheel::Ticks(int64_t ms) const
 {
-    if (delay <= 0)
-    {
-        entryPty.reset();
-    }
-    if (delay < kTimingMinute)
-    {
-        InsertSecondEntry(delay, entryPty);
-    }
-    else if (delay < kTimingHour)
+    auto ticks = (std::max<int64_t>(ms, 0) + tick_ms_ - 1) / tick_ms_;
+    return std::min(std::max<int64_t>(ticks, 1), kMaxTicks - 1);
+}
+
+void TimingWheel::Link(Timer *timer)
+{
+    // 超出最长延迟的定时器按最长延迟处理
+    auto diff = timer->expire_ - tick_;
+    if (diff >= kMaxTicks)
     {
-        InsertMinuteEntry(delay, entryPty);
+        timer->expire_ = tick_ + kMaxTicks - 1;
+        diff = kMaxTicks - 1;
     }
-    else if (delay < kTimingDay)
+
+    int64_t slot = 0;
+    if (diff < kRootSize)
     {
-        InsertHourEntry(delay, entryPty);
+        // 已经过期的定时器放入下一个要处理的槽位
+        slot = (diff < 0 ? tick_ : timer->expire_) & (kRootSize - 1);
+        root_bits_[slot >> 6] |= 1ull << (slot & 63);
     }
     else
     {
-        auto day = delay / kTimingDay;
-        if (day > 30)
+        // 第 level 层一个槽位的跨度是 2^shift 个 tick，一圈是 2^(shift + kLevelBits) 个 tick
+        int level = 1;
+        int shift = kRootBits;
+        while (level < kLevels - 1 && diff >= (1ll << (shift + kLevelBits)))
         {
-            NETWORK_ERROR << "It is not support > 30 days";
+            level++;
+            shift += kLevelBits;
         }
-        InsertDayEntry(delay, entryPty);
+        slot = kRootSize + (level - 1) * kLevelSize + ((timer->expire_ >> shift) & (kLevelSize - 1));
     }
+    ListAppend(&slots_[slot], timer);
+    timer->slot_ = static_cast<int32_t>(slot);
 }
 
-void TimingWheel::OnTimer(int64_t now)
+void TimingWheel::Unlink(Timer *timer)
 {
-    if (last_ts_ == 0)
+    auto slot = timer->slot_;
+    ListRemove(timer);
+    timer->slot_ = -1;
+
+    // 第 0 层的槽位变空时清除位图
+    if (slot >= 0 && slot < kRootSize && slots_[slot].next == &slots_[slot])
     {
-        last_ts_ = now;
+        root_bits_[slot >> 6] &= ~(1ull << (slot & 63));
     }
+}
 
-    if (now - last_ts_ < 1000)
+void TimingWheel::TakeSlot(int64_t slot, TimerLink &list)
+{
+    auto &head = slots_[slot];
+    if (head.next == &head)
     {
         return;
     }
-    last_ts_ = now;
-    ++tick_;
-    PopUp(wheels_[kTimingTypeSecond]);
-    if (tick_ % kTimingMinute == 0)
+    list.next = head.next;
+    list.prev = head.prev;
+    list.next->prev = &list;
+    list.prev->next = &list;
+    head.next = &head;
+    head.prev = &head;
+    if (slot < kRootSize)
     {
-        PopUp(wheels_[kTimingTypeMinute]);
+        root_bits_[slot >> 6] &= ~(1ull << (slot & 63));
     }
-    else if (tick_ % kTimingHour == 0)
+}
+
+void TimingWheel::Cascade(int level, int64_t index)
+{
+    TimerLink list;
+    TakeSlot(kRootSize + (level - 1) * kLevelSize + index, list);
+
+    // 这些定时器都在下层一圈之内到期，重新插入后落到下层
+    while (list.next != &list)
     {
-        PopUp(wheels_[kTimingTypeHour]);
+        Timer *timer = static_cast<Timer *>(list.next);
+        ListRemove(timer);
+        Link(timer);
     }
-    else if (tick_ % kTimingDay == 0)
+}
+
+int64_t TimingWheel::NextRootSlot(int64_t index) const
+{
+    for (int64_t word = index >> 6; word < kRootSize / 64; word++)
     {
-        PopUp(wheels_[kTimingTypeDay]);
+        uint64_t bits = root_bits_[word];
+        if (word == (index >> 6))
+        {
+            bits &= ~0ull << (index & 63);
+        }
+        if (bits)
+        {
+            return word * 64 + __builtin_ctzll(bits);
+        }
     }
+    return kRootSize;
 }
 
-void TimingWheel::PopUp(Wheel &bq)
+void TimingWheel::AddTimer(const TimerPtr &timer, int64_t delay, int64_t now)
 {
-    WheelEntry tmp;
-    bq.front().swap(tmp);
-    bq.front().clear();
-    bq.pop_front();
-    bq.push_back(WheelEntry());
+    auto now_tick = now / tick_ms_;
+    if (tick_ < 0)
+    {
+        tick_ = now_tick;
+    }
+
+    // 已经在时间轮中时先移除，相当于重新设置延迟
+    if (timer->self_)
+    {
+        Unlink(timer.get());
+        count_--;
+    }
+
+    // 事件循环落后时 tick_ 可能小于当前时间，从两者中较晚的一个开始计算
+    timer->cancelled_ = false;
+    timer->expire_ = std::max(now_tick, tick_ - 1) + Ticks(delay);
+    timer->self_ = timer;
+    Link(timer.get());
+    count_++;
 }
 
-void TimingWheel::RunAfter(double delay, const Func &cb)
+void TimingWheel::CancelTimer(const TimerPtr &timer)
 {
-    CallbackEntryPtr cbEntry = std::make_shared<CallbackEntry>([cb]() { cb(); });
-    InsertEntry(delay, cbEntry);
+    timer->cancelled_ = true;
+    if (timer->self_)
+    {
+        Unlink(timer.get());
+        count_--;
+        timer->self_.reset();
+    }
 }
 
-void TimingWheel::RunAfter(double delay, Func &&cb)
+void TimingWheel::InsertEntry(uint32_t delay, EntryPtr entryPty, int64_t now)
 {
-    CallbackEntryPtr cbEntry = std::make_shared<CallbackEntry>([cb]() { cb(); });
-    InsertEntry(delay, cbEntry);
+    if (delay == 0)
+    {
+        return;
+    }
+
+    // 同一秒到期的任务共用一个定时器，触发时整组释放
+    auto second = now / 1000 + delay;
+    auto iter = entries_.find(second);
+    if (iter == entries_.end())
+    {
+        iter = entries_.emplace(second, WheelEntry()).first;
+        auto timer = std::make_shared<Timer>([this, second]() {
+            auto it = entries_.find(second);
+            if (it == entries_.end())
+            {
+                return;
+            }
+
+            // 先从表中移出再释放，任务析构时可能重新插入
+            WheelEntry entries;
+            entries.swap(it->second);
+            entries_.erase(it);
+        });
+        AddTimer(timer, second * 1000 - now, now);
+    }
+    iter->second.emplace(std::move(entryPty));
 }
 
-void TimingWheel::RunEvery(double interval, const Func &cb)
+void TimingWheel::OnTimer(int64_t now)
 {
-    CallbackEntryPtr cbEntry = std::make_shared<CallbackEntry>([this,cb, interval]() {
-        cb();
-        RunEvery(interval, cb);
-        });
-    InsertEntry(interval, cbEntry);
+    auto now_tick = now / tick_ms_;
+    if (tick_ < 0 || count_ == 0)
+    {
+        // 没有定时器时直接跳到当前时间
+        tick_ = std::max(tick_, now_tick + 1);
+        return;
+    }
+
+    while (tick_ <= now_tick)
+    {
+        auto index = tick_ & (kRootSize - 1);
+
+        // 第 0 层转完一圈，逐层把上层当前槽位的定时器放入下层，上层也转完一圈时继续处理更上一层
+        if (index == 0)
+        {
+            int shift = kRootBits;
+            for (int level = 1; level < kLevels; level++, shift += kLevelBits)
+            {
+                auto idx = (tick_ >> shift) & (kLevelSize - 1);
+                Cascade(level, idx);
+                if (idx != 0)
+                {
+                    break;
+                }
+            }
+        }
+
+        // 空槽位直接跳过，但不越过下一次处理上层的位置
+        auto next = NextRootSlot(index);
+        if (next != index)
+        {
+            tick_ = std::min(tick_ + (next - index), now_tick + 1);
+            continue;
+        }
+
+        // 先取出整个槽位再推进，回调中插入的定时器最早落在下一个 tick
+        TimerLink list;
+        TakeSlot(index, list);
+        tick_++;
+        while (list.next != &list)
+        {
+            Timer *timer = static_cast<Timer *>(list.next);
+            ListRemove(timer);
+            timer->slot_ = -1;
+            Fire(timer);
+        }
+    }
+}
+
+void TimingWheel::Fire(Timer *timer)
+{
+    count_--;
+
+    // 回调期间持有定时器，回调中可以取消或重新插入自身
+    TimerPtr self = std::move(timer->self_);
+    if (timer->cb_)
+    {
+        timer->cb_();
+    }
+
+    // 周期定时器在回调中没有被取消或重新插入时，按周期继续
+    if (timer->interval_ > 0 && !timer->cancelled_ && !timer->self_)
+    {
+        timer->expire_ = std::max(timer->expire_ + Ticks(timer->interval_), tick_);
+        timer->self_ = std::move(self);
+        Link(timer);
+        count_++;
+    }
+}
+
+int64_t TimingWheel::NextTimeout(int64_t now, int64_t max_timeout) const
+{
+    if (tick_ < 0 || count_ == 0)
+    {
+        return max_timeout;
+    }
+
+    // 第 0 层最近的非空槽位，没有时为下一次处理上层的位置
+    auto index = tick_ & (kRootSize - 1);
+    auto next = tick_ + (NextRootSlot(index) - index);
+    auto timeout = next * tick_ms_ - now;
+    return std::min(std::max<int64_t>(timeout, 0), max_timeout);
 }
 
-void TimingWheel::RunEvery(double interval, Func &&cb)
+size_t TimingWheel::Size() const
 {
-    CallbackEntryPtr cbEntry = std::make_shared<CallbackEntry>([this, cb, interval]() {
-        cb();
-        RunEvery(interval, cb);
-    });
-    InsertEntry(interval, cbEntry);
+    return count_;
 }
@@ -34,6 +34,7 @@ void UdpSocket::OnRead()
         NETWORK_ERROR << "host" << peer_addr_.ToIpPort() << " had closed.";
         return;
     }
+    ExtendLife();
     while (true)
     {
         struct sockaddr_in6 sock_addr;
@@ -129,6 +130,10 @@ void UdpSocket::OnClose()
     if (!closed_)
     {
         closed_ = true;
+        if (idle_timer_)
+        {
+            loop_->CancelTimer(idle_timer_);
+        }
         if (close_cb_)
         {
             close_cb_(std::dynamic_pointer_cast<UdpSocket>(shared_from_this()));
@@ -181,21 +186,49 @@ void UdpSocket::SetTimeoutCallback(int timeout, UdpSocketTimeoutCallback &&cb)
 
 void UdpSocket::EnableCheckIdleTimeout(int32_t max_time)
 {
-    auto tp =
-        std::make_shared<UdpTimeoutEntry>(std::dynamic_pointer_cast<UdpSocket>(shared_from_this()));
-    max_idle_time_ = max_time;
-    timeout_entry_ = tp;
-    loop_->InsertEntry(max_time, tp);
+    auto us = std::dynamic_pointer_cast<UdpSocket>(shared_from_this());
+    loop_->RunInLoop([us, max_time]() {
+        us->max_idle_time_ = max_time;
+        us->last_active_time_ = us->loop_->NowMS();
+        if (!us->idle_timer_)
+        {
+            // 定时器不持有套接字，套接字释放后回调不做任何事
+            std::weak_ptr<UdpSocket> weak = us;
+            us->idle_timer_ = std::make_shared<Timer>([weak]() {
+                auto u = weak.lock();
+                if (u)
+                {
+                    u->CheckIdleTimeout();
+                }
+            });
+        }
+        us->loop_->AddTimer(us->idle_timer_, max_time * 1000ll);
+    });
 }
 
 void UdpSocket::ExtendLife()
 {
-    auto tp = timeout_entry_.lock();
+    // 收发路径上只记录时间，不操作定时器
+    last_active_time_ = loop_->NowMS();
+}
 
-    if (tp)
+void UdpSocket::CheckIdleTimeout()
+{
+    if (closed_)
+    {
+        return;
+    }
+
+    auto idle = loop_->NowMS() - last_active_time_;
+    auto max_idle = max_idle_time_ * 1000ll;
+    if (idle >= max_idle)
     {
-        loop_->InsertEntry(max_idle_time_, tp);
+        OnTimeout();
+        return;
     }
+
+    // 期间有过收发，从最后活动的时间重新计时
+    loop_->AddTimer(idle_timer_, max_idle - idle);
 }
 
 void UdpSocket::SendInLoop(std::list<UdpBufferNodePtr> &list)
@@ -0,0 +1,40 @@
+#include "WakeupEvent.h"
+#include "NetWork.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace tmms::network;
+
+WakeupEvent::WakeupEvent(EventLoop *loop) : Event(loop, ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    if (fd_ < 0)
+    {
+        NETWORK_ERROR << "eventfd open failed. error:" << errno;
+        exit(-1);
+    }
+}
+
+WakeupEvent::~WakeupEvent()
+{
+    Close();
+}
+
+void WakeupEvent::OnRead()
+{
+    // 一次读取清空计数，多次唤醒只需读一次
+    uint64_t count = 0;
+    auto ret = ::read(fd_, &count, sizeof(count));
+    if (ret < 0 && errno != EAGAIN)
+    {
+        NETWORK_ERROR << "eventfd read failed. error:" << errno;
+    }
+}
+
+void WakeupEvent::Notify()
+{
+    uint64_t one = 1;
+    ::write(fd_, &one, sizeof(one));
+}
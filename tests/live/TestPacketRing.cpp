@@ -0,0 +1,147 @@
+#include "live/GopMgr.h"
+#include "live/base/PacketRing.h"
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace tmms::mm;
+using namespace tmms::live;
+
+// 环形缓冲区容量，故意取较小值，让写者频繁覆盖读者正在读取的槽位
+const uint32_t kRingSize = 64;
+
+// 写者写入的总帧数
+const int64_t kTotalFrames = 2000000;
+
+// 每隔多少帧产生一个关键帧
+const int32_t kGopLength = 25;
+
+// 读者线程数
+const int32_t kReaders = 8;
+
+PacketRing ring(kRingSize);
+GopMgr gop_mgr(kRingSize);
+std::atomic<bool> done{false};
+std::atomic<int64_t> reads{0};
+std::atomic<int64_t> misses{0};
+std::atomic<int64_t> errors{0};
+
+// 数据内容由帧索引决定，读者据此校验读到的数据包是否完整
+void FillPacket(PacketPtr &packet, int64_t index)
+{
+    int32_t size = 16 + index % 64;
+    memset(packet->Data(), (char)(index & 0xFF), size);
+    packet->SetPacketSize(size);
+}
+
+bool CheckPacket(const PacketPtr &packet, int64_t index)
+{
+    if (packet->Index() != index || packet->TimeStamp() != (uint64_t)index * 40)
+    {
+        return false;
+    }
+    int32_t size = 16 + index % 64;
+    if (packet->PacketSize() != size)
+    {
+        return false;
+    }
+    const char *data = packet->Data();
+    for (int32_t i = 0; i < size; i++)
+    {
+        if (data[i] != (char)(index & 0xFF))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Publisher()
+{
+    for (int64_t i = 0; i < kTotalFrames; i++)
+    {
+        PacketPtr packet = Packet::NewPacket(128);
+        packet->SetIndex(i);
+        packet->SetTimeStamp(i * 40);
+        packet->SetPacketType(i % kGopLength == 0 ? (kPacketTypeVideo | kFrameTypeKeyFrame)
+                                                 : kPacketTypeVideo);
+        FillPacket(packet, i);
+
+        gop_mgr.AddFrame(packet);
+        ring.Push(std::move(packet));
+        if (i >= kRingSize)
+        {
+            gop_mgr.ClearExpriedGop(i - kRingSize);
+        }
+    }
+    done = true;
+}
+
+void Reader(int id)
+{
+    std::mt19937 rng(id);
+    while (!done)
+    {
+        auto max_idx = ring.LastestIndex();
+        if (max_idx < 0)
+        {
+            continue;
+        }
+
+        // 随机读取缓冲区窗口内（以及刚好滑出窗口）的帧
+        auto min_idx = max_idx - kRingSize - 4;
+        if (min_idx < 0)
+        {
+            min_idx = 0;
+        }
+        auto idx = min_idx + (int64_t)(rng() % (max_idx - min_idx + 1));
+        PacketPtr packet = ring.Get(idx);
+        reads++;
+        if (!packet)
+        {
+            misses++;
+        }
+        else if (!CheckPacket(packet, idx))
+        {
+            errors++;
+        }
+
+        // 同时读取 GOP 索引，返回的必须是关键帧的索引
+        int latency = 0;
+        auto gop = gop_mgr.GetGopByLatency(kRingSize * 40, latency);
+        if (gop != -1 && (gop % kGopLength != 0 || latency < 0))
+        {
+            errors++;
+        }
+    }
+}
+
+int main(int argc, const char **argv)
+{
+    std::vector<std::thread> readers;
+    for (int i = 0; i < kReaders; i++)
+    {
+        readers.emplace_back(Reader, i);
+    }
+
+    std::thread publisher(Publisher);
+    publisher.join();
+    for (auto &t : readers)
+    {
+        t.join();
+    }
+
+    // 每个 GOP 固定 kGopLength 帧、帧间隔 40 毫秒
+    if (gop_mgr.AvgGopDuration() != kGopLength * 40)
+    {
+        errors++;
+    }
+
+    std::cout << "frames : " << kTotalFrames << " , reads : " << reads
+              << " , misses : " << misses << " , errors : " << errors << std::endl;
+
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+#include "network/net/Event.h"
+#include "network/net/EventLoop.h"
+#include <chrono>
+#include <iostream>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace tmms::network;
+
+// 事件循环分发的微基准测试：
+// 注册大量始终可读的 eventfd，每次回调不读取数据，只重新启用读事件，边缘触发下 epoll_ctl 会把
+// 事件重新放入就绪队列，下一轮 epoll_wait 再次返回。统计每秒分发的事件数，以及每个事件消耗的
+// 用户态和内核态 CPU 时间，分发和查找事件表的开销体现在用户态时间上。
+// 之后检查回调中删除其他事件的情况：被删除的事件换成不可读的 eventfd（通常复用同一个文件描述符），
+// 同一批中被删除事件的残留通知不应分发到已删除或新注册的事件上。
+
+// 注册的事件数
+const int32_t kEvents = 10000;
+
+// 测量吞吐时分发的事件数
+const int64_t kBenchDispatch = 5000000;
+
+// 检查删除事件时分发的事件数
+const int64_t kCloseDispatch = 1000000;
+
+// 检查删除事件时，每分发多少个事件替换一次其他事件
+const int64_t kReplaceInterval = 1000;
+
+class BenchEvent;
+std::vector<std::shared_ptr<BenchEvent>> g_events;
+int64_t g_target = 0;
+int64_t g_dispatched = 0;
+int64_t g_stale = 0;
+int64_t g_replaced = 0;
+bool g_replace = false;
+
+/**
+ * @brief eventfd 事件，可读时每次回调后重新启用读事件
+ */
+class BenchEvent : public Event
+{
+  public:
+    BenchEvent(EventLoop *loop, int32_t slot, bool readable)
+        : Event(loop, ::eventfd(readable ? 1 : 0, EFD_NONBLOCK)), slot_(slot), readable_(readable)
+    {
+    }
+    ~BenchEvent()
+    {
+        Close();
+    }
+
+    void OnRead() override
+    {
+        // 已经删除的事件和不可读的事件不应该收到回调
+        if (deleted_ || !readable_)
+        {
+            g_stale++;
+            return;
+        }
+
+        g_dispatched++;
+        if (g_dispatched >= g_target)
+        {
+            loop_->Quit();
+            return;
+        }
+
+        // 删除下一个事件，它在本批中通常还有未分发的通知
+        if (g_replace && g_dispatched % kReplaceInterval == 0)
+        {
+            Replace((slot_ + 1) % kEvents);
+        }
+
+        // 重新启用读事件，使事件在下一轮再次就绪
+        EnableReading(true);
+    }
+
+    void Replace(int32_t slot)
+    {
+        auto &old = g_events[slot];
+        loop_->DelEvent(old);
+        old->deleted_ = true;
+        old->Close();
+
+        // 新的 eventfd 通常复用刚关闭的文件描述符
+        old = std::make_shared<BenchEvent>(loop_, slot, false);
+        loop_->AddEvent(old);
+        g_replaced++;
+    }
+
+  private:
+    int32_t slot_{0};
+    bool readable_{false};
+    bool deleted_{false};
+};
+
+// 本线程消耗的用户态和内核态 CPU 时间(纳秒)
+void ThreadCpuNs(int64_t &user, int64_t &sys)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    user = usage.ru_utime.tv_sec * 1000000000ll + usage.ru_utime.tv_usec * 1000ll;
+    sys = usage.ru_stime.tv_sec * 1000000000ll + usage.ru_stime.tv_usec * 1000ll;
+}
+
+// 运行事件循环直到再分发 count 个事件
+void RunLoop(EventLoop &loop, int64_t count, bool replace)
+{
+    g_dispatched = 0;
+    g_target = count;
+    g_replace = replace;
+
+    int64_t user_start = 0, sys_start = 0;
+    ThreadCpuNs(user_start, sys_start);
+    auto start = std::chrono::steady_clock::now();
+    loop.Loop();
+    auto wall_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    int64_t user_ns = 0, sys_ns = 0;
+    ThreadCpuNs(user_ns, sys_ns);
+    user_ns -= user_start;
+    sys_ns -= sys_start;
+
+    std::cout << (replace ? "close : " : "bench : ") << "events : " << kEvents
+              << " , dispatched : " << g_dispatched << " , replaced : " << g_replaced
+              << " , stale : " << g_stale << " , wall : " << wall_ms << "ms"
+              << " , events/sec : " << g_dispatched * 1000 / std::max<int64_t>(wall_ms, 1)
+              << " , user per event : " << user_ns / g_dispatched << "ns"
+              << " , sys per event : " << sys_ns / g_dispatched << "ns" << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+    EventLoop loop;
+
+    for (int32_t i = 0; i < kEvents; i++)
+    {
+        auto event = std::make_shared<BenchEvent>(&loop, i, true);
+        if (event->Fd() < 0)
+        {
+            std::cout << "eventfd failed, events : " << i << std::endl;
+            return 1;
+        }
+        loop.AddEvent(event);
+        g_events.emplace_back(event);
+    }
+
+    RunLoop(loop, kBenchDispatch, false);
+    RunLoop(loop, kCloseDispatch, true);
+
+    bool ok = g_stale == 0;
+    std::cout << (ok ? "OK" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
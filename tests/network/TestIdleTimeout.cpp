@@ -0,0 +1,138 @@
+#include "network/net/EventLoop.h"
+#include "network/net/TcpConnection.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace tmms::network;
+
+// 连接空闲检测的测试：
+// 1. 吞吐：大量连接开启空闲检测，另一个线程轮流向各连接写入，统计事件循环线程每次读事件消耗的用户态
+//    CPU 时间，空闲检测的开销体现在读写路径上
+// 2. 正确性：一半连接持续有数据，另一半不再有数据，超过最大空闲时间后只有后一半被关闭
+
+// 连接数
+const int32_t kConns = 2000;
+
+// 吞吐测试写入的轮数
+const int32_t kBenchRounds = 1000;
+
+// 最大空闲时间(秒)
+const int32_t kMaxIdle = 2;
+
+// 正确性测试中活动连接的写入间隔(毫秒)
+const int32_t kActiveInterval = 200;
+
+std::vector<TcpConnectionPtr> g_conns;
+std::vector<int> g_peers;
+std::vector<bool> g_closed;
+int64_t g_reads = 0;
+
+// 本线程消耗的用户态 CPU 时间(纳秒)
+int64_t ThreadUserNs()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec * 1000000000ll + usage.ru_utime.tv_usec * 1000ll;
+}
+
+// 在另一个线程中执行 writer，结束后退出事件循环
+template <typename F>
+void RunWithWriter(EventLoop &loop, F &&writer)
+{
+    std::thread t([&loop, &writer]() {
+        writer();
+        loop.RunInLoop([&loop]() { loop.Quit(); });
+    });
+    loop.Loop();
+    t.join();
+}
+
+int main(int argc, const char **argv)
+{
+    EventLoop loop;
+    InetAddress addr("127.0.0.1:0");
+    g_closed.resize(kConns, false);
+    for (int32_t i = 0; i < kConns; i++)
+    {
+        int fds[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) < 0)
+        {
+            std::cout << "socketpair failed, conns : " << i << std::endl;
+            return 1;
+        }
+        auto conn = std::make_shared<TcpConnection>(&loop, fds[0], addr, addr);
+        conn->SetRecvMsgCallback([](const TcpConnectionPtr &, MsgBuffer &buf) {
+            g_reads++;
+            buf.RetrieveAll();
+        });
+        conn->SetCloseCallback([i](const TcpConnectionPtr &) { g_closed[i] = true; });
+        loop.AddEvent(conn);
+        conn->EnableCheckIdleTimeout(kMaxIdle);
+        g_conns.emplace_back(conn);
+        g_peers.emplace_back(fds[1]);
+    }
+
+    // 吞吐：轮流向所有连接写入，等事件循环读完一轮再写下一轮
+    auto user_start = ThreadUserNs();
+    RunWithWriter(loop, []() {
+        char c = 'x';
+        for (int32_t r = 0; r < kBenchRounds; r++)
+        {
+            for (auto fd : g_peers)
+            {
+                ::write(fd, &c, 1);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    });
+    auto user_ns = ThreadUserNs() - user_start;
+    std::cout << "bench : conns : " << kConns << " , reads : " << g_reads
+              << " , user per read : " << user_ns / std::max<int64_t>(g_reads, 1) << "ns"
+              << std::endl;
+
+    // 正确性：只向偶数编号的连接写入，超过最大空闲时间后检查关闭的连接
+    RunWithWriter(loop, []() {
+        char c = 'x';
+        auto end = std::chrono::steady_clock::now() + std::chrono::seconds(kMaxIdle + 2);
+        while (std::chrono::steady_clock::now() < end)
+        {
+            for (int32_t i = 0; i < kConns; i += 2)
+            {
+                ::write(g_peers[i], &c, 1);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(kActiveInterval));
+        }
+    });
+
+    int32_t active_closed = 0, idle_open = 0;
+    for (int32_t i = 0; i < kConns; i++)
+    {
+        if (i % 2 == 0)
+        {
+            active_closed += g_closed[i];
+        }
+        else
+        {
+            idle_open += !g_closed[i];
+        }
+    }
+    std::cout << "idle : active closed : " << active_closed << " , idle still open : " << idle_open
+              << std::endl;
+
+    // 事件循环析构前关闭剩下的连接
+    for (auto &conn : g_conns)
+    {
+        conn->ForceClose();
+    }
+    g_conns.clear();
+
+    bool ok = active_closed == 0 && idle_open == 0;
+    std::cout << (ok ? "OK" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+#include "network/net/EventLoop.h"
+#include "network/net/EventLoopThread.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace tmms::network;
+
+// 跨事件循环投递任务的微基准测试：
+// 1. 吞吐：多个线程同时向一个事件循环投递小任务和超出内嵌存储的大任务，统计每秒执行的任务数
+// 2. 延迟：事件循环空闲时间隔投递，统计从投递到开始执行的时间
+// 3. 阻塞：另一个线程连续投递耗时的任务，事件循环同时在执行之前投递的任务，统计单次投递调用的耗时，
+//    投递不应该被正在执行的任务阻塞
+
+// 吞吐测试的生产者线程数
+const int32_t kProducers = 4;
+
+// 吞吐测试每个生产者投递的任务数
+const int64_t kTasksPerProducer = 250000;
+
+// 延迟测试的投递次数和间隔(微秒)
+const int32_t kLatencySamples = 2000;
+const int32_t kLatencyInterval = 50;
+
+// 阻塞测试的投递次数和每个任务的执行时间(微秒)
+const int32_t kBlockSamples = 20000;
+const int32_t kBlockTaskTime = 20;
+
+int64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// 等待计数达到目标
+void WaitFor(const std::atomic<int64_t> &count, int64_t target)
+{
+    while (count.load(std::memory_order_acquire) < target)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+// 排序后输出平均值、中位数、P99 和最大值
+void PrintStats(const char *name, std::vector<int64_t> &samples)
+{
+    std::sort(samples.begin(), samples.end());
+    int64_t sum = 0;
+    for (auto s : samples)
+    {
+        sum += s;
+    }
+    std::cout << name << " avg : " << sum / (int64_t)samples.size() / 1000 << "us"
+              << " , p50 : " << samples[samples.size() / 2] / 1000 << "us"
+              << " , p99 : " << samples[samples.size() * 99 / 100] / 1000 << "us"
+              << " , max : " << samples.back() / 1000 << "us" << std::endl;
+}
+
+template <bool kLarge>
+void BenchThroughput(EventLoop *loop)
+{
+    std::atomic<int64_t> done{0};
+    std::array<int64_t, 16> payload{};
+    auto start = NowNs();
+    std::vector<std::thread> producers;
+    for (int32_t p = 0; p < kProducers; p++)
+    {
+        producers.emplace_back([loop, &done, payload]() {
+            for (int64_t i = 0; i < kTasksPerProducer; i++)
+            {
+                if (kLarge)
+                {
+                    // 捕获 128 字节的数据，超出内嵌存储
+                    loop->RunInLoop([&done, payload]() {
+                        done.fetch_add(1 + payload[0], std::memory_order_release);
+                    });
+                }
+                else
+                {
+                    loop->RunInLoop([&done]() { done.fetch_add(1, std::memory_order_release); });
+                }
+            }
+        });
+    }
+    for (auto &t : producers)
+    {
+        t.join();
+    }
+    WaitFor(done, kProducers * kTasksPerProducer);
+    auto ms = (NowNs() - start) / 1000000;
+    std::cout << "throughput " << (kLarge ? "large" : "small") << " : "
+              << kProducers * kTasksPerProducer << " tasks , " << ms << "ms , tasks/sec : "
+              << kProducers * kTasksPerProducer * 1000 / std::max<int64_t>(ms, 1) << std::endl;
+}
+
+void BenchLatency(EventLoop *loop)
+{
+    std::atomic<int64_t> done{0};
+    std::vector<int64_t> samples(kLatencySamples);
+    for (int32_t i = 0; i < kLatencySamples; i++)
+    {
+        auto posted = NowNs();
+        loop->RunInLoop([&done, &samples, posted, i]() {
+            samples[i] = NowNs() - posted;
+            done.fetch_add(1, std::memory_order_release);
+        });
+        std::this_thread::sleep_for(std::chrono::microseconds(kLatencyInterval));
+    }
+    WaitFor(done, kLatencySamples);
+    PrintStats("latency :", samples);
+}
+
+void BenchBlocking(EventLoop *loop)
+{
+    std::atomic<int64_t> done{0};
+    std::vector<int64_t> samples(kBlockSamples);
+    for (int32_t i = 0; i < kBlockSamples; i++)
+    {
+        auto start = NowNs();
+        loop->RunInLoop([&done]() {
+            // 模拟耗时的任务
+            auto end = NowNs() + kBlockTaskTime * 1000;
+            while (NowNs() < end)
+            {
+            }
+            done.fetch_add(1, std::memory_order_release);
+        });
+        samples[i] = NowNs() - start;
+    }
+    WaitFor(done, kBlockSamples);
+    PrintStats("post time while busy :", samples);
+}
+
+int main(int argc, const char **argv)
+{
+    EventLoopThread thread;
+    thread.Run();
+    EventLoop *loop = thread.Loop();
+
+    BenchThroughput<false>(loop);
+    BenchThroughput<true>(loop);
+    BenchLatency(loop);
+    BenchBlocking(loop);
+
+    std::cout << "OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,206 @@
+#include "network/net/EventLoop.h"
+#include "network/net/TcpConnection.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace tmms::network;
+
+// 跨线程发送的测试：
+// 多个线程同时向同一个连接发送消息，一半用 Send(buf, size) 发送后立即改写缓冲区，
+// 另一半用 Send(list) 发送持有内存的节点且发送方不再保留引用。对端慢速读取，让连接反复写满，
+// 检查每个线程的消息完整且按顺序到达，以及发送完成后节点持有的内存全部释放
+
+// 发送线程数
+const int32_t kThreads = 4;
+
+// 每个线程发送的消息数
+const int32_t kMessages = 20000;
+
+// 消息头：线程编号、序号、消息体长度，各 4 字节
+const int32_t kHeadSize = 12;
+
+// 还没有释放的节点内存数
+std::atomic<int64_t> g_live_owners{0};
+
+// 消息体第 i 个字节的值
+char BodyByte(int32_t tid, int32_t seq, int32_t i)
+{
+    return (char)(tid * 31 + seq * 7 + i);
+}
+
+int32_t BodyLen(int32_t tid, int32_t seq)
+{
+    return (tid * 131 + seq * 977) % 2000;
+}
+
+void WriteMessage(char *p, int32_t tid, int32_t seq)
+{
+    int32_t len = BodyLen(tid, seq);
+    memcpy(p, &tid, 4);
+    memcpy(p + 4, &seq, 4);
+    memcpy(p + 8, &len, 4);
+    for (int32_t i = 0; i < len; i++)
+    {
+        p[kHeadSize + i] = BodyByte(tid, seq, i);
+    }
+}
+
+// 创建一个持有数据的节点，内存释放时计数减一
+BufferNodePtr OwnedNode(const char *data, size_t size)
+{
+    g_live_owners++;
+    std::shared_ptr<std::string> owner(new std::string(data, size), [](std::string *s) {
+        g_live_owners--;
+        delete s;
+    });
+    return std::make_shared<BufferNode>((void *)owner->data(), size, owner);
+}
+
+void Writer(const TcpConnectionPtr &conn, int32_t tid)
+{
+    std::vector<char> buf(kHeadSize + 2000);
+    for (int32_t seq = 0; seq < kMessages; seq++)
+    {
+        WriteMessage(buf.data(), tid, seq);
+        size_t size = kHeadSize + BodyLen(tid, seq);
+        if (seq % 2 == 0)
+        {
+            // 调用返回后立即改写缓冲区，连接必须已经复制了数据
+            conn->Send(buf.data(), size);
+            memset(buf.data(), 0xEE, buf.size());
+        }
+        else
+        {
+            // 消息头和消息体分成两个节点，发送方不保留引用
+            std::list<BufferNodePtr> list;
+            list.emplace_back(OwnedNode(buf.data(), kHeadSize));
+            list.emplace_back(OwnedNode(buf.data() + kHeadSize, size - kHeadSize));
+            conn->Send(std::move(list));
+        }
+    }
+}
+
+// 慢速读取并检查消息，返回错误数
+int64_t Reader(int fd)
+{
+    std::vector<int32_t> next(kThreads, 0);
+    std::string pending;
+    int64_t bad = 0;
+    int64_t received = 0;
+    int64_t reads = 0;
+    char buf[4096];
+    while (received < (int64_t)kThreads * kMessages)
+    {
+        auto n = ::read(fd, buf, sizeof(buf));
+        if (n <= 0)
+        {
+            std::cout << "read failed : " << n << std::endl;
+            return bad + 1;
+        }
+        pending.append(buf, n);
+
+        // 每读 8 次停一下，让发送方的套接字缓冲区写满
+        if (++reads % 8 == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+
+        size_t pos = 0;
+        while (pending.size() - pos >= (size_t)kHeadSize)
+        {
+            int32_t tid, seq, len;
+            memcpy(&tid, pending.data() + pos, 4);
+            memcpy(&seq, pending.data() + pos + 4, 4);
+            memcpy(&len, pending.data() + pos + 8, 4);
+            if (tid < 0 || tid >= kThreads || len != BodyLen(tid, seq))
+            {
+                std::cout << "corrupt header at message " << received << std::endl;
+                return bad + 1;
+            }
+            if (pending.size() - pos < (size_t)(kHeadSize + len))
+            {
+                break;
+            }
+            const char *body = pending.data() + pos + kHeadSize;
+            for (int32_t i = 0; i < len; i++)
+            {
+                if (body[i] != BodyByte(tid, seq, i))
+                {
+                    bad++;
+                    break;
+                }
+            }
+            if (seq != next[tid])
+            {
+                bad++;
+            }
+            next[tid] = seq + 1;
+            pos += kHeadSize + len;
+            received++;
+        }
+        pending.erase(0, pos);
+    }
+    return bad;
+}
+
+int main(int argc, const char **argv)
+{
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    {
+        std::cout << "socketpair failed" << std::endl;
+        return 1;
+    }
+    ::fcntl(fds[0], F_SETFL, ::fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    // 缩小发送缓冲区，让写满和部分写出的情况经常出现
+    int sndbuf = 16 * 1024;
+    ::setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    EventLoop loop;
+    InetAddress addr("127.0.0.1:0");
+    auto conn = std::make_shared<TcpConnection>(&loop, fds[0], addr, addr);
+    loop.AddEvent(conn);
+
+    auto start = std::chrono::steady_clock::now();
+    int64_t bad = 0;
+    std::thread reader([&]() {
+        bad = Reader(fds[1]);
+        loop.RunInLoop([&loop]() { loop.Quit(); });
+    });
+    std::vector<std::thread> writers;
+    for (int32_t t = 0; t < kThreads; t++)
+    {
+        writers.emplace_back(Writer, conn, t);
+    }
+    loop.Loop();
+    for (auto &t : writers)
+    {
+        t.join();
+    }
+    reader.join();
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+
+    std::cout << "send : threads : " << kThreads << " , messages : " << kThreads * kMessages
+              << " , bad : " << bad << " , live owners : " << g_live_owners << " , time : " << ms
+              << "ms" << std::endl;
+
+    // 事件循环析构前关闭连接
+    conn->ForceClose();
+    conn.reset();
+    ::close(fds[1]);
+
+    bool ok = bad == 0 && g_live_owners == 0;
+    std::cout << (ok ? "OK" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+#include "network/net/TimingWheel.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace tmms::network;
+
+// 时间轮的正确性检查和微基准测试，时间由测试推进，不依赖实际时钟：
+// 1. 随机插入延迟从 0 到约 12 天的定时器（覆盖各层），随机取消其中一部分，按随机步长推进时间，
+//    检查未取消的定时器都恰好触发一次且在到期后的第一次推进中触发，取消的定时器不触发，
+//    以及 NextTimeout 不会晚于最早到期的定时器
+// 2. 周期定时器按周期触发，在回调中取消后不再触发
+// 3. 统计插入、取消和插入后触发的平均耗时
+
+// 正确性检查的定时器数
+const int32_t kCheckTimers = 200000;
+
+// 正确性检查推进时间的最大步长(毫秒)
+const int64_t kMaxStep = 5000;
+
+// 基准测试的定时器数
+const int32_t kBenchTimers = 1000000;
+
+struct Record
+{
+    int64_t expire{0};    ///< 到期时间(毫秒)
+    int64_t fired_at{-1}; ///< 触发时的时间(毫秒)
+    int32_t fired{0};     ///< 触发次数
+    bool cancelled{false};
+};
+
+int64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+bool CheckRandom()
+{
+    std::mt19937_64 rng(20261017);
+    TimingWheel wheel;
+    int64_t now = 1000000;
+    int64_t fired = 0;
+    int64_t missed = 0;
+    std::vector<int64_t> times{now};
+    wheel.OnTimer(now);
+
+    std::vector<Record> records(kCheckTimers);
+    std::vector<TimerPtr> timers(kCheckTimers);
+    int32_t added = 0;
+    while (added < kCheckTimers || wheel.Size() > 0)
+    {
+        // 每步插入一批定时器，延迟按对数均匀分布
+        for (int32_t i = 0; i < 64 && added < kCheckTimers; i++, added++)
+        {
+            int64_t delay = rng() % (1ll << (rng() % 31));
+            auto &r = records[added];
+            r.expire = now + std::max<int64_t>(delay, 1);
+            timers[added] = std::make_shared<Timer>([&r, &now, &fired]() {
+                r.fired++;
+                r.fired_at = now;
+                fired++;
+            });
+            wheel.AddTimer(timers[added], delay, now);
+        }
+
+        // 随机取消一个已经插入的定时器
+        auto victim = rng() % added;
+        if (!records[victim].cancelled && timers[victim]->Pending() && rng() % 3 == 0)
+        {
+            records[victim].cancelled = true;
+            wheel.CancelTimer(timers[victim]);
+        }
+
+        // 推进时间，步长小于 NextTimeout 时不应有定时器到期，否则 epoll_wait 会错过定时器
+        auto timeout = wheel.NextTimeout(now, kMaxStep);
+        auto step = 1 + (int64_t)(rng() % kMaxStep);
+        auto before = fired;
+        now += step;
+        times.push_back(now);
+        wheel.OnTimer(now);
+        if (step < timeout && fired != before)
+        {
+            missed++;
+        }
+    }
+
+    // 未取消的定时器恰好触发一次，且在到期后的第一次推进中触发；取消的定时器不触发
+    int64_t bad = 0;
+    for (int32_t i = 0; i < kCheckTimers; i++)
+    {
+        auto &r = records[i];
+        if (r.cancelled)
+        {
+            bad += r.fired != 0;
+            continue;
+        }
+        auto first = *std::lower_bound(times.begin(), times.end(), r.expire);
+        if (r.fired != 1 || r.fired_at != first)
+        {
+            bad++;
+        }
+    }
+    std::cout << "random : timers : " << kCheckTimers << " , steps : " << times.size()
+              << " , end time : " << (now - times.front()) / 1000 << "s , bad : " << bad
+              << " , missed timeout : " << missed << std::endl;
+    return bad == 0 && missed == 0;
+}
+
+bool CheckPeriodic()
+{
+    TimingWheel wheel;
+    int64_t now = 0;
+    int32_t count = 0;
+    TimerPtr timer;
+    timer = std::make_shared<Timer>(
+        [&]() {
+            // 第 100 次触发时在回调中取消
+            if (++count == 100)
+            {
+                wheel.CancelTimer(timer);
+            }
+        },
+        7);
+    wheel.AddTimer(timer, 7, now);
+
+    int32_t at_50 = 0;
+    for (now = 1; now <= 2000; now++)
+    {
+        wheel.OnTimer(now);
+        if (now == 350)
+        {
+            at_50 = count;
+        }
+    }
+    std::cout << "periodic : count at 350ms : " << at_50 << " , total : " << count
+              << " , pending : " << timer->Pending() << std::endl;
+    return at_50 == 50 && count == 100 && !timer->Pending();
+}
+
+void Bench()
+{
+    TimingWheel wheel;
+    int64_t now = 0;
+    int64_t fired = 0;
+    std::vector<TimerPtr> timers;
+    timers.reserve(kBenchTimers);
+    for (int32_t i = 0; i < kBenchTimers; i++)
+    {
+        timers.emplace_back(std::make_shared<Timer>([&fired]() { fired++; }));
+    }
+
+    // 插入：延迟分布在 1ms 到约 65s 之间
+    auto start = NowNs();
+    for (int32_t i = 0; i < kBenchTimers; i++)
+    {
+        wheel.AddTimer(timers[i], 1 + (i * 7919ll) % 65536, now);
+    }
+    auto insert_ns = (NowNs() - start) / kBenchTimers;
+
+    // 重新插入：已经在时间轮中的定时器改为新的延迟
+    start = NowNs();
+    for (int32_t i = 0; i < kBenchTimers; i++)
+    {
+        wheel.AddTimer(timers[i], 1 + (i * 104729ll) % 65536, now);
+    }
+    auto reinsert_ns = (NowNs() - start) / kBenchTimers;
+
+    // 取消一半
+    start = NowNs();
+    for (int32_t i = 0; i < kBenchTimers; i += 2)
+    {
+        wheel.CancelTimer(timers[i]);
+    }
+    auto cancel_ns = (NowNs() - start) / (kBenchTimers / 2);
+
+    // 按 1ms 推进直到另一半全部触发，包括逐层下放的开销
+    start = NowNs();
+    while (wheel.Size() > 0)
+    {
+        wheel.OnTimer(++now);
+    }
+    auto fire_ns = (NowNs() - start) / std::max<int64_t>(fired, 1);
+
+    std::cout << "bench : timers : " << kBenchTimers << " , insert : " << insert_ns
+              << "ns , reinsert : " << reinsert_ns << "ns , cancel : " << cancel_ns
+              << "ns , fire : " << fire_ns << "ns , fired : " << fired << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+    bool ok = CheckRandom();
+    ok = CheckPeriodic() && ok;
+    Bench();
+    std::cout << (ok ? "OK" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}
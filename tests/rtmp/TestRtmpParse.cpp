@@ -0,0 +1,223 @@
+#include "mmedia/rtmp/RtmpContext.h"
+#include "network/base/InetAddress.h"
+#include "network/net/EventLoop.h"
+#include "network/net/TcpConnection.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+
+using namespace tmms::network;
+using namespace tmms::mm;
+
+// RTMP 接收解析的微基准测试：
+// 写线程通过 socketpair 持续发送编码好的音视频消息，读线程按 TcpConnection::OnRead 的方式
+// 读取并交给 RtmpContext 解析，统计读线程每接收 1MB 数据消耗的 CPU 时间。
+
+// 每轮发送的视频帧数
+const int32_t kFramesPerRound = 250;
+
+// 每隔多少帧产生一个关键帧
+const int32_t kGopLength = 25;
+
+// 发送的总字节数
+const int64_t kTotalBytes = 512ll * 1024 * 1024;
+
+/**
+ * @brief 统计收到的媒体消息
+ */
+class BenchHandler : public RtmpHandler
+{
+  public:
+    void OnNewConnection(const TcpConnectionPtr &conn) override
+    {
+    }
+    void OnConnectionDestroy(const TcpConnectionPtr &conn) override
+    {
+    }
+    void OnRecv(const TcpConnectionPtr &conn, const PacketPtr &data) override
+    {
+        Count(data);
+    }
+    void OnRecv(const TcpConnectionPtr &conn, PacketPtr &&data) override
+    {
+        Count(data);
+    }
+    void OnActive(const ConnectionPtr &conn) override
+    {
+    }
+
+    int64_t messages{0};
+    int64_t bytes{0};
+    int64_t errors{0};
+
+  private:
+    void Count(const PacketPtr &data)
+    {
+        // 负载的首字节是按消息序号填充的，校验组装结果是否完整
+        const char *p = data->Data();
+        if (data->PacketSize() < 2 || p[data->PacketSize() - 1] != p[0])
+        {
+            errors++;
+        }
+        messages++;
+        bytes += data->PacketSize();
+    }
+};
+
+// 按 RTMP 块格式编码一条消息，后续块使用 FMT3 块头
+void EncodeMessage(std::string &out, uint8_t csid, uint32_t ts, uint8_t type,
+                   const std::string &body, uint32_t chunk_size)
+{
+    char header[12];
+    header[0] = (char)csid;
+    header[1] = (char)(ts >> 16);
+    header[2] = (char)(ts >> 8);
+    header[3] = (char)ts;
+    header[4] = (char)(body.size() >> 16);
+    header[5] = (char)(body.size() >> 8);
+    header[6] = (char)body.size();
+    header[7] = (char)type;
+    uint32_t sid = 1;
+    memcpy(header + 8, &sid, 4);
+    out.append(header, 12);
+
+    size_t pos = 0;
+    while (true)
+    {
+        size_t n = std::min<size_t>(chunk_size, body.size() - pos);
+        out.append(body, pos, n);
+        pos += n;
+        if (pos >= body.size())
+        {
+            break;
+        }
+        out.push_back((char)(0xC0 | csid));
+    }
+}
+
+// 编码一轮音视频消息，帧大小分布与常见的 2~3Mbps 直播流相近
+std::string EncodeRound(uint32_t chunk_size, int64_t &messages)
+{
+    std::string out;
+    for (int32_t i = 0; i < kFramesPerRound; i++)
+    {
+        size_t size = i % kGopLength == 0 ? 60000 : 3000 + (i * 131) % 5000;
+        EncodeMessage(out, 6, i * 40, 9, std::string(size, (char)i), chunk_size);
+        EncodeMessage(out, 4, i * 40, 8, std::string(300, (char)i), chunk_size);
+        messages += 2;
+    }
+    return out;
+}
+
+int64_t ThreadCpuNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+bool RunBench(EventLoop *loop, uint32_t chunk_size)
+{
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    {
+        std::cout << "socketpair failed." << std::endl;
+        return false;
+    }
+
+    InetAddress addr("127.0.0.1:1935");
+    auto conn = std::make_shared<TcpConnection>(loop, fds[0], addr, addr);
+    loop->AddEvent(conn);
+    BenchHandler handler;
+    RtmpContext context(conn, &handler, false);
+    MsgBuffer buff;
+
+    // 简单握手：C0C1 的版本字段为 0
+    context.StartHandShake();
+    std::string c0c1(1537, '\0');
+    c0c1[0] = '\x03';
+    buff.Append(c0c1.data(), c0c1.size());
+    context.Parse(buff);
+    context.OnWriteComplete();
+    context.OnWriteComplete();
+    std::string c2(1536, '\0');
+    buff.Append(c2.data(), c2.size());
+    context.Parse(buff);
+
+    // 写线程：先设置块大小，再循环发送编码好的消息
+    int64_t expect_messages = 0;
+    int64_t round_messages = 0;
+    std::string round = EncodeRound(chunk_size, round_messages);
+    int64_t rounds = kTotalBytes / round.size() + 1;
+    expect_messages = rounds * round_messages;
+    std::thread writer([&]() {
+        std::string head;
+        std::string body(4, '\0');
+        body[0] = (char)(chunk_size >> 24);
+        body[1] = (char)(chunk_size >> 16);
+        body[2] = (char)(chunk_size >> 8);
+        body[3] = (char)chunk_size;
+        EncodeMessage(head, 2, 0, 1, body, 128);
+        ::write(fds[1], head.data(), head.size());
+        for (int64_t r = 0; r < rounds; r++)
+        {
+            size_t sent = 0;
+            while (sent < round.size())
+            {
+                auto n = ::write(fds[1], round.data() + sent, round.size() - sent);
+                if (n <= 0)
+                {
+                    return;
+                }
+                sent += n;
+            }
+        }
+        ::shutdown(fds[1], SHUT_WR);
+    });
+
+    // 读线程：与 TcpConnection::OnRead 相同，读到数据就交给解析器
+    auto start = std::chrono::steady_clock::now();
+    int64_t cpu_start = ThreadCpuNs();
+    int64_t read_bytes = 0;
+    while (true)
+    {
+        int err = 0;
+        auto n = buff.ReadFd(fds[0], &err);
+        if (n <= 0)
+        {
+            break;
+        }
+        read_bytes += n;
+        context.Parse(buff);
+    }
+    int64_t cpu_ns = ThreadCpuNs() - cpu_start;
+    auto wall_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    writer.join();
+    ::close(fds[1]);
+
+    double mb = read_bytes / (1024.0 * 1024.0);
+    std::cout << "chunk size : " << chunk_size << " , read : " << (int64_t)mb << "MB"
+              << " , messages : " << handler.messages << "/" << expect_messages
+              << " , errors : " << handler.errors << " , wall : " << wall_ms << "ms"
+              << " , cpu : " << cpu_ns / 1000000 << "ms"
+              << " , cpu per MB : " << (int64_t)(cpu_ns / mb / 1000) << "us" << std::endl;
+    return handler.errors == 0 && handler.messages == expect_messages;
+}
+
+int main(int argc, const char **argv)
+{
+    EventLoop loop;
+
+    bool ok = RunBench(&loop, 4096);
+    ok = RunBench(&loop, 128) && ok;
+
+    std::cout << (ok ? "OK" : "FAIL") << std::endl;
+    return ok ? 0 : 1;
+}